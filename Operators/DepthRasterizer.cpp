@@ -0,0 +1,533 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#include "DepthRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if !defined(CEL_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+	#define CEL_SSE2_RASTERIZER
+	#include <emmintrin.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Ogre;
+
+
+/** Clips a convex polygon in clip space against the plane where a * z + w >= 0 */
+static void clipPolygon( const std::vector<Vector4>& in, float a, std::vector<Vector4>& out )
+{
+	out.clear();
+	
+	for (size_t i = 0; i < in.size(); i++) {
+		
+		const Vector4& p = in[i];
+		const Vector4& q = in[(i + 1) % in.size()];
+		float dp = a * p.z + p.w;
+		float dq = a * q.z + q.w;
+		
+		if (dp >= 0)
+			out.push_back(p);
+		
+		if ((dp >= 0) != (dq >= 0)) {
+			float t = dp / (dp - dq);
+			out.push_back(Vector4(p.x + t * (q.x - p.x), p.y + t * (q.y - p.y), 
+								  p.z + t * (q.z - p.z), p.w + t * (q.w - p.w)));
+		}
+	}
+}
+
+
+void DepthRasterizer::begin( int w, int h, const PixelWindow* scissor )
+{
+	width = w;
+	height = h;
+	
+	PixelWindow all = { 0, width - 1, 0, height - 1 };
+	window = scissor ? scissor->intersect(all) : all;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	
+	triangles.clear();
+	bins.assign(tilesX * tilesY, std::vector<size_t>());
+}
+
+
+void DepthRasterizer::addTriangle( const Vector4 clip[3], CullingMode culling, float value )
+{
+	bool nearOut = true, nearIn = true, farOut = true, farIn = true;
+	
+	for (int i = 0; i < 3; i++) {
+		bool inNear = clip[i].z + clip[i].w >= 0;
+		bool inFar = clip[i].w - clip[i].z >= 0;
+		nearOut = nearOut && !inNear;
+		nearIn = nearIn && inNear;
+		farOut = farOut && !inFar;
+		farIn = farIn && inFar;
+	}
+	
+	if (nearOut || farOut)
+		return;
+	
+	if (nearIn && farIn) {
+		addClippedTriangle(clip[0], clip[1], clip[2], culling, value);
+		return;
+	}
+	
+	// crosses the near or far plane: clip, then split the polygon in a fan
+	std::vector<Vector4> polygon(clip, clip + 3), clipped;
+	clipPolygon(polygon, 1, clipped);
+	clipPolygon(clipped, -1, polygon);
+	
+	for (size_t i = 2; i < polygon.size(); i++)
+		addClippedTriangle(polygon[0], polygon[i - 1], polygon[i], culling, value);
+}
+
+
+void DepthRasterizer::addClippedTriangle( const Vector4& a, const Vector4& b, const Vector4& c, CullingMode culling, float value )
+{
+	const Vector4* v[3] = { &a, &b, &c };
+	ScreenTriangle t;
+	float z[3];
+	
+	for (int i = 0; i < 3; i++) {
+		// the near plane keeps w > 0 for perspective projections, w is 1 otherwise
+		if (v[i]->w <= 0)
+			return;
+		
+		// snapped to 1/16 of pixel like the GPU, so that the edge functions are exact
+		float invW = 1.0f / v[i]->w;
+		t.x[i] = std::floor((v[i]->x * invW + 1) * 8.0f * width + 0.5f) / 16.0f;
+		t.y[i] = std::floor((1 - v[i]->y * invW) * 8.0f * height + 0.5f) / 16.0f;
+		z[i] = std::min(1.0f, std::max(0.0f, (v[i]->z * invW + 1) * 0.5f));
+	}
+	
+	// positive when the triangle is clockwise on screen, i.e. anticlockwise in normalized coordinates
+	double area = ((double)t.x[1] - t.x[0]) * ((double)t.y[2] - t.y[0]) - ((double)t.x[2] - t.x[0]) * ((double)t.y[1] - t.y[0]);
+	
+	if (area == 0 || 
+		(culling == CULL_CLOCKWISE && area > 0) || 
+		(culling == CULL_ANTICLOCKWISE && area < 0))
+		return;
+	
+	// orders the vertices so that the inside of the edges is positive
+	if (area < 0) {
+		std::swap(t.x[1], t.x[2]);
+		std::swap(t.y[1], t.y[2]);
+		std::swap(z[1], z[2]);
+		area = -area;
+	}
+	
+	// pixels whose center is inside the bounds
+	float minX = std::max(-1.0f, std::min(t.x[0], std::min(t.x[1], t.x[2])));
+	float maxX = std::min((float)width, std::max(t.x[0], std::max(t.x[1], t.x[2])));
+	float minY = std::max(-1.0f, std::min(t.y[0], std::min(t.y[1], t.y[2])));
+	float maxY = std::min((float)height, std::max(t.y[0], std::max(t.y[1], t.y[2])));
+	
+	t.minX = std::max(window.minX, (int)std::ceil(minX - 0.5f));
+	t.maxX = std::min(window.maxX, (int)std::floor(maxX - 0.5f));
+	t.minY = std::max(window.minY, (int)std::ceil(minY - 0.5f));
+	t.maxY = std::min(window.maxY, (int)std::floor(maxY - 0.5f));
+	
+	if (t.minX > t.maxX || t.minY > t.maxY)
+		return;
+	
+	// depth plane through the three vertices
+	double dx1 = (double)t.x[1] - t.x[0], dy1 = (double)t.y[1] - t.y[0], dz1 = (double)z[1] - z[0];
+	double dx2 = (double)t.x[2] - t.x[0], dy2 = (double)t.y[2] - t.y[0], dz2 = (double)z[2] - z[0];
+	t.z = z[0];
+	t.dzdx = (dz1 * dy2 - dz2 * dy1) / area;
+	t.dzdy = (dz2 * dx1 - dz1 * dx2) / area;
+	t.value = value;
+	
+	triangles.push_back(t);
+	
+	for (int ty = t.minY / tileSize; ty <= t.maxY / tileSize; ty++)
+		for (int tx = t.minX / tileSize; tx <= t.maxX / tileSize; tx++)
+			bins[ty * tilesX + tx].push_back(triangles.size() - 1);
+}
+
+
+void DepthRasterizer::rasterizeTile( int tile, std::vector<float>& depth, std::vector<float>& values )
+{
+	int x0 = (tile % tilesX) * tileSize;
+	int y0 = (tile / tilesX) * tileSize;
+	
+	std::fill(depth.begin(), depth.end(), 1.0f);
+	std::fill(values.begin(), values.end(), 0.0f);
+	
+	const std::vector<size_t>& bin = bins[tile];
+	
+	for (size_t i = 0; i < bin.size(); i++) {
+		
+		const ScreenTriangle& t = triangles[bin[i]];
+		
+		// edge functions, positive inside, with the top-left rule for the pixels on the edges.
+		// Both the snapped vertices and the pixel centers are on a grid of 1/16 of pixel, so in
+		// double precision the edge functions are exact and shared edges have no cracks
+		double ex[3], ey[3];
+		bool topLeft[3];
+		
+		for (int e = 0; e < 3; e++) {
+			int p = (e + 1) % 3, q = (e + 2) % 3;
+			ex[e] = (double)t.x[q] - t.x[p];
+			ey[e] = (double)t.y[q] - t.y[p];
+			topLeft[e] = ey[e] < 0 || (ey[e] == 0 && ex[e] > 0);
+		}
+		
+		int xs = std::max(t.minX, x0), xe = std::min(t.maxX, x0 + tileSize - 1);
+		int ys = std::max(t.minY, y0), ye = std::min(t.maxY, y0 + tileSize - 1);
+		
+#ifdef CEL_SSE2_RASTERIZER
+		// 4 pixels at a time, from a multiple of 4 in the tile, the extra pixels are outside the triangle
+		xs = x0 + ((xs - x0) & ~3);
+		
+		__m128 zero = _mm_setzero_ps();
+		__m128 dz = _mm_set_ps(3 * (float)t.dzdx, 2 * (float)t.dzdx, (float)t.dzdx, 0);
+		__m128 dzStep = _mm_set1_ps(4 * (float)t.dzdx);
+		__m128 value = _mm_set1_ps(t.value);
+		__m128 writeDepth = t.value < 0 ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+		__m128 tl[3];
+		__m128d stepX[3];
+		for (int e = 0; e < 3; e++) {
+			tl[e] = topLeft[e] ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+			stepX[e] = _mm_set1_pd(-4 * ey[e]);
+		}
+		
+		for (int y = ys; y <= ye; y++) {
+			
+			float* zrow = &depth[(y - y0) * tileSize];
+			float* vrow = &values[(y - y0) * tileSize];
+			double py = y + 0.5;
+			
+			// depth of the first pixel, then stepped
+			__m128 z = _mm_add_ps(_mm_set1_ps((float)(t.z + t.dzdx * (xs + 0.5 - t.x[0]) + t.dzdy * (py - t.y[0]))), dz);
+			
+			// edge functions of the first 4 pixels, then stepped exactly
+			__m128d w01[3], w23[3];
+			for (int e = 0; e < 3; e++) {
+				int p = (e + 1) % 3;
+				double w = ex[e] * (py - t.y[p]) - ey[e] * (xs + 0.5 - t.x[p]);
+				w01[e] = _mm_set_pd(w - ey[e], w);
+				w23[e] = _mm_set_pd(w - 3 * ey[e], w - 2 * ey[e]);
+			}
+			
+			for (int x = xs; x <= xe; x += 4, z = _mm_add_ps(z, dzStep)) {
+				
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				
+				for (int e = 0; e < 3; e++) {
+					// the conversion to float keeps the sign and the zeros
+					__m128 w = _mm_movelh_ps(_mm_cvtpd_ps(w01[e]), _mm_cvtpd_ps(w23[e]));
+					__m128 in = _mm_or_ps(_mm_cmpgt_ps(w, zero), _mm_and_ps(_mm_cmpeq_ps(w, zero), tl[e]));
+					inside = _mm_and_ps(inside, in);
+					w01[e] = _mm_add_pd(w01[e], stepX[e]);
+					w23[e] = _mm_add_pd(w23[e], stepX[e]);
+				}
+				
+				__m128 old = _mm_loadu_ps(zrow + (x - x0));
+				__m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+				
+				if (_mm_movemask_ps(pass) == 0)
+					continue;
+				
+				__m128 v = _mm_or_ps(_mm_and_ps(writeDepth, z), _mm_andnot_ps(writeDepth, value));
+				_mm_storeu_ps(zrow + (x - x0), _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+				_mm_storeu_ps(vrow + (x - x0), _mm_or_ps(_mm_and_ps(pass, v), _mm_andnot_ps(pass, _mm_loadu_ps(vrow + (x - x0)))));
+			}
+		}
+#else
+		for (int y = ys; y <= ye; y++) {
+			
+			float* zrow = &depth[(y - y0) * tileSize];
+			float* vrow = &values[(y - y0) * tileSize];
+			double py = y + 0.5;
+			
+			for (int x = xs; x <= xe; x++) {
+				
+				double px = x + 0.5;
+				bool inside = true;
+				
+				for (int e = 0; e < 3 && inside; e++) {
+					int p = (e + 1) % 3;
+					double w = ex[e] * (py - t.y[p]) - ey[e] * (px - t.x[p]);
+					inside = w > 0 || (w == 0 && topLeft[e]);
+				}
+				
+				float z = (float)(t.z + t.dzdx * (px - t.x[0]) + t.dzdy * (py - t.y[0]));
+				
+				if (inside && z < zrow[x - x0]) {
+					zrow[x - x0] = z;
+					vrow[x - x0] = t.value < 0 ? z : t.value;
+				}
+			}
+		}
+#endif
+	}
+}
+
+
+void DepthRasterizer::finish( Image* image, int face )
+{
+	PixelWindow all = { 0, width - 1, 0, height - 1 };
+	
+	write(image, face, all);
+}
+
+
+void DepthRasterizer::finishWindow( Image* image )
+{
+	write(image, 0, window);
+}
+
+
+void DepthRasterizer::write( Image* image, int face, const PixelWindow& region )
+{
+	PixelBox box = image->getPixelBox(face);
+	int tiles = tilesX * tilesY;
+	
+#ifdef _OPENMP
+	int n = (PixelSet::threads > 0) ? PixelSet::threads : omp_get_num_procs();
+	#pragma omp parallel num_threads(std::max(1, std::min(n, tiles)))
+#endif
+	{
+		std::vector<float> depth(tileSize * tileSize), values(tileSize * tileSize);
+		
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic)
+#endif
+		for (int tile = 0; tile < tiles; tile++) {
+			
+			int x0 = (tile % tilesX) * tileSize;
+			int y0 = (tile / tilesX) * tileSize;
+			PixelWindow tileWindow = { x0, std::min(x0 + tileSize, width) - 1, y0, std::min(y0 + tileSize, height) - 1 };
+			
+			// Tiles out of the region are not written at all
+			PixelWindow w = tileWindow.intersect(region);
+			if (w.isEmpty())
+				continue;
+			
+			rasterizeTile(tile, depth, values);
+			
+			int count = w.maxX - w.minX + 1;
+			
+			for (int y = w.minY; y <= w.maxY; y++) {
+				
+				const float* v = &values[(y - y0) * tileSize + w.minX - x0];
+				size_t offset = (y - region.minY) * box.rowPitch + w.minX - region.minX;
+				
+				if (box.format == PF_FLOAT32_R) {
+					float* row = static_cast<float*>(box.data) + offset;
+					std::copy(v, v + count, row);
+				}
+				else {
+					uint16* row = static_cast<uint16*>(box.data) + offset;
+					for (int x = 0; x < count; x++)
+						row[x] = (uint16)(std::min(1.0f, std::max(0.0f, v[x])) * 65535.0f + 0.5f);
+				}
+			}
+		}
+	}
+	
+	triangles.clear();
+	bins.clear();
+}
+
+
+void DepthRasterizer::render( SceneManager* sceneManager, Camera* camera, uint32 visibilityMask, Image* image, int face, const PixelWindow* scissor )
+{
+	// as the render system does before rendering, with no frame to trigger it
+	sceneManager->getRootSceneNode()->_update(true, false);
+	
+	begin((int)image->getWidth(), (int)image->getHeight(), scissor);
+	addNode(sceneManager->getRootSceneNode(), camera, visibilityMask);
+	finish(image, face);
+}
+
+
+void DepthRasterizer::render( SceneManager* sceneManager, Camera* camera, uint32 visibilityMask, int width, int height, const PixelWindow& window, Image* image )
+{
+	sceneManager->getRootSceneNode()->_update(true, false);
+	
+	begin(width, height, &window);
+	addNode(sceneManager->getRootSceneNode(), camera, visibilityMask);
+	finishWindow(image);
+}
+
+
+void DepthRasterizer::addNode( SceneNode* sceneNode, Camera* camera, uint32 visibilityMask )
+{
+	SceneNode::ObjectIterator objects = sceneNode->getAttachedObjectIterator();
+	
+	while (objects.hasMoreElements()) {
+		
+		MovableObject* object = objects.getNext();
+		
+		if (!object->isVisible() || !(object->getVisibilityFlags() & visibilityMask) || 
+			!camera->isVisible(object->getWorldBoundingBox(true)))
+			continue;
+		
+		if (Entity* entity = dynamic_cast<Entity*>(object)) {
+			
+			// the GPU may render it animated, its pixel sets can differ
+			if ((entity->hasSkeleton() || entity->hasVertexAnimation()) && warnedEntities.insert(entity->getName()).second)
+				LogManager::getSingleton().logMessage("Depth rasterizer, animation ignored: " + entity->getName() + 
+					" is rendered in its bind pose", LML_CRITICAL);
+			
+			for (unsigned int i = 0; i < entity->getNumSubEntities(); i++)
+				if (entity->getSubEntity(i)->isVisible())
+					addRenderable(entity->getSubEntity(i), camera);
+		}
+		else if (ManualObject* manual = dynamic_cast<ManualObject*>(object)) {
+			for (unsigned int i = 0; i < manual->getNumSections(); i++)
+				addRenderable(manual->getSection(i), camera);
+		}
+		else if (Renderable* renderable = dynamic_cast<Renderable*>(object))
+			addRenderable(renderable, camera);
+	}
+	
+	SceneNode::ChildNodeIterator children = sceneNode->getChildIterator();
+	
+	while (children.hasMoreElements())
+		addNode(static_cast<SceneNode*>(children.getNext()), camera, visibilityMask);
+}
+
+
+void DepthRasterizer::addRenderable( Renderable* renderable, Camera* camera )
+{
+	RenderOperation operation;
+	renderable->getRenderOperation(operation);
+	
+	if ((operation.operationType != RenderOperation::OT_TRIANGLE_LIST && 
+		 operation.operationType != RenderOperation::OT_TRIANGLE_STRIP && 
+		 operation.operationType != RenderOperation::OT_TRIANGLE_FAN) || !operation.vertexData)
+		return;
+	
+	// culling and written value from the pass of the depth scheme, the depth by default
+	CullingMode culling = CULL_CLOCKWISE;
+	float value = -1;
+	const MaterialPtr& material = renderable->getMaterial();
+	
+	if (!material.isNull()) {
+		for (unsigned short i = 0; i < material->getNumTechniques(); i++) {
+			Technique* technique = material->getTechnique(i);
+			if (technique->getSchemeName() == "CEL_Depth_Scheme" && technique->getNumPasses() > 0) {
+				Pass* pass = technique->getPass(0);
+				culling = pass->getCullingMode();
+				if (!pass->hasFragmentProgram())
+					value = pass->getAmbient().r;
+				break;
+			}
+		}
+	}
+	
+	Matrix4 world;
+	renderable->getWorldTransforms(&world);
+	Matrix4 transform = 
+		(renderable->getUseIdentityProjection() ? Matrix4::IDENTITY : camera->getProjectionMatrix()) * 
+		(renderable->getUseIdentityView() ? Matrix4::IDENTITY : camera->getViewMatrix()) * world;
+	
+	// vertices in clip space
+	const VertexData* vertexData = operation.vertexData;
+	const VertexElement* position = vertexData->vertexDeclaration->findElementBySemantic(VES_POSITION);
+	
+	if (!position)
+		return;
+	
+	HardwareVertexBufferSharedPtr vertexBuffer = vertexData->vertexBufferBinding->getBuffer(position->getSource());
+	unsigned char* vertex = static_cast<unsigned char*>(vertexBuffer->lock(HardwareBuffer::HBL_READ_ONLY)) + 
+		vertexData->vertexStart * vertexBuffer->getVertexSize();
+	
+	std::vector<Vector4> clip(vertexData->vertexCount);
+	
+	for (size_t i = 0; i < vertexData->vertexCount; i++, vertex += vertexBuffer->getVertexSize()) {
+		float* p;
+		position->baseVertexPointerToElement(vertex, &p);
+		clip[i] = transform * Vector4(p[0], p[1], p[2], 1);
+	}
+	
+	vertexBuffer->unlock();
+	
+	// vertex indices, relative to vertexStart
+	std::vector<uint32> indices;
+	
+	if (operation.useIndexes && operation.indexData) {
+		const IndexData* indexData = operation.indexData;
+		HardwareIndexBufferSharedPtr indexBuffer = indexData->indexBuffer;
+		const void* data = indexBuffer->lock(HardwareBuffer::HBL_READ_ONLY);
+		
+		indices.resize(indexData->indexCount);
+		
+		for (size_t i = 0; i < indexData->indexCount; i++)
+			indices[i] = (indexBuffer->getType() == HardwareIndexBuffer::IT_32BIT) ? 
+				static_cast<const uint32*>(data)[indexData->indexStart + i] : 
+				static_cast<const uint16*>(data)[indexData->indexStart + i];
+		
+		indexBuffer->unlock();
+	}
+	else {
+		indices.resize(vertexData->vertexCount);
+		for (size_t i = 0; i < indices.size(); i++)
+			indices[i] = (uint32)i;
+	}
+	
+	// triangles, strips alternating their winding
+	Vector4 triangle[3];
+	
+	for (size_t i = 2; i < indices.size(); i += (operation.operationType == RenderOperation::OT_TRIANGLE_LIST) ? 3 : 1) {
+		
+		uint32 i0, i1, i2;
+		
+		if (operation.operationType == RenderOperation::OT_TRIANGLE_LIST) {
+			i0 = indices[i - 2]; i1 = indices[i - 1]; i2 = indices[i];
+		}
+		else if (operation.operationType == RenderOperation::OT_TRIANGLE_FAN) {
+			i0 = indices[0]; i1 = indices[i - 1]; i2 = indices[i];
+		}
+		else if (i % 2 == 0) {
+			i0 = indices[i - 2]; i1 = indices[i - 1]; i2 = indices[i];
+		}
+		else {
+			i0 = indices[i - 1]; i1 = indices[i - 2]; i2 = indices[i];
+		}
+		
+		if (i0 >= clip.size() || i1 >= clip.size() || i2 >= clip.size())
+			continue;
+		
+		triangle[0] = clip[i0];
+		triangle[1] = clip[i1];
+		triangle[2] = clip[i2];
+		addTriangle(triangle, culling, value);
+	}
+}
@@ -0,0 +1,144 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#ifndef _dDepthRasterizer // to avoid duplicate inclusions
+#define _dDepthRasterizer
+
+#include "Ogre.h"
+#include "PixelSet.h"
+
+#include <set>
+#include <vector>
+
+/** @brief Renders the depth of a scene on the CPU, the way the CEL_Depth_Scheme does on the GPU,
+	so that pixel sets can be computed without a rendering context.
+ @remarks the triangles of the visible renderables are read from their vertex and index 
+	buffers, clipped against the near and far planes, culled as the pass of the depth scheme 
+	says, and rasterized in square tiles of tileSize pixels, possibly in parallel 
+	(see PixelSet::threads), with a depth test keeping the nearest surface.
+	Like the GPU, each pixel gets the depth in [0,1] of the nearest triangle covering its 
+	center, or 0 if there is none. Depths may differ from the GPU ones by the precision of 
+	the depth buffer, and pixels lying exactly on the edge of a triangle may be covered 
+	differently. Skeletal and vertex animations and vertex programs other than Depth_VS are 
+	ignored: meshes are rendered in their bind pose, and a warning is logged the first time 
+	an animated entity is rasterized.
+*/
+class DepthRasterizer
+{
+
+public:
+	
+	/** Side of the square tiles the image is rasterized in */
+	static const int tileSize = 64;
+	
+	/** Renders the depth of the objects of the scene whose visibility flags meet visibilityMask, 
+	 as seen from camera, into a face of image.
+	 @param sceneManager	the scene to render
+	 @param camera			camera giving the view and the projection
+	 @param visibilityMask	mask of the visible objects, as for a viewport
+	 @param image			image receiving the depth, PF_L16 or PF_FLOAT32_R
+	 @param face			face of the image
+	 @param scissor			if not NULL, only the pixels of the window are drawn, the others are left empty
+	 */
+	void render( Ogre::SceneManager* sceneManager, Ogre::Camera* camera, Ogre::uint32 visibilityMask, Ogre::Image* image, int face = 0, const PixelWindow* scissor = 0 );
+	
+	/** Same, only rendering the pixels of window, of a rendering of width x height pixels.
+	 @param image			image receiving the depth of the window, of its size: its first pixel
+							is the top left corner of the window
+	 */
+	void render( Ogre::SceneManager* sceneManager, Ogre::Camera* camera, Ogre::uint32 visibilityMask, int width, int height, const PixelWindow& window, Ogre::Image* image );
+	
+	/** Starts a rendering of width x height pixels, with no triangles, drawing only the pixels of scissor if any */
+	void begin( int width, int height, const PixelWindow* scissor = 0 );
+	
+	/** Adds a triangle given in clip space. 
+	 @param clip		vertices of the triangle, after the projection
+	 @param culling		the faces that are not drawn, as for a pass
+	 @param value		value written for the triangle, or a negative number to write its depth
+	 */
+	void addTriangle( const Ogre::Vector4 clip[3], Ogre::CullingMode culling, float value = -1 );
+	
+	/** Rasterizes the triangles added since begin() into a face of image */
+	void finish( Ogre::Image* image, int face = 0 );
+	
+	/** Same, writing only the pixels of the scissor window given to begin() into image, 
+		whose first pixel is the top left corner of the window */
+	void finishWindow( Ogre::Image* image );
+	
+private:
+	
+	/** A triangle in pixel coordinates, y going down, with its depth plane */
+	struct ScreenTriangle {
+		
+		/** vertices, ordered so that the inside of all edges is positive */
+		float x[3], y[3];
+		
+		/** depth at (x, y) is z + dzdx * (x - x[0]) + dzdy * (y - y[0]) */
+		double z, dzdx, dzdy;
+		
+		/** value written for the triangle, negative to write its depth */
+		float value;
+		
+		/** pixels whose center can be inside the triangle, clipped to the scissor window */
+		int minX, maxX, minY, maxY;
+	};
+	
+	/** Adds the triangles of the objects attached to the scene node and its children */
+	void addNode( Ogre::SceneNode* sceneNode, Ogre::Camera* camera, Ogre::uint32 visibilityMask );
+	
+	/** Adds the triangles of a renderable */
+	void addRenderable( Ogre::Renderable* renderable, Ogre::Camera* camera );
+	
+	/** Adds a triangle whose vertices are all in front of the near plane and behind the far one */
+	void addClippedTriangle( const Ogre::Vector4& a, const Ogre::Vector4& b, const Ogre::Vector4& c, Ogre::CullingMode culling, float value );
+	
+	/** Rasterizes the tiles touching region, and writes the pixels of region into a face of image, 
+		pixel (region.minX, region.minY) going to its first pixel */
+	void write( Ogre::Image* image, int face, const PixelWindow& region );
+	
+	/** Rasterizes the triangles of a tile into its depth and value buffers */
+	void rasterizeTile( int tile, std::vector<float>& depth, std::vector<float>& values );
+	
+	int width, height;
+	int tilesX, tilesY;
+	
+	/** the pixels that are drawn */
+	PixelWindow window;
+	
+	/** the triangles of the rendering, and the ones touching each tile, in order */
+	std::vector<ScreenTriangle> triangles;
+	std::vector<std::vector<size_t> > bins;
+	
+	/** names of the animated entities that were warned about */
+	std::set<Ogre::String> warnedEntities;
+	
+};
+
+#endif
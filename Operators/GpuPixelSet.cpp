@@ -0,0 +1,492 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#include "GpuPixelSet.h"
+
+using namespace Ogre;
+
+
+/** Relations computed by Slice_FS */
+enum SliceRelation { SLICE_LEFT = 0, SLICE_RIGHT = 1, SLICE_ABOVE = 2, SLICE_BELOW = 3 };
+
+/** Extent of the pixels of an empty pixel set, as written by Extents_FS */
+static const float emptyExtent = 1.0e9f;
+
+
+class GpuPixelSet::Passes
+{
+	
+public:
+	
+	/** The passes of the Renderer::OgreRenderer, created the first time they are needed */
+	static Passes& get();
+	
+	/** Destroys the passes, if they were created */
+	static void destroy();
+	
+	/** true if the GPU can evaluate pixel sets, nothing below is set up otherwise */
+	bool available;
+	
+	/** Takes a render texture of the pool, for a pixel set or the extents of one */
+	TexturePtr acquireSet();
+	TexturePtr acquireExtents();
+	
+	/** Gives back a render texture taken from the pool */
+	void releaseSet( const TexturePtr& texture ) { freeSets.push_back(texture); }
+	void releaseExtents( const TexturePtr& texture ) { freeExtents.push_back(texture); }
+	
+	/** Draws a quad covering the target with the material, whose texture units read source and other */
+	void run( const MaterialPtr& material, const TexturePtr& target, const TexturePtr& source, const TexturePtr& other = TexturePtr() );
+	
+	/** Materials of the passes, each running the fragment program of the same name */
+	MaterialPtr overlap, coveredBy, slice, count, extents, reduce;
+	
+	/** Levels of the reduction of the extents, each one half the size of the previous one,
+		the first one half the size of the viewport. The last pass writes a 1x1 texture. */
+	std::vector<TexturePtr> reduction;
+	
+	/** Query counting the pixels drawn by the count pass */
+	HardwareOcclusionQuery* query;
+	
+private:
+	
+	Passes();
+	~Passes();
+	
+	/** Creates a render texture with a viewport, which the passes render to without clearing it */
+	TexturePtr createTarget( const String& name, int width, int height, PixelFormat format );
+	
+	/** Creates a material running a fragment program on textures texture units */
+	MaterialPtr createMaterial( const String& name, const String& program, int textures );
+	
+	/** Render textures not in use, and all the ones created */
+	std::vector<TexturePtr> freeSets, freeExtents;
+	std::vector<TexturePtr> targets;
+	
+	/** Quad covering the viewport */
+	Rectangle2D* quad;
+	
+	SceneManager* sceneManager;
+	int width, height;
+	
+	static Passes* instance;
+	
+};
+
+
+GpuPixelSet::Passes* GpuPixelSet::Passes::instance = 0;
+
+
+GpuPixelSet::Passes& GpuPixelSet::Passes::get()
+{
+	if (!instance)
+		instance = new Passes();
+	
+	return *instance;
+}
+
+
+void GpuPixelSet::Passes::destroy()
+{
+	delete instance;
+	instance = 0;
+}
+
+
+GpuPixelSet::Passes::Passes() : available(false), query(0), quad(0), sceneManager(0), width(0), height(0)
+{
+	Renderer* renderer = Renderer::OgreRenderer;
+	RenderSystem* renderSystem = Root::getSingletonPtr()->getRenderSystem();
+	
+	if (!renderer || renderer->isSoftware() || !renderSystem)
+		return;
+	
+	// The programs are GLSL, the reduction needs float render textures and the count occlusion queries
+	const RenderSystemCapabilities* capabilities = renderSystem->getCapabilities();
+	
+	if (!capabilities->hasCapability(RSC_HWOCCLUSION) || !capabilities->hasCapability(RSC_TEXTURE_FLOAT) ||
+		!GpuProgramManager::getSingleton().isSyntaxSupported("glsl"))
+		return;
+	
+	sceneManager = renderer->getOffScreenCamera()->getSceneManager();
+	width = renderer->getViewportWidth();
+	height = renderer->getViewportHeight();
+	
+	overlap = createMaterial("CEL/Gpu/Overlap", "Overlap_FS", 2);
+	coveredBy = createMaterial("CEL/Gpu/CoveredBy", "CoveredBy_FS", 2);
+	slice = createMaterial("CEL/Gpu/Slice", "Slice_FS", 2);
+	count = createMaterial("CEL/Gpu/Count", "Count_FS", 1);
+	extents = createMaterial("CEL/Gpu/Extents", "Extents_FS", 1);
+	reduce = createMaterial("CEL/Gpu/Reduce", "Reduce_FS", 1);
+	
+	// Only the pixels that pass are counted, nothing needs to be written
+	count->getTechnique(0)->getPass(0)->setColourWriteEnabled(false);
+	
+	MaterialPtr materials[] = { overlap, coveredBy, slice, count, extents, reduce };
+	for (int i = 0; i < 6; i++)
+		if (materials[i]->getNumSupportedTechniques() == 0)
+			return;
+	
+	for (int w = (width + 1) / 2, h = (height + 1) / 2; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2)
+		reduction.push_back( createTarget("CEL_Gpu_Reduction" + StringConverter::toString(reduction.size()), w, h, PF_FLOAT32_RGBA) );
+	
+	quad = new Rectangle2D();
+	quad->setCorners(-1, 1, 1, -1);
+	
+	query = renderSystem->createHardwareOcclusionQuery();
+	
+	available = true;
+}
+
+
+GpuPixelSet::Passes::~Passes()
+{
+	if (query)
+		Root::getSingletonPtr()->getRenderSystem()->destroyHardwareOcclusionQuery(query);
+	
+	delete quad;
+	
+	for (size_t i = 0; i < targets.size(); i++) {
+		RenderTarget* target = targets[i]->getBuffer()->getRenderTarget();
+		target->removeAllViewports();
+		Root::getSingletonPtr()->getRenderSystem()->destroyRenderTarget(target->getName());
+		Root::getSingletonPtr()->getRenderSystem()->destroyRenderTexture(targets[i]->getName());
+	}
+	
+	MaterialPtr materials[] = { overlap, coveredBy, slice, count, extents, reduce };
+	for (int i = 0; i < 6; i++)
+		if (!materials[i].isNull())
+			MaterialManager::getSingleton().remove(materials[i]->getName());
+}
+
+
+TexturePtr GpuPixelSet::Passes::createTarget( const String& name, int width, int height, PixelFormat format )
+{
+	TexturePtr texture = Root::getSingletonPtr()->getTextureManager()->createManual(
+		name,
+		"Default",
+		TEX_TYPE_2D,
+		width,
+		height,
+		0,
+		format,
+		TU_RENDERTARGET
+	);
+	
+	// Pixel sets are rendered by Renderer::RenderInto() through the viewport
+	RenderTarget* target = texture->getBuffer()->getRenderTarget();
+	target->setAutoUpdated(false);
+	
+	Viewport* viewport = target->addViewport(Renderer::OgreRenderer->getOffScreenCamera());
+	viewport->setSkiesEnabled(false);
+	viewport->setShadowsEnabled(false);
+	viewport->setBackgroundColour( ColourValue(0,0,0,1));
+	viewport->setOverlaysEnabled( false );
+	viewport->setClearEveryFrame ( true );
+	viewport->setMaterialScheme("CEL_Depth_Scheme");
+	
+	targets.push_back(texture);
+	
+	return texture;
+}
+
+
+MaterialPtr GpuPixelSet::Passes::createMaterial( const String& name, const String& program, int textures )
+{
+	MaterialPtr material = MaterialManager::getSingleton().create(name, "Default");
+	
+	// The quad covers the target, each pixel is written once whatever was there
+	Pass* pass = material->getTechnique(0)->getPass(0);
+	pass->setLightingEnabled(false);
+	pass->setDepthCheckEnabled(false);
+	pass->setDepthWriteEnabled(false);
+	pass->setCullingMode(CULL_NONE);
+	pass->setFragmentProgram(program);
+	
+	// Pixels are read one by one, never in between
+	for (int i = 0; i < textures; i++) {
+		TextureUnitState* unit = pass->createTextureUnitState();
+		unit->setTextureFiltering(TFO_NONE);
+		unit->setTextureAddressingMode(TextureUnitState::TAM_CLAMP);
+	}
+	
+	material->load();
+	
+	return material;
+}
+
+
+TexturePtr GpuPixelSet::Passes::acquireSet()
+{
+	if (freeSets.empty())
+		return createTarget("CEL_Gpu_PixelSet" + StringConverter::toString(targets.size()), width, height, PF_L16);
+	
+	TexturePtr texture = freeSets.back();
+	freeSets.pop_back();
+	
+	return texture;
+}
+
+
+TexturePtr GpuPixelSet::Passes::acquireExtents()
+{
+	if (freeExtents.empty())
+		return createTarget("CEL_Gpu_Extents" + StringConverter::toString(targets.size()), 1, 1, PF_FLOAT32_RGBA);
+	
+	TexturePtr texture = freeExtents.back();
+	freeExtents.pop_back();
+	
+	return texture;
+}
+
+
+void GpuPixelSet::Passes::run( const MaterialPtr& material, const TexturePtr& target, const TexturePtr& source, const TexturePtr& other )
+{
+	Pass* pass = material->getTechnique(0)->getPass(0);
+	
+	pass->getTextureUnitState(0)->setTextureName(source->getName());
+	if (!other.isNull())
+		pass->getTextureUnitState(1)->setTextureName(other->getName());
+	
+	float size[] = { (float)source->getWidth(), (float)source->getHeight() };
+	pass->getFragmentProgramParameters()->setNamedConstant("size", size, 1, 2);
+	
+	RenderOperation operation;
+	quad->getRenderOperation(operation);
+	
+	Viewport* viewport = target->getBuffer()->getRenderTarget()->getViewport(0);
+	
+	sceneManager->manualRender(&operation, pass, viewport, Matrix4::IDENTITY, Matrix4::IDENTITY, Matrix4::IDENTITY, true);
+}
+
+
+GpuPixelSet* GpuPixelSet::Render( const std::vector<String>& sceneNodes, RenderingMode mode )
+{
+	if (!isAvailable())
+		return NULL;
+	
+	std::vector<SceneNode*> nodes;
+	Renderer::OgreRenderer->ResolveNodes(sceneNodes, nodes);
+	
+	return Render(nodes, mode);
+}
+
+
+GpuPixelSet* GpuPixelSet::Render( const std::vector<SceneNode*>& sceneNodes, RenderingMode mode )
+{
+	if (!isAvailable())
+		return NULL;
+	
+	GpuPixelSet* result = new GpuPixelSet();
+	
+	// Nodes out of the view leave the texture cleared, and the count is known
+	if (!Renderer::OgreRenderer->RenderInto(sceneNodes, mode, result->texture->getBuffer()->getRenderTarget()))
+		result->count = 0;
+	
+	return result;
+}
+
+
+bool GpuPixelSet::isAvailable()
+{
+	return Renderer::OgreRenderer && Passes::get().available;
+}
+
+
+void GpuPixelSet::shutdown()
+{
+	Passes::destroy();
+}
+
+
+GpuPixelSet::GpuPixelSet() : extentsRead(false), count(-1)
+{
+	texture = Passes::get().acquireSet();
+}
+
+
+GpuPixelSet::~GpuPixelSet()
+{
+	Passes::get().releaseSet(texture);
+	
+	if (!extentsTexture.isNull())
+		Passes::get().releaseExtents(extentsTexture);
+}
+
+
+GpuPixelSet* GpuPixelSet::Overlap( GpuPixelSet* ps )
+{
+	Passes& passes = Passes::get();
+	GpuPixelSet* result = new GpuPixelSet();
+	
+	passes.run(passes.overlap, result->texture, texture, ps->texture);
+	
+	return result;
+}
+
+
+GpuPixelSet* GpuPixelSet::CoveredBy( GpuPixelSet* ps )
+{
+	Passes& passes = Passes::get();
+	GpuPixelSet* result = new GpuPixelSet();
+	
+	passes.run(passes.coveredBy, result->texture, texture, ps->texture);
+	
+	return result;
+}
+
+
+GpuPixelSet* GpuPixelSet::Left( GpuPixelSet* ps )
+{
+	return slice(ps, SLICE_LEFT);
+}
+
+
+GpuPixelSet* GpuPixelSet::Right( GpuPixelSet* ps )
+{
+	return slice(ps, SLICE_RIGHT);
+}
+
+
+GpuPixelSet* GpuPixelSet::Above( GpuPixelSet* ps )
+{
+	return slice(ps, SLICE_ABOVE);
+}
+
+
+GpuPixelSet* GpuPixelSet::Below( GpuPixelSet* ps )
+{
+	return slice(ps, SLICE_BELOW);
+}
+
+
+GpuPixelSet* GpuPixelSet::slice( GpuPixelSet* ps, int relation )
+{
+	Passes& passes = Passes::get();
+	
+	// The side is given by the extents of ps, which stay on the GPU
+	ps->reduceExtents();
+	
+	GpuPixelSet* result = new GpuPixelSet();
+	
+	passes.slice->getTechnique(0)->getPass(0)->getFragmentProgramParameters()->setNamedConstant("relation", relation);
+	passes.run(passes.slice, result->texture, texture, ps->extentsTexture);
+	
+	return result;
+}
+
+
+int GpuPixelSet::Count()
+{
+	if (count >= 0)
+		return count;
+	
+	Passes& passes = Passes::get();
+	
+	// The pass writes nothing, but can't read the texture it renders to
+	TexturePtr scratch = passes.acquireSet();
+	
+	passes.query->beginOcclusionQuery();
+	passes.run(passes.count, scratch, texture);
+	passes.query->endOcclusionQuery();
+	
+	unsigned int samples = 0;
+	passes.query->pullOcclusionQuery(&samples);
+	
+	passes.releaseSet(scratch);
+	
+	count = (int)samples;
+	return count;
+}
+
+
+void GpuPixelSet::reduceExtents()
+{
+	if (!extentsTexture.isNull())
+		return;
+	
+	Passes& passes = Passes::get();
+	extentsTexture = passes.acquireExtents();
+	
+	// The first pass reads the pixel set, each of the following ones the level written 
+	// by the previous one, and the last one writes the extents texture
+	TexturePtr source = texture;
+	
+	for (size_t i = 0; i <= passes.reduction.size(); i++) {
+		
+		TexturePtr target = (i < passes.reduction.size()) ? passes.reduction[i] : extentsTexture;
+		passes.run((i == 0) ? passes.extents : passes.reduce, target, source);
+		
+		source = target;
+	}
+}
+
+
+void GpuPixelSet::readExtents()
+{
+	if (extentsRead)
+		return;
+	
+	reduceExtents();
+	
+	// The only pixel transferred
+	PixelBox box(1, 1, 1, PF_FLOAT32_RGBA, extents);
+	extentsTexture->getBuffer()->blitToMemory(box);
+	
+	extentsRead = true;
+}
+
+
+int GpuPixelSet::Min_x()
+{
+	readExtents();
+	return (extents[0] >= emptyExtent) ? -1 : (int)extents[0];
+}
+
+
+int GpuPixelSet::Min_y()
+{
+	readExtents();
+	return (extents[1] >= emptyExtent) ? -1 : (int)extents[1];
+}
+
+
+int GpuPixelSet::Max_x()
+{
+	readExtents();
+	return (extents[2] >= emptyExtent) ? -1 : (int)-extents[2];
+}
+
+
+int GpuPixelSet::Max_y()
+{
+	readExtents();
+	return (extents[3] >= emptyExtent) ? -1 : (int)-extents[3];
+}
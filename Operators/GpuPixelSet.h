@@ -0,0 +1,122 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#ifndef _dGpuPixelSet // to avoid duplicate inclusions
+#define _dGpuPixelSet
+
+#include "Ogre.h"
+
+#include <vector>
+
+#include "Renderer.h"
+
+/** @brief A planar pixel set kept in a render texture, whose operators are fragment passes over
+	render textures, so that an expression can be evaluated without transferring pixels to RAM.
+ @remarks the pixel sets are rendered as Renderer::Render() does, into render textures of the 
+	size of the viewport taken from a pool. Overlap, CoveredBy, Left, Right, Above and Below are 
+	fragment programs writing a new texture from one or two others, with the same results as the 
+	PixelSet operators. Count() is an occlusion query on a pass keeping the pixels of the set,
+	the extents (Min_x() ... Max_y()) a parallel min reduction of 2x2 blocks down to a single 
+	texel. Only these scalars are read back. 
+	The GPU evaluation needs GLSL fragment programs, float render textures and occlusion 
+	queries; Render() returns NULL when they are missing, or when the Renderer is in software mode.
+*/
+class GpuPixelSet
+{
+
+public:
+	
+	/** Renders a group of SceneNodes into a new GpuPixelSet, as Renderer::Render(sceneNodes, mode) 
+		does with the rendering camera, or returns NULL if the GPU can't evaluate pixel sets.
+	 @param sceneNodes	names of the Ogre::SceneNodes to render
+	 @param mode		as in Renderer::Render()
+	 */
+	static GpuPixelSet* Render( const std::vector<Ogre::String>& sceneNodes, RenderingMode mode = NODE );
+	
+	/** Same as above, with the SceneNodes given by Renderer::ResolveNodes() instead of their names */
+	static GpuPixelSet* Render( const std::vector<Ogre::SceneNode*>& sceneNodes, RenderingMode mode = NODE );
+	
+	/** true if the GPU can evaluate pixel sets */
+	static bool isAvailable();
+	
+	/** Destroys the render textures and materials of the passes, before the Renderer is destroyed */
+	static void shutdown();
+	
+	/** Gives the render texture back to the pool */
+	~GpuPixelSet();
+	
+	/** Same as the PixelSet operators, the result is a new GpuPixelSet */
+	GpuPixelSet* Overlap( GpuPixelSet* ps );
+	GpuPixelSet* CoveredBy( GpuPixelSet* ps );
+	GpuPixelSet* Left( GpuPixelSet* ps );
+	GpuPixelSet* Right( GpuPixelSet* ps );
+	GpuPixelSet* Above( GpuPixelSet* ps );
+	GpuPixelSet* Below( GpuPixelSet* ps );
+	
+	/** Number of pixels of the set */
+	int Count();
+	
+	/** Extents of the set, -1 if it is empty as for a PixelSet */
+	int Min_x();
+	int Max_x();
+	int Min_y();
+	int Max_y();
+	
+private:
+	
+	/** The render textures, materials, quad and occlusion query of the passes */
+	class Passes;
+	
+	/** Takes a render texture of the pool for a new pixel set */
+	GpuPixelSet();
+	
+	/** Pixel set of the pixels of this one on a side of ps, relation being the one of Slice_FS */
+	GpuPixelSet* slice( GpuPixelSet* ps, int relation );
+	
+	/** Reduces the extents of the set into its extents texture if it wasn't yet */
+	void reduceExtents();
+	
+	/** Reads back the extents texture: minX, minY, -maxX, -maxY, 1e9 for an empty set */
+	void readExtents();
+	
+	/** Depth of the pixels of the set, 0 out of it */
+	Ogre::TexturePtr texture;
+	
+	/** Extents of the set once reduced, a 1x1 texture */
+	Ogre::TexturePtr extentsTexture;
+	
+	/** Extents once read back, and count once queried, -1 before */
+	float extents[4];
+	bool extentsRead;
+	int count;
+	
+};
+
+#endif
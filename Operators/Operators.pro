@@ -13,6 +13,12 @@ SUBDIRS = Parser Test
 
 LIBS += -lOgreMain
 
+# Parallel operators (CONFIG += openmp), see PixelSet::threads
+openmp {
+	QMAKE_CXXFLAGS += -fopenmp
+	QMAKE_LFLAGS += -fopenmp
+}
+
 # Use Precompiled headers (PCH)
 PRECOMPILED_HEADER = ../CEL.pch
 
@@ -28,7 +34,12 @@ HEADERS += ../OgreMax/OgreMaxModel.hpp \
 	../OgreMax/OgreMaxUtilities.hpp \
 	../OgreMax/Version.hpp \
 	../tinyxml/tinyxml.h \
+	DepthRasterizer.h \
+	GpuPixelSet.h \
 	PixelSet.h \
+	PixelSetKernels.h \
+	PixelSetPool.h \
+	RenderCache.h \
         Renderer.h 
 
 
@@ -40,7 +51,12 @@ SOURCES += ../OgreMax/OgreMaxModel.cpp \
 	  ../tinyxml/tinyxml.cpp \
 	  ../tinyxml/tinyxmlerror.cpp \
 	  ../tinyxml/tinyxmlparser.cpp \
+	  DepthRasterizer.cpp \
+	  GpuPixelSet.cpp \
 	  PixelSet.cpp \
+	  PixelSetKernels.cpp \
+	  PixelSetPool.cpp \
+	  RenderCache.cpp \
           Renderer.cpp 
 
 CONFIG -= release \
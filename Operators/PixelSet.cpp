@@ -31,44 +31,466 @@ http://www.gnu.org/copyleft/lesser.txt.
 // #define LOG_OPERATIONS
 
 #include "PixelSet.h"
+#include "PixelSetKernels.h"
+#include "PixelSetPool.h"
 #include "float.h"
 
+#include <new>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace Ogre;
 using namespace std;
 
-PixelSet::PixelSet( Image* image, String label ) : pixels(image), PSname(label)
+float PixelSet::sparseFillRatio = 0.05f;
+bool PixelSet::cacheDistanceTransform = true;
+int PixelSet::threads = 1;
+
+/** Normalizes a raw depth sample in [0,1] */
+static inline float depthToFloat( uint16 z ) { return z * (1.0f / 65535.0f); }
+static inline float depthToFloat( float z ) { return z; }
+
+/** Number of pixels set in a word of the occupancy bitmap */
+static inline int popCount( uint64 w )
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(w);
+#else
+	w = w - ((w >> 1) & 0x5555555555555555ULL);
+	w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+	w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/** Position of the lowest pixel set in a non-zero word of the occupancy bitmap */
+static inline int lowestBit( uint64 w )
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(w);
+#else
+	int b = 0;
+	while (!(w & 1)) { w >>= 1; b++; }
+	return b;
+#endif
+}
+
+/** Position of the highest pixel set in a non-zero word of the occupancy bitmap */
+static inline int highestBit( uint64 w )
+{
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(w);
+#else
+	int b = 63;
+	while (!(w >> 63)) { w <<= 1; b--; }
+	return b;
+#endif
+}
+
+/** Kernels matching the depth sample type */
+static inline PixelSetKernels::Kernel16 overlapKernel( const uint16* ) { return PixelSetKernels::get().overlap16; }
+static inline PixelSetKernels::Kernel32 overlapKernel( const float* ) { return PixelSetKernels::get().overlap32; }
+static inline PixelSetKernels::Kernel16 coveredByKernel( const uint16* ) { return PixelSetKernels::get().coveredBy16; }
+static inline PixelSetKernels::Kernel32 coveredByKernel( const float* ) { return PixelSetKernels::get().coveredBy32; }
+
+/** Bits of word k of an occupancy row that fall inside the pixel range [from, to] */
+static inline uint64 rangeMask( int k, int from, int to )
+{
+	int lo = std::max(from - (k << 6), 0);
+	int hi = std::min(to - (k << 6), 63);
+	
+	if (lo > hi)
+		return 0;
+	
+	return (~0ULL >> (63 - hi)) & (~0ULL << lo);
+}
+
+/** Bits of word k of an occupancy row of the given number of words whose left and right neighbours are both set */
+static inline uint64 sideBits( const uint64* bits, int k, int words )
+{
+	uint64 left = (bits[k] << 1) | ((k > 0) ? bits[k - 1] >> 63 : 0);
+	uint64 right = (bits[k] >> 1) | ((k + 1 < words) ? bits[k + 1] << 63 : 0);
+	
+	return left & right;
+}
+
+/** Bits of word k of an occupancy row whose pixel misses at least one of its eight neighbours.
+	above and below are the rows around it, 0 if they are outside the image or empty. */
+static inline uint64 edgeBits( const uint64* above, const uint64* row, const uint64* below, int k, int words )
+{
+	if ( row[k] == 0 )
+		return 0;
+	
+	if ( above == 0 || below == 0 )
+		return row[k];
+	
+	uint64 inner = 
+		above[k] & sideBits(above, k, words) &
+		row[k] & sideBits(row, k, words) &
+		below[k] & sideBits(below, k, words);
+	
+	return row[k] & ~inner;
+}
+
+/** Sets (or clears) the bits of pixels [x0, x1) of an occupancy row */
+static inline void setBits( uint64* bits, int x0, int x1, bool value = true )
+{
+	for (int k = x0 >> 6; k <= (x1 - 1) >> 6; k++) {
+		if (value)
+			bits[k] |= rangeMask(k, x0, x1 - 1);
+		else
+			bits[k] &= ~rangeMask(k, x0, x1 - 1);
+	}
+}
+
+/** First pixel at or after from whose occupancy bit equals value, words * 64 if there is none */
+static inline int findBit( const uint64* bits, int words, int from, bool value )
+{
+	int k = from >> 6;
+	
+	if (k >= words)
+		return words << 6;
+	
+	uint64 w = (value ? bits[k] : ~bits[k]) & (~0ULL << (from & 63));
+	
+	while (w == 0) {
+		if (++k == words)
+			return words << 6;
+		w = value ? bits[k] : ~bits[k];
+	}
+	
+	return (k << 6) + lowestBit(w);
+}
+
+
+/** Running statistics of a pixel set, fed one occupancy word or one run of pixels at a time.
+	Coordinate extremes and averages only consider the front face of cubic pixel sets. */
+template <typename T>
+class PixelSet::StatisticsAccumulator
+{
+public:
+
+	StatisticsAccumulator() : count(0), relevantCount(0), minX(INT_MAX), maxX(-INT_MAX), minY(INT_MAX), maxY(-INT_MAX), 
+		rawMinZ(0), rawMaxZ(0), totalX(0), totalY(0), totalZ(0) {}
+	
+	/** Adds the pixels of word k of row y, depth is the whole row of samples */
+	inline void add( uint64 w, int k, int y, const T* depth, bool relevant )
+	{
+		if ( w == 0 )
+			return;
+		
+		int n = popCount(w);
+		count += n;
+		
+		if ( !relevant )
+			return;
+		
+		relevantCount += n;
+		
+		minX = std::min(minX, (k << 6) + lowestBit(w));
+		maxX = std::max(maxX, (k << 6) + highestBit(w));
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		totalY += (double)n * y;
+		
+		for (; w; w &= w - 1) {
+			int x = (k << 6) + lowestBit(w);
+			addDepth(depth[x]);
+			totalX += x;
+		}
+	}
+	
+	/** Adds the run of pixels [x0, x1) of row y, depth are the samples of the run */
+	inline void addRun( int x0, int x1, int y, const T* depth, bool relevant )
+	{
+		int n = x1 - x0;
+		count += n;
+		
+		if ( !relevant )
+			return;
+		
+		relevantCount += n;
+		
+		minX = std::min(minX, x0);
+		maxX = std::max(maxX, x1 - 1);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		totalY += (double)n * y;
+		totalX += (double)n * (x0 + x1 - 1) / 2;
+		
+		for (int i = 0; i < n; i++)
+			addDepth(depth[i]);
+	}
+	
+	/** Adds the pixels collected by another accumulator */
+	void merge( const StatisticsAccumulator& s )
+	{
+		if ( s.count == 0 )
+			return;
+		
+		count += s.count;
+		relevantCount += s.relevantCount;
+		
+		minX = std::min(minX, s.minX); maxX = std::max(maxX, s.maxX);
+		minY = std::min(minY, s.minY); maxY = std::max(maxY, s.maxY);
+		
+		if ( rawMinZ == 0 || (s.rawMinZ > 0 && s.rawMinZ < rawMinZ) )
+			rawMinZ = s.rawMinZ;
+		if ( s.rawMaxZ > rawMaxZ )
+			rawMaxZ = s.rawMaxZ;
+		
+		totalX += s.totalX; totalY += s.totalY; totalZ += s.totalZ;
+	}
+	
+	/** Stores the statistics in the pixel set */
+	void apply( PixelSet* ps )
+	{
+		if ( count == 0 ) {
+			ps->clearStatistics();
+			return;
+		}
+		
+		ps->PScount = count;
+		ps->minX = minX; ps->maxX = maxX;
+		ps->minY = minY; ps->maxY = maxY;
+		ps->minZ = (rawMinZ > 0) ? depthToFloat(rawMinZ) : FLT_MAX;
+		ps->maxZ = (rawMaxZ > 0) ? depthToFloat(rawMaxZ) : -FLT_MAX;
+		
+		ps->averageX = relevantCount ? (float)(totalX / relevantCount) : -1;
+		ps->averageY = relevantCount ? (float)(totalY / relevantCount) : -1;
+		ps->averageZ = relevantCount ? (float)(totalZ / relevantCount) : -1;
+	}
+	
+private:
+
+	inline void addDepth( T z )
+	{
+		if ( rawMinZ == 0 || z < rawMinZ )
+			rawMinZ = z;
+		if ( z > rawMaxZ )
+			rawMaxZ = z;
+		totalZ += depthToFloat(z);
+	}
+	
+	int count, relevantCount;
+	int minX, maxX, minY, maxY;
+	T rawMinZ, rawMaxZ;
+	double totalX, totalY, totalZ;
+};
+
+
+/** Gives access to row y of a face as an occupancy bitmap and a row of depth samples, 
+	whatever the storage. DENSE rows are read in place, SPARSE rows are expanded in a scratch row
+	borrowed from the pool. */
+template <typename T>
+class PixelSet::RowReader
+{
+public:
+
+	RowReader( PixelSet* ps ) : bits(0), depth(0), ps(ps), loaded(0), loadedCount(0), 
+		scratchBits(ps->storage == SPARSE ? ps->maskStride : 0), scratchDepth(ps->storage == SPARSE ? ps->maskStride << 6 : 0)
+	{
+		if (ps->storage == SPARSE) {
+			memset(scratchBits.data, 0, ps->maskStride * sizeof(uint64));
+			memset(scratchDepth.data, 0, (ps->maskStride << 6) * sizeof(T));
+			bits = scratchBits.data;
+			depth = scratchDepth.data;
+		}
+	}
+	
+	/** Loads row y of the given face, returns false if the row is known to be empty */
+	bool load( int y, int face )
+	{
+		if (ps->storage == DENSE) {
+			bits = ps->MaskRow(y, face);
+			depth = ps->Row<T>(y, face);
+			return true;
+		}
+		
+		// Clear the runs of the previous row, then expand the runs of this one
+		for (size_t i = 0; i < loadedCount; i++) {
+			setBits(&scratchBits[0], loaded[i].x0, loaded[i].x1, false);
+			memset(&scratchDepth[loaded[i].x0], 0, (loaded[i].x1 - loaded[i].x0) * sizeof(T));
+		}
+		
+		loaded = ps->SpanRow(y, face, loadedCount);
+		const T* samples = ps->SpanDepth<T>();
+		
+		for (size_t i = 0; i < loadedCount; i++) {
+			setBits(&scratchBits[0], loaded[i].x0, loaded[i].x1);
+			memcpy(&scratchDepth[loaded[i].x0], samples + loaded[i].offset, (loaded[i].x1 - loaded[i].x0) * sizeof(T));
+		}
+		
+		return loadedCount > 0;
+	}
+	
+	const uint64* bits;
+	const T* depth;
+	
+private:
+
+	PixelSet* ps;
+	const PixelSpan* loaded;
+	size_t loadedCount;
+	PixelSetScratch<uint64> scratchBits;
+	PixelSetScratch<T> scratchDepth;
+};
+
+
+/** Gives write access to row y of a face of an empty pixel set, as an occupancy bitmap and a row 
+	of depth samples. DENSE rows are written in place, SPARSE rows are written in a scratch row and
+	turned into runs by commit(). Rows must be written in face, y order. Depth samples are written
+	directly, occupancy words through store(), which also updates the statistics of the pixel set.
+	Several writers can fill different rows of a DENSE pixel set at the same time. */
+template <typename T>
+class PixelSet::RowWriter
+{
+public:
+
+	RowWriter( PixelSet* ps ) : bits(0), depth(0), ps(ps), y(0), face(0), relevant(true), 
+		scratchBits(ps->storage == SPARSE ? ps->maskStride : 0), scratchDepth(ps->storage == SPARSE ? ps->maskStride << 6 : 0)
+	{
+		if (ps->storage == SPARSE) {
+			memset(scratchBits.data, 0, ps->maskStride * sizeof(uint64));
+			memset(scratchDepth.data, 0, (ps->maskStride << 6) * sizeof(T));
+		}
+	}
+	
+	/** Starts writing row y of the given face */
+	void begin( int y, int face )
+	{
+		if (ps->storage == DENSE) {
+			bits = ps->MaskRow(y, face);
+			depth = ps->Row<T>(y, face);
+		} else {
+			bits = &scratchBits[0];
+			depth = &scratchDepth[0];
+		}
+		
+		this->y = y;
+		this->face = face;
+		relevant = (ps->type == PLANAR) || (face == FRONT);
+	}
+	
+	/** Stores occupancy word k of the current row, the depth samples of its pixels must be written already */
+	inline void store( int k, uint64 w )
+	{
+		bits[k] = w;
+		statistics.add(w, k, y, depth, relevant);
+	}
+	
+	/** Stores the row written since begin() */
+	void commit()
+	{
+		if (ps->storage == DENSE)
+			return;
+		
+		ps->appendSpans<T>(y, face, bits, depth);
+		
+		// Back to an empty scratch row
+		for (int k = 0; k < ps->maskStride; k++) 
+			for (uint64 w = bits[k]; w; w &= w - 1)
+				depth[(k << 6) + lowestBit(w)] = 0;
+		
+		memset(bits, 0, ps->maskStride * sizeof(uint64));
+	}
+	
+	/** Statistics of the rows written so far */
+	const StatisticsAccumulator<T>& getStatistics() const
+	{
+		return statistics;
+	}
+	
+	uint64* bits;
+	T* depth;
+	
+private:
+
+	PixelSet* ps;
+	int y, face;
+	bool relevant;
+	StatisticsAccumulator<T> statistics;
+	PixelSetScratch<uint64> scratchBits;
+	PixelSetScratch<T> scratchDepth;
+};
+
+
+/** The bands of rows of an operation, at most one per bandRows rows of each face, 
+	in a scratch buffer of the calling thread */
+class PixelSet::BandList
+{
+public:
+
+	BandList( int faces, int height ) : bands(faces * ((height + bandRows - 1) / bandRows)), count(0) {}
+	
+	void add( const RowBand& band ) { bands[count++] = band; }
+	
+	const RowBand& operator[]( int i ) const { return bands[i]; }
+	
+	int size() const { return count; }
+	
+private:
+
+	PixelSetScratch<RowBand> bands;
+	int count;
+};
+
+
+PixelSet::PixelSet( Image* image, String label ) : pixels(image), PSname(label), storage(DENSE), references(1)
 {
 
 	// Which type?
 	this->type = (image->getNumFaces() == 1) ? PLANAR : CUBIC;
 	
+	bindBuffer();
+	
+	buildMask();
+	
 	computeStatistics();
 	
+	// Small silhouettes are kept as runs of pixels, and the full image is released
+	if ( PScount < sparseFillRatio * width * height * faces )
+		makeSparse();
+	
 	#ifdef LOG_OPERATIONS
 	this->logStatistics();
 	#endif
 }
 
-PixelSet::PixelSet( int width, int height, PixelFormat pf, Ogre::String label, PixelSetType type ) :  PSname(label), type(type)
+PixelSet::PixelSet( Image* image, String label, int width, int height, int originX, int originY ) : 
+	pixels(image), PSname(label), type(PLANAR), storage(DENSE), references(1)
 {
-	// How many faces?
-	int faces = (type == PLANAR) ? 1 : 6;
+	if (image->getNumFaces() != 1)
+		throw PixelSetException("Only planar pixel sets can be built from a part of an image.");
 	
-	// We allocate memory for the image where the pixel set will be stored
-	uchar *data = OGRE_ALLOC_T(
-		uchar, 
-		width * height * PixelUtil::getNumElemBytes(pf) * faces, 
-		MEMCATEGORY_GENERAL
-	);
-
-	// Write black color to the image
-	PixelUtil::packColour(0.0f, 0.0f, 0.0f, 0.0f, pf, data);
+	bindBuffer();
 	
-	pixels = new Image();
-	pixels->loadDynamicImage(data, width, height, 0, pf, true, faces, 0);
+	buildMask();
 	
 	computeStatistics();
 	
+	// The pixels of the image are moved where they belong in the full pixel set,
+	// which is stored SPARSE or DENSE depending on its own fill ratio
+	placeAt(width, height, originX, originY);
+	
+	#ifdef LOG_OPERATIONS
+	this->logStatistics();
+	#endif
+}
+
+PixelSet::PixelSet( int width, int height, PixelFormat pf, Ogre::String label, PixelSetType type ) : 
+	pixels(0), PSname(label), type(type), format(pf), storage(DENSE), width(width), height(height), references(1)
+{
+	// How many faces?
+	faces = (type == PLANAR) ? 1 : 6;
+	
+	allocateImage();
+	
+	// No need to scan a black image
+	clearStatistics();
+	
 	//#ifdef LOG_OPERATIONS
 	//this->logStatistics();
 	//#endif
@@ -76,68 +498,485 @@ PixelSet::PixelSet( int width, int height, PixelFormat pf, Ogre::String label, P
 	
 }
 
-PixelSet::~PixelSet() 
+PixelSet::PixelSet( int width, int height, PixelFormat pf, Ogre::String label, PixelSetType type, PixelSetStorage storage ) : 
+	pixels(0), PSname(label), type(type), format(pf), storage(storage), width(width), height(height), references(1)
+{
+	faces = (type == PLANAR) ? 1 : 6;
+	
+	if (storage == DENSE) {
+		allocateImage();
+	} else {
+		depthType = (pf == PF_L16) ? DEPTH_L16 : DEPTH_FLOAT32;
+		rowStride = 0;
+		for (int face = 0; face < 6; face++)
+			faceData[face] = 0;
+		maskStride = (width + 63) >> 6;
+		
+		// No runs yet
+		rowSpans.assign(faces * height + 1, 0);
+		sparseRows = 0;
+	}
+	
+	// The result of an operator, its image and bitmap come from the pool
+	PixelSetPool::get().countAllocation(sizeof(PixelSet) + rowSpans.capacity() * sizeof(size_t));
+	
+	clearStatistics();
+}
+
+PixelSet* PixelSet::Empty( int width, int height, PixelFormat pf, String label, PixelSetType type )
+{
+	PixelSet* result = new PixelSet(width, height, pf, label, type, (sparseFillRatio > 0) ? SPARSE : DENSE);
+	
+	if (result->storage == SPARSE)
+		result->finishSpans();
+	
+	return result;
+}
+
+PixelSet::~PixelSet() 
+{
+	// Give the image and the bitmap back to the pool
+	PixelSetPool::get().release(pixels);
+	PixelSetPool::get().releaseMask(mask);
+}
+
+PixelSet* PixelSet::createResult( String label, PixelSetType type, int maxCount )
+{
+	int area = width * height * ((type == PLANAR) ? 1 : 6);
+	PixelSetStorage resultStorage = (maxCount < sparseFillRatio * area) ? SPARSE : DENSE;
+	
+	return new PixelSet( width, height, format, label, type, resultStorage );
+}
+
+void PixelSet::allocateImage()
+{
+	// We take the image where the pixel set will be stored from the pool, black 
+	// since a zero depth sample is a pixel not in the set
+	pixels = PixelSetPool::get().acquire(width, height, format, faces);
+	
+	bindBuffer();
+}
+
+void PixelSet::bindBuffer()
+{
+	width = pixels->getWidth();
+	height = pixels->getHeight();
+	faces = pixels->getNumFaces();
+	
+	PixelFormat pf = pixels->getFormat();
+	
+	if ( pf != PF_L16 && pf != PF_FLOAT32_R ) {
+		
+		// Format not supported by the raw view (e.g. the render system gave us 
+		// PF_FLOAT32_RGB instead of PF_L16), keep only the red channel as float depth
+		Image* converted = PixelSetPool::get().acquire(width, height, PF_FLOAT32_R, faces, false);
+		
+		for (int face = 0; face < faces; face++)
+			PixelUtil::bulkPixelConversion(pixels->getPixelBox(face, 0), converted->getPixelBox(face, 0));
+		
+		PixelSetPool::get().release(pixels);
+		pixels = converted;
+		pf = PF_FLOAT32_R;
+	}
+	
+	format = pf;
+	depthType = (pf == PF_L16) ? DEPTH_L16 : DEPTH_FLOAT32;
+	
+	PixelBox pb = pixels->getPixelBox(0, 0);
+	rowStride = pb.rowPitch * PixelUtil::getNumElemBytes(pf);
+	
+	for (int face = 0; face < 6; face++)
+		faceData[face] = (face < faces) ? static_cast<uchar*>(pixels->getPixelBox(face, 0).data) : 0;
+	
+	// Empty occupancy bitmap, 64 pixels per word
+	maskStride = (width + 63) >> 6;
+	PixelSetPool::get().releaseMask(mask);
+	PixelSetPool::get().acquireMask(maskStride * height * faces, mask);
+}
+
+void PixelSet::buildMask()
+{
+	if (depthType == DEPTH_L16)
+		buildMaskT<uint16>();
+	else
+		buildMaskT<float>();
+}
+
+template <typename T>
+void PixelSet::buildMaskT()
+{
+	// Rows are independent, r runs over the rows of all faces
+	int rows = faces * height;
+	
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static) num_threads(bandThreads((rows + bandRows - 1) / bandRows))
+#endif
+	for (int r = 0; r < rows; r++) {
+		
+		const T* row = Row<T>(r % height, r / height);
+		uint64* bits = MaskRow(r % height, r / height);
+		
+		for (int x = 0; x < width; x++)
+			if ( row[x] > 0 )
+				bits[x >> 6] |= 1ULL << (x & 63);
+	}
+}
+
+template <typename T>
+void PixelSet::appendSpans( int y, int face, const uint64* bits, const T* depth )
+{
+	// Rows in between were empty, they start where this one starts
+	size_t r = face * height + y;
+	for (; sparseRows <= r; sparseRows++)
+		rowSpans[sparseRows] = spans.size();
+	
+	// One run for each sequence of set bits
+	int x = findBit(bits, maskStride, 0, true);
+	size_t spanCapacity = spans.capacity(), depthCapacity = spanDepth.capacity();
+	
+	while (x < width) {
+		
+		int end = std::min(findBit(bits, maskStride, x, false), width);
+		
+		PixelSpan span = { x, end, spanDepth.size() / sizeof(T) };
+		spans.push_back(span);
+		spanDepth.insert(spanDepth.end(), (const uchar*)(depth + x), (const uchar*)(depth + end));
+		
+		x = findBit(bits, maskStride, end, true);
+	}
+	
+	if (spans.capacity() != spanCapacity)
+		PixelSetPool::get().countAllocation(spans.capacity() * sizeof(PixelSpan));
+	if (spanDepth.capacity() != depthCapacity)
+		PixelSetPool::get().countAllocation(spanDepth.capacity());
+}
+
+void PixelSet::finishSpans()
+{
+	for (; sparseRows < rowSpans.size(); sparseRows++)
+		rowSpans[sparseRows] = spans.size();
+}
+
+const PixelSpan* PixelSet::findSpan( int x, int y, int face )
+{
+	size_t count;
+	const PixelSpan* row = SpanRow(y, face, count);
+	
+	// Last run starting at or before x
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (row[mid].x0 <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	if (lo == 0 || x >= row[lo - 1].x1)
+		return 0;
+	
+	return &row[lo - 1];
+}
+
+void PixelSet::makeSparse()
+{
+	if (storage == SPARSE)
+		return;
+	
+	if (depthType == DEPTH_L16)
+		makeSparseT<uint16>();
+	else
+		makeSparseT<float>();
+}
+
+template <typename T>
+void PixelSet::makeSparseT()
+{
+	rowSpans.assign(faces * height + 1, 0);
+	sparseRows = 0;
+	spans.clear();
+	spanDepth.clear();
+	spanDepth.reserve(PScount * sizeof(T));
+	
+	for (int face = 0; face < faces; face++)
+		for (int y = 0; y < height; y++)
+			appendSpans<T>(y, face, MaskRow(y, face), Row<T>(y, face));
+	
+	finishSpans();
+	
+	// Release the full image and bitmap
+	PixelSetPool::get().release(pixels);
+	pixels = 0;
+	PixelSetPool::get().releaseMask(mask);
+	
+	for (int face = 0; face < 6; face++)
+		faceData[face] = 0;
+	
+	storage = SPARSE;
+}
+
+void PixelSet::placeAt( int w, int h, int originX, int originY )
+{
+	PixelWindow window = { originX, originX + width - 1, originY, originY + height - 1 };
+	
+	if ( window.minX < 0 || window.minY < 0 || window.maxX >= w || window.maxY >= h )
+		throw PixelSetException("Image out of the pixel set, check its origin and size.");
+	
+	if ( PScount < sparseFillRatio * w * h ) {
+		
+		// The runs of the image, moved right by originX
+		makeSparse();
+		
+		for (size_t i = 0; i < spans.size(); i++) {
+			spans[i].x0 += originX;
+			spans[i].x1 += originX;
+		}
+		
+		// and down by originY: rows above the image start at the first run, rows below after the last one
+		std::vector<size_t> placed(h + 1, spans.size());
+		std::fill(placed.begin(), placed.begin() + originY, 0);
+		std::copy(rowSpans.begin(), rowSpans.begin() + height, placed.begin() + originY);
+		
+		rowSpans.swap(placed);
+		sparseRows = rowSpans.size();
+		
+		width = w;
+		height = h;
+		maskStride = (width + 63) >> 6;
+		
+		computeStatistics();
+		
+	} else {
+		
+		// Already in place
+		if ( originX == 0 && originY == 0 && width == w && height == h )
+			return;
+		
+		// Full black image, with the image copied in the window
+		Image* image = pixels;
+		const uchar* data = faceData[0];
+		size_t stride = rowStride;
+		
+		pixels = 0;
+		width = w;
+		height = h;
+		allocateImage();
+		
+		if (depthType == DEPTH_L16)
+			placeDenseT<uint16>(data, stride, window);
+		else
+			placeDenseT<float>(data, stride, window);
+		
+		PixelSetPool::get().release(image);
+		
+		// Nothing to count out of the window
+		computeStatistics(window);
+	}
+}
+
+template <typename T>
+void PixelSet::placeDenseT( const uchar* data, size_t stride, const PixelWindow& window )
+{
+	for (int y = window.minY; y <= window.maxY; y++) {
+		
+		const T* source = reinterpret_cast<const T*>(data + (y - window.minY) * stride);
+		T* row = Row<T>(y);
+		uint64* bits = MaskRow(y);
+		
+		memcpy(row + window.minX, source, (window.maxX - window.minX + 1) * sizeof(T));
+		
+		for (int x = window.minX; x <= window.maxX; x++)
+			if ( row[x] > 0 )
+				bits[x >> 6] |= 1ULL << (x & 63);
+	}
+}
+
+void PixelSet::makeDense()
+{
+	if (storage == DENSE)
+		return;
+	
+	if (depthType == DEPTH_L16)
+		makeDenseT<uint16>();
+	else
+		makeDenseT<float>();
+}
+
+template <typename T>
+void PixelSet::makeDenseT()
+{
+	allocateImage();
+	
+	const T* samples = SpanDepth<T>();
+	
+	for (int face = 0; face < faces; face++)
+		for (int y = 0; y < height; y++) {
+			
+			size_t count;
+			const PixelSpan* row = SpanRow(y, face, count);
+			
+			for (size_t i = 0; i < count; i++) {
+				memcpy(Row<T>(y, face) + row[i].x0, samples + row[i].offset, (row[i].x1 - row[i].x0) * sizeof(T));
+				setBits(MaskRow(y, face), row[i].x0, row[i].x1);
+			}
+		}
+	
+	// Release the runs
+	std::vector<PixelSpan>().swap(spans);
+	std::vector<size_t>().swap(rowSpans);
+	std::vector<uchar>().swap(spanDepth);
+	
+	storage = DENSE;
+}
+
+size_t PixelSet::Bytes()
+{
+	size_t bytes = sizeof(PixelSet);
+	
+	if (pixels)
+		bytes += pixels->getSize();
+	
+	bytes += mask.capacity() * sizeof(uint64);
+	bytes += spans.capacity() * sizeof(PixelSpan);
+	bytes += rowSpans.capacity() * sizeof(size_t);
+	bytes += spanDepth.capacity();
+	bytes += edgePixels.capacity() * sizeof(std::pair<int,int>);
+	bytes += edgeDistances.capacity() * sizeof(float);
+	
+	return bytes;
+}
+
+bool PixelSet::Contains(int x, int y, int face)
+{
+	if (storage == DENSE)
+		return (MaskRow(y, face)[x >> 6] >> (x & 63)) & 1;
+	else
+		return findSpan(x, y, face) != 0;
+}
+
+float PixelSet::getDepth(int x, int y, int face)
+{
+	if (storage == SPARSE) {
+		
+		const PixelSpan* span = findSpan(x, y, face);
+		
+		if (span == 0)
+			return 0;
+		
+		if (depthType == DEPTH_L16)
+			return depthToFloat( SpanDepth<uint16>()[span->offset + x - span->x0] );
+		else
+			return SpanDepth<float>()[span->offset + x - span->x0];
+	}
+	
+	if (depthType == DEPTH_L16)
+		return depthToFloat( Row<uint16>(y, face)[x] );
+	else
+		return Row<float>(y, face)[x];
+}
+
+void PixelSet::splitBands( int face, const PixelWindow& w, BandList& bands )
+{
+	for (int y = w.minY; y <= w.maxY && !w.isEmpty(); y += bandRows) {
+		RowBand band = { face, w };
+		band.window.minY = y;
+		band.window.maxY = std::min(y + bandRows - 1, w.maxY);
+		bands.add(band);
+	}
+}
+
+int PixelSet::bandThreads( int count )
+{
+#ifdef _OPENMP
+	int n = (threads > 0) ? threads : omp_get_num_procs();
+	return std::max(1, std::min(n, count));
+#else
+	return 1;
+#endif
+}
+
+template <typename T>
+void PixelSet::runBands( void (PixelSet::*band)( PixelSet*, const RowBand&, RowWriter<T>& ), 
+						PixelSet* ps, PixelSet* result, const BandList& bands )
+{
+	int count = bands.size();
+	PixelSetScratch<StatisticsAccumulator<T> > statistics(count);
+	
+	// Select the row kernels before any thread looks them up
+	PixelSetKernels::get();
+	
+	// Runs of a SPARSE result are appended in row order, so its bands are written serially
+#ifdef _OPENMP
+	int n = (result->storage == DENSE) ? bandThreads(count) : 1;
+	#pragma omp parallel for schedule(dynamic) num_threads(n)
+#endif
+	for (int i = 0; i < count; i++) {
+		RowWriter<T> writer(result);
+		(this->*band)(ps, bands[i], writer);
+		new (&statistics[i]) StatisticsAccumulator<T>(writer.getStatistics());
+	}
+	
+	// Statistics are merged in band order, they don't depend on the number of threads
+	StatisticsAccumulator<T> total;
+	for (int i = 0; i < count; i++)
+		total.merge(statistics[i]);
+	
+	if (result->storage == SPARSE)
+		result->finishSpans();
+	
+	total.apply(result);
+}
+
+PixelWindow PixelSet::window( int face ) const
 {
-	// Free allocated memory
-	// OGRE_FREE( pixels->getData(), MEMCATEGORY_GENERAL);
-	delete pixels;
+	PixelWindow w = { 0, width - 1, 0, height - 1 };
+	
+	if ( PScount == 0 ) {
+		w.maxX = -1;
+		w.maxY = -1;
+	} else if ( type == PLANAR || face == FRONT ) {
+		w.minX = minX; w.maxX = maxX;
+		w.minY = minY; w.maxY = maxY;
+	}
+	
+	return w;
 }
 
-PixelSet* PixelSet::Overlap( PixelSet* ps)
+void PixelSet::checkCompatible( PixelSet* ps )
 {
-
 	// Check if PixelSets are type-compatible (ie. same type)
 	if (ps->type != this->type)
 		throw PixelSetException("PixelSets incompatible, check PixelSet type.");
 	
 	// Check if PixelSets are size-compatible
-	if (ps->pixels->getWidth() != this->pixels->getWidth() || ps->pixels->getHeight() != this->pixels->getHeight())
+	if (ps->width != this->width || ps->height != this->height)
 		throw PixelSetException("PixeSets incompatible, check PixelSets size.");
 	
-	// Get PixelFormat and PixelSet type from current image	
-	PixelFormat pf = pixels->getFormat();
-	PixelSetType pt = this->type;
-	
-	// How many faces?
-	int faces = (pt == PLANAR) ? 1 : 6;
+	// Check if PixelSets have the same depth encoding
+	if (ps->depthType != this->depthType)
+		throw PixelSetException("PixelSets incompatible, check PixelSets depth format.");
+}
+
+PixelSet* PixelSet::Overlap( PixelSet* ps)
+{
+
+	checkCompatible(ps);
 	
 	// Build up label for the PixelSet representing the overlap
 	String label = "Overlap(" + this->PSname + "," + ps->getName() + ")";
 	
-	// Create new empty PixelSet 
-	PixelSet* result = new PixelSet( pixels->getWidth(), pixels->getHeight(), pf, label, pt);
+	// Create new empty PixelSet, the overlap is at most as large as the smallest operand
+	PixelSet* result = createResult( label, type, std::min(PScount, ps->PScount) );
 	
-	PixelBox pb	= result->getImage()->getPixelBox();
-		
-	// Get data address
-	uchar * dest = static_cast<uchar*>(pb.data);
+	// Pixels of the overlap are in both bounding boxes
+	BandList bands(faces, height);
+	for (int face = 0; face < faces; face++)
+		splitBands(face, window(face).intersect(ps->window(face)), bands);
 	
-	for (int i = 0; i < faces; i++) {
-		
-		int min_x = 0, min_y = 0, max_x = pixels->getWidth(), max_y = pixels->getHeight();
-		
-		if ( faces ==  1 ) {
-			min_x = minX; max_x = maxX;
-			min_y = minY; max_y = maxY;
-		}
-		
-		// For all the pixels of the PixelBox
-		for (int x = min_x; x<= max_x; x++) {
-			for (int y = min_y; y <= max_y; y++) {
-				if (( this->getPixel(x,y,i).r > 0 ) && ( ps->getPixel(x,y,i).r > 0 )) {
-					
-					// We have found a member of the overlap
-					size_t offset = 
-						i *  pixels->getWidth() * pixels->getHeight() * PixelUtil::getNumElemBytes(pf) +	// Locate face
-						y * pixels->getWidth() * PixelUtil::getNumElemBytes(pf) +							// Locate column
-						x * PixelUtil::getNumElemBytes(pf);													// Locate row
-					PixelUtil::packColour( this->getPixel(x,y,i), pixels->getFormat(), &dest[offset]);
-				}
-			}
-		}
-	}
-		
-	result->computeStatistics();
+	if (depthType == DEPTH_L16)
+		runBands<uint16>(&PixelSet::overlapT<uint16>, ps, result, bands);
+	else
+		runBands<float>(&PixelSet::overlapT<float>, ps, result, bands);
 
 	#ifdef LOG_OPERATIONS
 	result->logStatistics();
@@ -146,55 +985,70 @@ PixelSet* PixelSet::Overlap( PixelSet* ps)
 	return result;
 }
 
-
-PixelSet* PixelSet::CoveredBy( PixelSet* ps)
+template <typename T>
+void PixelSet::overlapT( PixelSet* ps, const RowBand& band, RowWriter<T>& out )
 {
-
-	// Check if PixelSets are type-compatible (ie. same type)
-	if (ps->type != this->type)
-		throw PixelSetException("PixelSets incompatible, check PixelSet type.");
+	// Words covering 64 pixels of the row are handed to the vectorized kernel
+	uint64 (*kernel)(const T*, const T*, T*) = overlapKernel( (T*)0 );
+	int fullWords = width >> 6;
 	
-	// Check if PixelSets are size-compatible
-	if (ps->pixels->getWidth() != this->pixels->getWidth() || ps->pixels->getHeight() != this->pixels->getHeight())
-		throw PixelSetException("PixeSets incompatible, check PixelSets size.");
+	RowReader<T> a(this), b(ps);
+	const PixelWindow& w = band.window;
 	
-	// Get PixelFormat and PixelSet type from current image	
-	PixelFormat pf = pixels->getFormat();
-	PixelSetType pt = this->type;
+	// For all the rows of the band, membership is the AND of the two bitmaps,
+	// depth samples are only touched for the pixels that survive
+	for (int y = w.minY; y <= w.maxY; y++) {
 	
-	// How many faces?
-	int faces = (pt == PLANAR) ? 1 : 6;
+		if ( !a.load(y, band.face) || !b.load(y, band.face) )
+			continue;
+		
+		out.begin(y, band.face);
+		
+		for (int k = w.firstWord(); k <= w.lastWord(); k++) {
+			
+			uint64 overlap = a.bits[k] & b.bits[k];
+			
+			if ( overlap == 0 )
+				continue;
+			
+			if ( k < fullWords ) {
+				out.store(k, kernel(a.depth + (k << 6), b.depth + (k << 6), out.depth + (k << 6)));
+				continue;
+			}
+			
+			// We have found members of the overlap
+			for (uint64 bits = overlap; bits; bits &= bits - 1) {
+				int x = (k << 6) + lowestBit(bits);
+				out.depth[x] = a.depth[x];
+			}
+			
+			out.store(k, overlap);
+		}
+		
+		out.commit();
+	}
+}
+
+
+PixelSet* PixelSet::CoveredBy( PixelSet* ps)
+{
+
+	checkCompatible(ps);
 	
 	// Build up label for the PixelSet representing the overlap
 	String label = "CoveredBy(" + this->PSname + "," + ps->getName() + ")";
 
 	// Create new empty PixelSet 
-	PixelSet* result = new PixelSet( pixels->getWidth(), pixels->getHeight(), pf, label, pt);
-	
-	PixelBox pb	= result->getImage()->getPixelBox();
-		
-	// Get data address
-	uchar * dest = static_cast<uchar*>(pb.data);
-	
-	for (int i = 0; i < faces; i++) {
-		
-		// For all the pixels of the PixelBox
-		for (int x = minX; x<= maxX; x++) {
-			for (int y = minY; y <= maxY; y++) {
-				if (( this->getPixel(x,y,i).r > 0 ) && ( ps->getPixel(x,y,i).r > 0 ) && ( this->getPixel(x,y,i).r > ps->getPixel(x,y,i).r )) {
-					
-					// We have found a member of the overlap
-					size_t offset = 
-						i *  pixels->getWidth() * pixels->getHeight() * PixelUtil::getNumElemBytes(pf) +	// Locate face
-						y * pixels->getWidth() * PixelUtil::getNumElemBytes(pf) +							// Locate column
-						x * PixelUtil::getNumElemBytes(pf);													// Locate row
-					PixelUtil::packColour( this->getPixel(x,y,i), pixels->getFormat(), &dest[offset]);
-				}
-			}
-		}
-	}
-
-	result->computeStatistics();
+	PixelSet* result = createResult( label, type, std::min(PScount, ps->PScount) );
+	
+	BandList bands(faces, height);
+	for (int face = 0; face < faces; face++)
+		splitBands(face, window(face).intersect(ps->window(face)), bands);
+	
+	if (depthType == DEPTH_L16)
+		runBands<uint16>(&PixelSet::coveredByT<uint16>, ps, result, bands);
+	else
+		runBands<float>(&PixelSet::coveredByT<float>, ps, result, bands);
 
 	#ifdef LOG_OPERATIONS
 	result->logStatistics();
@@ -203,27 +1057,68 @@ PixelSet* PixelSet::CoveredBy( PixelSet* ps)
 	return result;
 }
 
+template <typename T>
+void PixelSet::coveredByT( PixelSet* ps, const RowBand& band, RowWriter<T>& out )
+{
+	uint64 (*kernel)(const T*, const T*, T*) = coveredByKernel( (T*)0 );
+	int fullWords = width >> 6;
+	
+	RowReader<T> a(this), b(ps);
+	const PixelWindow& w = band.window;
+	
+	for (int y = w.minY; y <= w.maxY; y++) {
+	
+		if ( !a.load(y, band.face) || !b.load(y, band.face) )
+			continue;
+		
+		out.begin(y, band.face);
+		
+		for (int k = w.firstWord(); k <= w.lastWord(); k++) {
+			
+			uint64 candidates = a.bits[k] & b.bits[k], covered = 0;
+			
+			if ( candidates == 0 )
+				continue;
+			
+			if ( k < fullWords ) {
+				out.store(k, kernel(a.depth + (k << 6), b.depth + (k << 6), out.depth + (k << 6)));
+				continue;
+			}
+			
+			// Pixels in both sets, covered if the other pixel set is nearer to the camera
+			for (; candidates; candidates &= candidates - 1) {
+				int bit = lowestBit(candidates);
+				int x = (k << 6) + bit;
+				if ( a.depth[x] > b.depth[x] ) {
+					out.depth[x] = a.depth[x];
+					covered |= 1ULL << bit;
+				}
+			}
+			
+			out.store(k, covered);
+		}
+		
+		out.commit();
+	}
+}
+
 
 PixelSet* PixelSet::RSL( String label, int sliceMinX, int sliceMaxX, int sliceMinY, int sliceMaxY)
 {
 	
-	// create a new empty pixelbox, set all pixels to black 
-	PixelFormat pf = pixels->getFormat();
-	PixelSet* result = new PixelSet( pixels->getWidth(), pixels->getHeight(), pf, label);
-	PixelBox pb = result->getImage()->getPixelBox();
-	uchar * dest = static_cast<uchar*>(pb.data);
+	// create a new empty pixel set, it can at most contain all pixels of this one 
+	PixelSet* result = createResult( label, PLANAR, PScount );
 	
-	// check between the given rectangular subregion if there are pixels of this pixel set, add them to returned pixel set
-	for (int x = sliceMinX; x<= sliceMaxX; x++)
-		for (int y = sliceMinY; y <= sliceMaxY; y++)
-			if ( this->getPixel(x,y).r > 0 )
-			{
-				// we have found a pixel of this which is left of any pixel in ps
-				size_t offset = y * pixels->getWidth() * PixelUtil::getNumElemBytes(pf) + x * PixelUtil::getNumElemBytes(pf);
-				PixelUtil::packColour( this->getPixel(x,y), pixels->getFormat(), &dest[offset]);
-			}
+	// clip the slice to the pixels of the set, and so to the image
+	PixelWindow slice = { sliceMinX, sliceMaxX, sliceMinY, sliceMaxY };
 	
-	result->computeStatistics();	
+	BandList bands(1, height);
+	splitBands(0, window(0).intersect(slice), bands);
+	
+	if (depthType == DEPTH_L16)
+		runBands<uint16>(&PixelSet::rslT<uint16>, 0, result, bands);
+	else
+		runBands<float>(&PixelSet::rslT<float>, 0, result, bands);
 	
 #ifdef LOG_OPERATIONS
 	result->logStatistics();
@@ -232,6 +1127,51 @@ PixelSet* PixelSet::RSL( String label, int sliceMinX, int sliceMaxX, int sliceMi
 	return result;
 }
 
+template <typename T>
+void PixelSet::rslT( PixelSet* ps, const RowBand& band, RowWriter<T>& out )
+{
+	RowReader<T> a(this);
+	const PixelWindow& w = band.window;
+	
+	// check between the given rectangular subregion if there are pixels of this pixel set, add them to returned pixel set
+	for (int y = w.minY; y <= w.maxY; y++) {
+		
+		if ( !a.load(y, band.face) )
+			continue;
+		
+		out.begin(y, band.face);
+		
+		for (int k = w.firstWord(); k <= w.lastWord(); k++) {
+			
+			uint64 inside = a.bits[k] & rangeMask(k, w.minX, w.maxX);
+			
+			for (uint64 bits = inside; bits; bits &= bits - 1) {
+				int x = (k << 6) + lowestBit(bits);
+				out.depth[x] = a.depth[x];
+			}
+			
+			out.store(k, inside);
+		}
+		
+		out.commit();
+	}
+}
+PixelSet* PixelSet::Copy( String label )
+{
+	PixelSet* result = createResult( label, type, PScount );
+	
+	// all the pixels of each face are inside the slice
+	BandList bands(faces, height);
+	for (int face = 0; face < faces; face++)
+		splitBands(face, window(face), bands);
+	
+	if (depthType == DEPTH_L16)
+		runBands<uint16>(&PixelSet::rslT<uint16>, 0, result, bands);
+	else
+		runBands<float>(&PixelSet::rslT<float>, 0, result, bands);
+	
+	return result;
+}
 
 PixelSet* PixelSet::Left( PixelSet* ps)
 {	
@@ -268,33 +1208,217 @@ PixelSet* PixelSet::Below( PixelSet* ps)
 // this method find edge pixels in a pixel set by checking the eight neighbours
 void PixelSet::FindEdgePixels()
 {
+	// we only scan the bounding box. The edge pixels of each band of rows are counted 
+	// first, then written at their place in edgePixels, in band order, so that the scan 
+	// allocates nothing but edgePixels
+	BandList bands(1, height);
+	splitBands(0, window(0), bands);
 	
-	// not super efficient, we could test the bounding box of the pixel set first,
-	// then do not check if the pixel we are trying to access really exists in the image
-	
-	for (int x = minX; x<= maxX; x++)  
-		for (int y = minY; y <= maxY; y++)
-			if ( this->getPixel(x,y).r > 0 )
-				{
-				// we have found a pixel. Now we access the eight neighbours, and as soon as
-				// one is not present, we add the present pixel to the edgePixel vector
-				if (( (x>0) && (y>0) && (this->getPixel(x-1,y-1).r > 0 )) &&
-					( (x>0) && (this->getPixel(x-1,y).r > 0 )) &&
-					( (x>0) && (y<pixels->getHeight()-2) && (this->getPixel(x-1,y+1).r > 0 )) &&
-					( (y>0) && (this->getPixel(x,y-1).r > 0 )) &&
-					( (y<pixels->getHeight()-2) && (this->getPixel(x,y+1).r > 0 )) &&
-					( (x<pixels->getWidth()-2) && (y>0) && (this->getPixel(x+1,y-1).r > 0 )) &&
-					( (x<pixels->getWidth()-2) && (this->getPixel(x+1,y).r > 0 )) &&
-					( (x<pixels->getWidth()-2) && (y<pixels->getHeight()-2) && (this->getPixel(x+1,y+1).r > 0 )))
-					;
-					else
-						edgePixels.push_back(make_pair(x,y));
-				}
+	int count = bands.size();
+	PixelSetScratch<size_t> offsets(count + 1);
+	
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) num_threads(bandThreads(count))
+#endif
+	for (int i = 0; i < count; i++) {
+		if (depthType == DEPTH_L16)
+			offsets[i + 1] = findEdgePixelsT<uint16>(bands[i], 0);
+		else
+			offsets[i + 1] = findEdgePixelsT<float>(bands[i], 0);
+	}
+	
+	offsets[0] = edgePixels.size();
+	for (int i = 0; i < count; i++)
+		offsets[i + 1] += offsets[i];
+	
+	if (offsets[count] == offsets[0])
+		return;
+	
+	if (offsets[count] > edgePixels.capacity())
+		PixelSetPool::get().countAllocation(offsets[count] * sizeof(pair<int,int>));
+	
+	edgePixels.resize(offsets[count]);
+	
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) num_threads(bandThreads(count))
+#endif
+	for (int i = 0; i < count; i++) {
+		if (depthType == DEPTH_L16)
+			findEdgePixelsT<uint16>(bands[i], &edgePixels[offsets[i]]);
+		else
+			findEdgePixelsT<float>(bands[i], &edgePixels[offsets[i]]);
+	}
+}
+
+template <typename T>
+size_t PixelSet::findEdgePixelsT( const RowBand& band, pair<int,int>* edges )
+{
+	// we keep the rows above and below the current one. 
+	// Pixels on the image border are always edge pixels.
+	// The edge pixels are written to edges, or only counted if it is 0.
+	
+	size_t found = 0;
+	
+	RowReader<T> aboveRow(this), currentRow(this), belowRow(this);
+	const PixelWindow& w = band.window;
+	
+	for (int y = w.minY; y <= w.maxY; y++) {
+		
+		if ( !currentRow.load(y, 0) )
+			continue;
+		
+		const uint64* above = (y > 0 && aboveRow.load(y - 1, 0)) ? aboveRow.bits : 0;
+		const uint64* below = (y < height - 1 && belowRow.load(y + 1, 0)) ? belowRow.bits : 0;
+		
+		// the pixels of a word that miss one of their eight neighbours are found at once
+		for (int k = w.firstWord(); k <= w.lastWord(); k++) {
+			
+			uint64 bits = edgeBits(above, currentRow.bits, below, k, maskStride);
+			
+			if ( !edges ) {
+				found += popCount(bits);
+				continue;
+			}
+			
+			for (; bits; bits &= bits - 1)
+				edges[found++] = make_pair((k << 6) + lowestBit(bits), y);
+		}
+	}
+	
+	return found;
+}
+
+template <typename T>
+void PixelSet::silhouetteT( PixelSet* ps, const RowBand& band, RowWriter<T>& out )
+{
+	// Same as findEdgePixelsT, the edge pixels are written to the result with their depth
+	
+	RowReader<T> aboveRow(this), currentRow(this), belowRow(this);
+	const PixelWindow& w = band.window;
+	
+	for (int y = w.minY; y <= w.maxY; y++) {
+		
+		if ( !currentRow.load(y, band.face) )
+			continue;
+		
+		const uint64* above = (y > 0 && aboveRow.load(y - 1, band.face)) ? aboveRow.bits : 0;
+		const uint64* below = (y < height - 1 && belowRow.load(y + 1, band.face)) ? belowRow.bits : 0;
+		
+		out.begin(y, band.face);
+		
+		for (int k = w.firstWord(); k <= w.lastWord(); k++) {
+			
+			uint64 edges = edgeBits(above, currentRow.bits, below, k, maskStride);
+			
+			if ( edges == 0 )
+				continue;
+			
+			for (uint64 bits = edges; bits; bits &= bits - 1) {
+				int x = (k << 6) + lowestBit(bits);
+				out.depth[x] = currentRow.depth[x];
+			}
+			
+			out.store(k, edges);
+		}
+		
+		out.commit();
+	}
+}
+
+PixelSet* PixelSet::Silhouette()
+{
+	
+	String label = "Silhouette(" + this->PSname + ")";
+	
+	// The silhouette is made of the pixels of this that miss one of their eight neighbours
+	PixelSet* result = createResult( label, type, PScount );
+	
+	BandList bands(faces, height);
+	for (int face = 0; face < faces; face++)
+		splitBands(face, window(face), bands);
+	
+	if (depthType == DEPTH_L16)
+		runBands<uint16>(&PixelSet::silhouetteT<uint16>, 0, result, bands);
+	else
+		runBands<float>(&PixelSet::silhouetteT<float>, 0, result, bands);
+	
+	// Its first face holds the edge pixels Distance() needs, keep them
+	if ( edgePixels.size() == 0 && result->PScount > 0 ) {
+		
+		// all of them at most, listed without growing the vector
+		if ( (size_t)result->PScount > edgePixels.capacity() )
+			PixelSetPool::get().countAllocation(result->PScount * sizeof(pair<int,int>));
+		edgePixels.reserve(result->PScount);
+		
+		if (depthType == DEPTH_L16)
+			result->listPixelsT<uint16>(edgePixels);
+		else
+			result->listPixelsT<float>(edgePixels);
+	}
+	
+	#ifdef LOG_OPERATIONS
+	result->logStatistics();
+	#endif
+	
+	return result;
+}
+
+template <typename T>
+void PixelSet::listPixelsT( std::vector<pair<int,int> >& list )
+{
+	RowReader<T> row(this);
+	PixelWindow w = window(0);
+	
+	for (int y = w.minY; y <= w.maxY && !w.isEmpty(); y++) {
+		
+		if ( !row.load(y, 0) )
+			continue;
+		
+		for (int k = w.firstWord(); k <= w.lastWord(); k++)
+			for (uint64 bits = row.bits[k]; bits; bits &= bits - 1)
+				list.push_back(make_pair((k << 6) + lowestBit(bits), y));
+	}
 }
 
 
+/** Squared distance used for pixels with no edge pixel in sight */
+static const float DT_INFINITY = 1e20f;
+
+/** One dimensional squared Euclidean distance transform of the sampled function f 
+	(Felzenszwalb and Huttenlocher, "Distance Transforms of Sampled Functions"). 
+	d receives the transform, v and z are scratch buffers of n and n + 1 elements. */
+static void distanceTransform1D( const float* f, int n, float* d, int* v, float* z )
+{
+	// lower envelope of the parabolas rooted at each sample
+	int k = 0;
+	v[0] = 0;
+	z[0] = -DT_INFINITY;
+	z[1] = DT_INFINITY;
+	
+	for (int q = 1; q < n; q++) {
+		
+		float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+		
+		while (s <= z[k]) {
+			k--;
+			s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+		}
+		
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = DT_INFINITY;
+	}
+	
+	// and its value at each sample
+	k = 0;
+	for (int q = 0; q < n; q++) {
+		while (z[k + 1] < q)
+			k++;
+		d[q] = (float)(q - v[k]) * (q - v[k]) + f[v[k]];
+	}
+}
 
-// straighforward and probably stupid implementation
 float PixelSet::Distance( PixelSet* ps)
 {
 	
@@ -305,23 +1429,38 @@ float PixelSet::Distance( PixelSet* ps)
 	if ( ps->edgePixels.size() == 0)
 		ps->FindEdgePixels();
 	
-	int c = 0;
-
+	if ( edgePixels.size() == 0 || ps->edgePixels.size() == 0 )
+		return Math::Sqrt(FLT_MAX);
+	
+	// the transform of one set is queried at the edge pixels of the other one,
+	// we transform the set that already has a cached transform if any
+	PixelSet* transformed = (ps->edgeDistances.size() > 0 && edgeDistances.size() == 0) ? ps : this;
+	PixelSet* queried = (transformed == this) ? ps : this;
+	
+	// the transform is kept in the pixel set, or in a scratch buffer while it is queried
+	size_t samples = transformed->width * transformed->height;
+	bool computed = transformed->edgeDistances.size() > 0;
+	PixelSetScratch<float> local( (computed || cacheDistanceTransform) ? 0 : samples );
+	
+	if ( !computed && cacheDistanceTransform ) {
+		if ( samples > transformed->edgeDistances.capacity() )
+			PixelSetPool::get().countAllocation(samples * sizeof(float));
+		transformed->edgeDistances.resize(samples);
+	}
+	
+	float* distances = local.data ? local.data : &transformed->edgeDistances[0];
+	
+	if ( !computed )
+		transformed->computeEdgeDistances(distances);
+	
 	float minDistance = FLT_MAX;
-	std::vector<pair<int,int> >::const_iterator fit;
-	std::vector<pair<int,int> >::const_iterator sit;
-	
-	for ( fit = edgePixels.begin(); fit != edgePixels.end(); ++fit) 
-		for ( sit = ps->edgePixels.begin(); sit != ps->edgePixels.end(); ++sit) 
-		{
-			c++;
-			// we compute square distance	
-			float sqDistance = Math::Sqr(fit->first - sit->first) + Math::Sqr(fit->second - sit->second);		
-			if (sqDistance < minDistance )
-				minDistance = sqDistance;
-		}
+	std::vector<pair<int,int> >::const_iterator it;
 	
-	//LogManager::getSingleton().logMessage("count: " + StringConverter::toString(c));
+	for ( it = queried->edgePixels.begin(); it != queried->edgePixels.end(); ++it) {
+		float sqDistance = distances[it->second * width + it->first];
+		if (sqDistance < minDistance )
+			minDistance = sqDistance;
+	}
 	
 	if (minDistance > 0)
 		return Math::Sqrt(minDistance);
@@ -330,103 +1469,187 @@ float PixelSet::Distance( PixelSet* ps)
 	
 }
 
-PixelSet* PixelSet::Silhouette(){
+void PixelSet::computeEdgeDistances( float* distances )
+{
+	// Sampled function: 0 on edge pixels, infinity elsewhere
+	std::fill(distances, distances + width * height, DT_INFINITY);
 	
-	return 0;
+	std::vector<pair<int,int> >::const_iterator it;
+	for ( it = edgePixels.begin(); it != edgePixels.end(); ++it)
+		distances[it->second * width + it->first] = 0;
+	
+	int n = std::max(width, height);
+	
+	// Transform along columns, only those of the bounding box have finite values. 
+	// Columns are copied in and out a block at a time, walking the rows in memory order.
+	// Blocks of columns, and then bands of rows, are independent and can run in parallel, 
+	// in scratch buffers of the threads running them.
+	const int block = 16;
+	PixelWindow w = window(0);
+	int blocks = w.isEmpty() ? 0 : (w.maxX - w.minX) / block + 1;
+	
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) num_threads(bandThreads(blocks))
+#endif
+	for (int b = 0; b < blocks; b++) {
+		
+		PixelSetScratch<float> columns(block * height), d(n), z(n + 1);
+		PixelSetScratch<int> v(n);
+		
+		int x0 = w.minX + b * block;
+		int count = std::min(block, w.maxX - x0 + 1);
+		
+		for (int y = 0; y < height; y++)
+			for (int i = 0; i < count; i++)
+				columns[i * height + y] = distances[y * width + x0 + i];
+		
+		for (int i = 0; i < count; i++) {
+			distanceTransform1D(&columns[i * height], height, &d[0], &v[0], &z[0]);
+			memcpy(&columns[i * height], &d[0], height * sizeof(float));
+		}
+		
+		for (int y = 0; y < height; y++)
+			for (int i = 0; i < count; i++)
+				distances[y * width + x0 + i] = columns[i * height + y];
+	}
 	
-	/// to be completed
+	// Then along rows, which are contiguous
+	int rowBands = (height + bandRows - 1) / bandRows;
 	
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) num_threads(bandThreads(rowBands))
+#endif
+	for (int b = 0; b < rowBands; b++) {
+		
+		PixelSetScratch<float> d(n), z(n + 1);
+		PixelSetScratch<int> v(n);
+		
+		for (int y = b * bandRows; y < std::min((b + 1) * bandRows, height); y++) {
+			
+			float* row = &distances[y * width];
+			
+			distanceTransform1D(row, width, &d[0], &v[0], &z[0]);
+			memcpy(row, &d[0], width * sizeof(float));
+		}
+	}
 }
 
+void PixelSet::clearStatistics()
+{
+	PScount = 0;
+	maxX = -1; minX = -1; maxY = -1; minY = -1; maxZ = -1; minZ = -1; 
+	averageX = -1; averageY = -1; averageZ = -1;
+}
 
 void PixelSet::computeStatistics()
 {
+	PixelWindow all = { 0, width - 1, 0, height - 1 };
 	
-	// How many faces? How much large?
-	int faces = (this->type == PLANAR) ? 1 : 6;
+	computeStatistics(all);
+}
+
+void PixelSet::computeStatistics( const PixelWindow& w )
+{
+	if (storage == SPARSE) {
+		if (depthType == DEPTH_L16)
+			computeSparseStatisticsT<uint16>();
+		else
+			computeSparseStatisticsT<float>();
+	} else {
+		if (depthType == DEPTH_L16)
+			computeStatisticsT<uint16>(w);
+		else
+			computeStatisticsT<float>(w);
+	}
+}
+
+template <typename T>
+void PixelSet::computeStatisticsT( const PixelWindow& w )
+{
 	
 	// We compute max, min values for all x,y,z coordinates in the pixel set 
-	// and we compute the number of pixels in the set.
+	// and we compute the number of pixels in the set, one bitmap word at a time.
+	// Each band of rows has its own accumulator, merged in band order.
 	
-	maxX = -INT_MAX; 
-	minX = INT_MAX; 
-	maxY = -INT_MAX; 
-	minY = INT_MAX; 
-	maxZ = -FLT_MAX; 
-	minZ = FLT_MAX;
+	BandList bands(faces, height);
+	for (int face = 0; face < faces; face++)
+		splitBands(face, w, bands);
 	
-	PScount = 0;
-
-	float totalZ = 0;
-	float totalX = 0;
-	float totalY = 0;
+	int count = (int)bands.size();
+	PixelSetScratch<StatisticsAccumulator<T> > statistics(count);
 	
-	// Iterate through all the faces of the PixelSet
-	for (int face = 0; face < faces; face++) {
+	for (int i = 0; i < count; i++)
+		new (&statistics[i]) StatisticsAccumulator<T>();
+	
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) num_threads(bandThreads(count))
+#endif
+	for (int i = 0; i < count; i++) {
 		
-		// Considering all columns
-		for (int x = 0; x < pixels->getWidth(); x++) {
+		// Locate minimum-maximum coordinates, only if considering front face
+		int face = bands[i].face;
+		bool relevantFace = (this->type == PLANAR) || (this->type == CUBIC && face == FRONT);
+		
+		// Considering all rows of the band
+		for (int y = bands[i].window.minY; y <= bands[i].window.maxY; y++) {
 			
-			// And rows
-			for (int y = 0; y < pixels->getHeight(); y++) {
+			const uint64* bits = MaskRow(y, face);
+			const T* row = Row<T>(y, face);
 			
-				// Get the color-coded z coordinate of each pixel
-				float z = pixels->getColourAt(x, y, face).r;
-				
-				// If depth greater than zero, pixel must be considered
-				if ( z > 0.0 ) {
-					
-					PScount++;
-					
-					bool relevantFace = (this->type == PLANAR) || (this->type == CUBIC && face == FRONT);
-
-					// Locate minimum-maximum coordinates, only if considering front face
-					if (relevantFace) {
-					
-						if ( x < minX )
-							minX = x;
-						if (x > maxX )
-							maxX = x;
-						
-						if ( y < minY )
-							minY = y;
-						if (y > maxY )
-							maxY = y;
-						
-						if ( z < minZ )
-							minZ = z;
-						if (z > maxZ )
-							maxZ = z;
-
-					}
-				}
-			}
+			// And all words of the row touched by the window
+			for (int k = w.firstWord(); k <= w.lastWord(); k++)
+				statistics[i].add(bits[k], k, y, row, relevantFace);
 		}	
 	}
 	
-	if ( PScount == 0 ) { 
-		maxX = -1; minX = -1; maxY = -1; minY = -1; maxZ = -1; minZ = -1; averageZ = -1;
-	} else {
+	for (int i = 1; i < count; i++)
+		statistics[0].merge(statistics[i]);
+	
+	if (count > 0)
+		statistics[0].apply(this);
+	else
+		clearStatistics();
 	
-		/** I'm not sure about what this code should mean, I don't remember 
-		 *  if is mine or someone else's. -- Tommaso */
+}
+
+template <typename T>
+void PixelSet::computeSparseStatisticsT()
+{
+	
+	// Same as computeStatisticsT, one run of pixels at a time
 	
-		averageX = totalX / PScount; averageY = totalY / PScount; averageZ = totalZ / PScount;
+	StatisticsAccumulator<T> statistics;
+	
+	const T* samples = SpanDepth<T>();
+	
+	for (int face = 0; face < faces; face++) {
+		
+		bool relevantFace = (this->type == PLANAR) || (this->type == CUBIC && face == FRONT);
+		
+		for (int y = 0; y < height; y++) {
+			
+			size_t count;
+			const PixelSpan* row = SpanRow(y, face, count);
+			
+			for (size_t i = 0; i < count; i++)
+				statistics.addRun(row[i].x0, row[i].x1, y, samples + row[i].offset, relevantFace);
+		}
 	}
 	
+	statistics.apply(this);
+	
 }
 
 void PixelSet::logStatistics()
 {
-	// How many faces?
-	int faces = (type == PLANAR) ? 1 : 6;
-	float height	= pixels->getHeight();
-	float width	= pixels->getWidth();
+	float height	= this->height;
+	float width	= this->width;
 	
 	LogManager::getSingleton().logMessage("New pixel set created: " + PSname);
-	LogManager::getSingleton().logMessage("Pixel set made up by num. faces: " + StringConverter::toString(this->pixels->getNumFaces()));
+	LogManager::getSingleton().logMessage("Pixel set made up by num. faces: " + StringConverter::toString(faces));
+	LogManager::getSingleton().logMessage(String("Storage: ") + ((storage == SPARSE) ? "sparse, runs: " + StringConverter::toString(spans.size()) : "dense"));
 	LogManager::getSingleton().logMessage("Count: " + StringConverter::toString(PScount));
-	LogManager::getSingleton().logMessage("Relative count: " + StringConverter::toString((float)PScount / (float)(faces * pixels->getWidth()*pixels->getHeight())));
+	LogManager::getSingleton().logMessage("Relative count: " + StringConverter::toString((float)PScount / (float)(faces * width * height)));
 	
 	LogManager::getSingleton().logMessage("MinX: " + StringConverter::toString(minX) + ", MaxX: " + StringConverter::toString(maxX));
 	LogManager::getSingleton().logMessage("MinY: " + StringConverter::toString(minY) + ", MaxY: " + StringConverter::toString(maxY));
@@ -438,3 +1661,5 @@ void PixelSet::logStatistics()
 }
 
 
+
+
@@ -55,6 +55,53 @@ enum PixelSetFace {
 	FRONT	= 5
 };
 
+/** Encoding of the depth samples stored in the raw buffer of a PixelSet:
+ - DEPTH_L16		16 bit normalized integer depth (PF_L16), what the Renderer asks for
+ - DEPTH_FLOAT32	32 bit float depth (PF_FLOAT32_R), what some render systems give back
+ Images in any other format are converted to DEPTH_FLOAT32 when the PixelSet is built.
+ */
+enum PixelSetDepth { DEPTH_L16, DEPTH_FLOAT32 };
+
+/** How the pixels of a PixelSet are stored:
+ - DENSE		a full image of depth samples plus an occupancy bitmap, 
+				memory proportional to the viewport
+ - SPARSE		runs of contiguous pixels for each row plus their depth samples,
+				memory proportional to the pixels in the set
+ Renders and operator results pick SPARSE when their fill ratio is below
+ PixelSet::sparseFillRatio.
+ */
+enum PixelSetStorage { DENSE, SPARSE };
+
+/** A run of contiguous pixels [x0, x1) of a row of a SPARSE PixelSet. 
+	offset locates the depth sample of x0 among the depth samples of the set.
+ */
+struct PixelSpan {
+	int x0, x1;
+	size_t offset;
+};
+
+/** The rectangle of pixels [minX, maxX] x [minY, maxY] of a face that an operator has to visit.
+	Operators walk it row by row, one occupancy word at a time, so the depth buffer is read 
+	in memory order and rows or columns that cannot hold any pixel are never touched.
+ */
+struct PixelWindow {
+	int minX, maxX, minY, maxY;
+	
+	/** true if the window holds no pixel at all */
+	bool isEmpty() const { return minX > maxX || minY > maxY; }
+	
+	/** first and last occupancy word of a row touched by the window */
+	int firstWord() const { return minX >> 6; }
+	int lastWord() const { return maxX >> 6; }
+	
+	/** the pixels that are in both windows */
+	PixelWindow intersect( const PixelWindow& w ) const 
+	{
+		PixelWindow r = { std::max(minX, w.minX), std::min(maxX, w.maxX), std::max(minY, w.minY), std::min(maxY, w.maxY) };
+		return r;
+	}
+};
+
 /** @brief Defines a Pixel Set and its methods  
 */	
 class PixelSet {
@@ -69,6 +116,19 @@ public:
 	 */
 	PixelSet( Ogre::Image* image, Ogre::String label ); 
 	
+	/** Constructor from a ogre image holding only a rectangle of a planar pixel set, e.g. the part 
+		of a render where the targets can be: the pixels out of the rectangle are not in the set. 
+		Coordinates stay those of the full pixel set, and unless the set is stored DENSE, building 
+		it costs in proportion to the image only.
+	 @param image Pointer to the image containing the rectangle
+	 @param label name of the pixel set
+	 @param width width of the pixel set
+	 @param height height of the pixel set
+	 @param originX column of the pixel set where the first column of the image goes
+	 @param originY row of the pixel set where the first row of the image goes
+	 */
+	PixelSet( Ogre::Image* image, Ogre::String label, int width, int height, int originX, int originY );
+	
 	/** Constructor that creates an empty pixel set, given width, height and pixel format.
 	 @param width width of the image containing the pixel set
 	 @param height height of the image containing the pixel set
@@ -77,9 +137,40 @@ public:
 	*/
 	PixelSet( int width, int height, Ogre::PixelFormat pf, Ogre::String label, PixelSetType = PLANAR );
 	
-	/** Destructor */
+	/** Creates a pixel set with no pixels, stored SPARSE unless sparse storage is disabled, so that 
+		no image is allocated nor scanned, e.g. for renders that are known to be empty.
+	 @param width width of the pixel set
+	 @param height height of the pixel set
+	 @param pf pixel format of the depth samples
+	 @param label name of the pixel set
+	 */
+	static PixelSet* Empty( int width, int height, Ogre::PixelFormat pf, Ogre::String label, PixelSetType type = PLANAR );
+	
+	/** Destructor, for a pixel set that was never shared, see Release() */
 	~PixelSet();
 	
+	/** Returns the pixel set itself with one more owner, e.g. the RenderCache and the callers 
+		of the Renderer it serves the set to, instead of a copy. Shared sets must not be changed.
+	 */
+	PixelSet* Share() { references++; return this; }
+	
+	/** Gives back a pixel set, which is deleted once all its owners did. Sets returned by the 
+		Renderer may be shared, so they are given back with Release() and never deleted. 
+	 */
+	void Release() { if (--references == 0) delete this; }
+	
+	/** Fill ratio (pixels in the set / pixels of the image) below which 
+		renders and operator results are stored SPARSE. 0 disables sparse storage. */
+	static float sparseFillRatio;
+	
+	/** Number of threads the operators split their work on, in bands of bandRows rows.
+		1 runs them serially, 0 uses all the processors. It only has an effect when built 
+		with OpenMP, and results do not depend on it. */
+	static int threads;
+	
+	/** Number of rows in each band of work handed to a thread */
+	static const int bandRows = 32;
+	
 	/** Returns the z value for the pixel (x,y,face) in the pixel set. 
 		If the returned value is 0, there is no pixel with those coordinates 
 		in the pixel set.
@@ -89,13 +180,89 @@ public:
 	 @param face face of the pixelset, mostly 0, but can be in [0..5]
 			if the pixelset is cubic
 	 */
-	Ogre::ColourValue getPixel(int x, int y, int face = 0) { return this->pixels->getColourAt(x, y, face); }
+	Ogre::ColourValue getPixel(int x, int y, int face = 0) { float z = getDepth(x, y, face); return Ogre::ColourValue(z, z, z, 1.0f); }
+	
+	/** Returns the z value, normalized in [0,1], for the pixel (x,y,face) in the pixel set, 
+		reading it straight from the raw buffer. 0 means that the pixel is not in the set.
+	 @param x x coordinate of the pixel
+	 @param y y coordinate of the pixel
+	 @param face face of the pixelset
+	 */
+	float getDepth(int x, int y, int face = 0);
+	
+	/** Returns a typed pointer to the first depth sample of row y of the given face (DENSE only).
+		T must match DepthType(): Ogre::uint16 for DEPTH_L16, float for DEPTH_FLOAT32.
+		Rows are RowStride() bytes apart, so the pointer is valid for x in [0, Width()).
+	 @param y y coordinate of the row
+	 @param face face of the pixelset
+	 */
+	template <typename T> T* Row(int y, int face = 0) { return reinterpret_cast<T*>(faceData[face] + y * rowStride); }
+	
+	/** Returns true if the pixel (x,y,face) belongs to the pixel set
+	 @param x x coordinate of the pixel
+	 @param y y coordinate of the pixel
+	 @param face face of the pixelset
+	 */
+	bool Contains(int x, int y, int face = 0);
+	
+	/** Returns the occupancy bitmap of row y of the given face (DENSE only): MaskStride() words, bit (x & 63) 
+		of word (x >> 6) is set iff pixel x belongs to the set. Bits past Width() are always 0.
+	 @param y y coordinate of the row
+	 @param face face of the pixelset
+	 */
+	Ogre::uint64* MaskRow(int y, int face = 0) { return &mask[(face * height + y) * maskStride]; }
+	
+	/** Returns the number of 64 bit words of a row of the occupancy bitmap */
+	int MaskStride() { return maskStride; }
+	
+	/** Returns the runs of pixels of row y of the given face (SPARSE only), 
+		the number of runs is returned in count.
+	 @param y y coordinate of the row
+	 @param face face of the pixelset
+	 @param count number of runs in the row
+	 */
+	const PixelSpan* SpanRow(int y, int face, size_t& count) 
+	{ 
+		size_t r = face * height + y; 
+		count = rowSpans[r + 1] - rowSpans[r]; 
+		return count ? &spans[rowSpans[r]] : 0; 
+	}
+	
+	/** Returns a typed pointer to the depth samples of a SPARSE pixel set, indexed by PixelSpan::offset */
+	template <typename T> T* SpanDepth() { return spanDepth.empty() ? 0 : reinterpret_cast<T*>(&spanDepth[0]); }
+	
+	/** Returns how the pixel set is stored */
+	PixelSetStorage Storage() { return storage; }
+	
+	/** Switches the pixel set to DENSE storage, allocating the full image */
+	void makeDense();
+	
+	/** Switches the pixel set to SPARSE storage, releasing the full image */
+	void makeSparse();
+	
+	/** Returns the number of bytes of memory taken by the pixel set and its buffers */
+	size_t Bytes();
+	
+	/** Returns the encoding of the depth samples in the raw buffer */
+	PixelSetDepth DepthType() { return depthType; }
+	
+	/** Returns the distance in bytes between two consecutive rows of the raw buffer */
+	size_t RowStride() { return rowStride; }
+	
+	/** Returns the width of the image containing the pixel set */
+	int Width() { return width; }
+	
+	/** Returns the height of the image containing the pixel set */
+	int Height() { return height; }
+	
+	/** Returns the number of faces of the image containing the pixel set (1 or 6) */
+	int Faces() { return faces; }
 	
 	/** Returns the name of the pixel set */
 	Ogre::String getName() { return this->PSname; }
 	
-	/** Returns a pointer to the image associated to the pixel set */
-	Ogre::Image* getImage() { return this->pixels; }
+	/** Returns a pointer to the image associated to the pixel set, switching to DENSE storage if needed */
+	Ogre::Image* getImage() { if (storage == SPARSE) makeDense(); return this->pixels; }
 	
 	/** Returns the number of pixels in the pixel set */
 	int Count() { return PScount; }
@@ -118,9 +285,17 @@ public:
 	/** Returns the min z coordinate of any pixel in the pixel set */
 	float Min_z() { return minZ; }
 	
-	/** Returns the minimum distance between two pixel sets */
+	/** Returns the minimum distance between the edge pixels of two pixel sets. 
+		The distance transform of the edges of one of the two sets is queried at the 
+		edges of the other, so the cost is linear in the image size.
+	 @param ps reference to the other pixel set
+	 */
 	float Distance( PixelSet* ps);
 	
+	/** If true, the distance transform computed by Distance() is kept in the pixel set
+		and reused by the following calls involving the same set */
+	static bool cacheDistanceTransform;
+	
 	/** Returns the type of the PixelSet */
 	PixelSetType Type() { return type; }
 	
@@ -161,7 +336,14 @@ public:
 	 */
 	PixelSet* Below( PixelSet* ps);
 	
-	/** Returns a PixelSet which is the silhouette of this pixel set
+	/** Returns a new PixelSet with the same pixels as this one
+	 @param label The name of the new PixelSet
+	 */
+	PixelSet* Copy( Ogre::String label );
+	
+	/** Returns a PixelSet which is the silhouette of this pixel set, i.e. the pixels of 'this'
+	 that miss at least one of their eight neighbours, computed in one pass over the occupancy 
+	 bitmap. Its pixels on the first face are kept as the edge pixels used by Distance.
 	 */
 	PixelSet* Silhouette();
 	
@@ -170,6 +352,9 @@ protected:
 	/** vector of edge pixels, to compute distances efficiently */
 	std::vector <std::pair<int,int> > edgePixels;
 	
+	/** squared distance of each pixel (face 0) to the nearest edge pixel, empty if not cached */
+	std::vector<float> edgeDistances;
+	
 	/** A Ogre::Image object used to store the rendering and access the pixels of the set */
 	Ogre::Image* pixels;
 	
@@ -201,15 +386,150 @@ protected:
 	/** PixelSet type (regular or cube map) */
 	PixelSetType type;
 	
+	/** encoding of the depth samples in the raw buffer */
+	PixelSetDepth depthType;
+	
+	/** pixel format of the depth samples, PF_L16 or PF_FLOAT32_R */
+	Ogre::PixelFormat format;
+	
+	/** how the pixels are stored */
+	PixelSetStorage storage;
+	
+	/** size of the image containing the pixel set */
+	int width, height, faces;
+	
+	/** distance in bytes between two rows of the raw buffer */
+	size_t rowStride;
+	
+	/** address of the first row of each face in the raw buffer */
+	Ogre::uchar* faceData[6];
+	
+	/** occupancy bitmap, one bit per pixel, kept in sync with the depth samples */
+	std::vector<Ogre::uint64> mask;
+	
+	/** number of words of a row of the occupancy bitmap */
+	int maskStride;
+	
+	/** runs of pixels of a SPARSE pixel set, sorted by face, row and x */
+	std::vector<PixelSpan> spans;
+	
+	/** index in spans of the first run of each row, faces * height + 1 entries */
+	std::vector<size_t> rowSpans;
+	
+	/** number of rows whose first run is already set in rowSpans, while a SPARSE set is being written */
+	size_t sparseRows;
+	
+	/** depth samples of the runs of a SPARSE pixel set */
+	std::vector<Ogre::uchar> spanDepth;
+	
+	/** number of owners of the pixel set, see Share() */
+	int references;
+	
 	/** computes edge pixels */
 	void FindEdgePixels();
 	
 	
 private:
 	
-	/** computes pixel set cardinality and min, max values for x, y, z coordinates. */
+	/** Constructor of an empty pixel set with the given storage, used for operator results */
+	PixelSet( int width, int height, Ogre::PixelFormat pf, Ogre::String label, PixelSetType type, PixelSetStorage storage );
+	
+	/** creates the empty result of an operator on this pixel set, SPARSE if at most 
+		maxCount pixels can end up in it and that is below sparseFillRatio */
+	PixelSet* createResult( Ogre::String label, PixelSetType type, int maxCount );
+	
+	/** read and write access to rows of a pixel set, independent of its storage. 
+		The writer collects the statistics of the rows it fills. SPARSE rows go through 
+		scratch rows of the thread, see PixelSetScratch. */
+	template <typename T> class RowReader;
+	template <typename T> class RowWriter;
+	
+	/** a band of rows of a face, the unit of work of the operators */
+	struct RowBand {
+		int face;
+		PixelWindow window;
+	};
+	
+	/** the bands of rows of an operation, in a scratch buffer of the calling thread */
+	class BandList;
+	
+	/** appends the bands of bandRows rows covering window w of a face */
+	static void splitBands( int face, const PixelWindow& w, BandList& bands );
+	
+	/** number of threads to run count bands on */
+	static int bandThreads( int count );
+	
+	/** runs band(ps, b, writer) on all bands b, possibly in parallel, and completes the result. 
+		Each band gets its own writer, whose statistics are merged in band order. */
+	template <typename T> void runBands( void (PixelSet::*band)( PixelSet*, const RowBand&, RowWriter<T>& ), 
+										PixelSet* ps, PixelSet* result, const BandList& bands );
+	
+	/** appends the pixels of a row of occupancy bits and depth samples to a SPARSE pixel set,
+		rows must be appended in face, y order */
+	template <typename T> void appendSpans( int y, int face, const Ogre::uint64* bits, const T* depth );
+	
+	/** sets the first run of all rows that were not appended, once a SPARSE pixel set is complete */
+	void finishSpans();
+	
+	/** finds the run containing pixel (x,y,face) of a SPARSE pixel set, 0 if there is none */
+	const PixelSpan* findSpan( int x, int y, int face );
+	
+	/** allocates a black image of width x height x faces samples in the current format, and binds it */
+	void allocateImage();
+	
+	/** binds the raw buffer view (strides, face addresses, depth type) to the current image,
+	 converting the image to PF_FLOAT32_R if its format is not directly supported */
+	void bindBuffer();
+	
+	/** rebuilds the occupancy bitmap from the depth samples */
+	void buildMask();
+	
+	/** computes pixel set cardinality and min, max values for x, y, z coordinates by scanning the
+		whole pixel set. Only needed for images coming from outside, operators collect the 
+		statistics of their results while writing them. */
 	void computeStatistics();
 	
+	/** same, only scanning the pixels of window w of each face of a DENSE set, the others must be empty */
+	void computeStatistics( const PixelWindow& w );
+	
+	/** moves the pixels of a planar pixel set to (originX, originY) of a larger one of width x height,
+		then stores it SPARSE or DENSE according to its fill ratio there */
+	void placeAt( int width, int height, int originX, int originY );
+	
+	/** sets the statistics of an empty pixel set */
+	void clearStatistics();
+	
+	/** collects the statistics of the pixels written to a pixel set */
+	template <typename T> class StatisticsAccumulator;
+	
+	/** typed implementations of the operators, T is the depth sample type.
+		Operators taking a RowBand only process the rows of that band. */
+	template <typename T> void buildMaskT();
+	template <typename T> void computeStatisticsT( const PixelWindow& w );
+	template <typename T> void placeDenseT( const Ogre::uchar* data, size_t stride, const PixelWindow& window );
+	template <typename T> void computeSparseStatisticsT();
+	template <typename T> void makeDenseT();
+	template <typename T> void makeSparseT();
+	template <typename T> void overlapT( PixelSet* ps, const RowBand& band, RowWriter<T>& out );
+	template <typename T> void coveredByT( PixelSet* ps, const RowBand& band, RowWriter<T>& out );
+	template <typename T> void rslT( PixelSet* ps, const RowBand& band, RowWriter<T>& out );
+	template <typename T> size_t findEdgePixelsT( const RowBand& band, std::pair<int,int>* edges );
+	template <typename T> void silhouetteT( PixelSet* ps, const RowBand& band, RowWriter<T>& out );
+	
+	/** lists the pixels of the first face, in row order */
+	template <typename T> void listPixelsT( std::vector<std::pair<int,int> >& list );
+	
+	/** computes the squared distance of each pixel (face 0) to the nearest edge pixel, 
+		into distances of width x height samples */
+	void computeEdgeDistances( float* distances );
+	
+	/** the window of a face holding all the pixels of the set: the bounding box on planar sets and on the
+		front face of cubic ones, whose statistics are only collected there, the whole face elsewhere */
+	PixelWindow window( int face ) const;
+	
+	/** checks that ps can be combined pixel by pixel with this pixel set, throws a PixelSetException otherwise */
+	void checkCompatible( PixelSet* ps );
+	
 	/** writes pixel set cardinality and min, max values for x, y, z coordinates to the default log */
 	void logStatistics();
 	
@@ -0,0 +1,317 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#include "PixelSetKernels.h"
+
+#if !defined(CEL_NO_SIMD) && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	#define CEL_X86_KERNELS
+	#include <immintrin.h>
+	#define CEL_TARGET(isa) __attribute__((target(isa)))
+#elif !defined(CEL_NO_SIMD) && defined(_MSC_VER) && defined(_M_X64)
+	#define CEL_X86_KERNELS
+	#include <intrin.h>
+	#include <immintrin.h>
+	#define CEL_TARGET(isa)
+#endif
+
+using namespace Ogre;
+
+
+// Scalar kernels
+
+template <typename T>
+static uint64 overlapScalar( const T* src, const T* other, T* dest )
+{
+	uint64 bits = 0;
+	for (int i = 0; i < 64; i++) {
+		bool in = src[i] > 0 && other[i] > 0;
+		dest[i] = in ? src[i] : 0;
+		bits |= (uint64)in << i;
+	}
+	return bits;
+}
+
+template <typename T>
+static uint64 coveredByScalar( const T* src, const T* other, T* dest )
+{
+	uint64 bits = 0;
+	for (int i = 0; i < 64; i++) {
+		bool in = other[i] > 0 && src[i] > other[i];
+		dest[i] = in ? src[i] : 0;
+		bits |= (uint64)in << i;
+	}
+	return bits;
+}
+
+
+#ifdef CEL_X86_KERNELS
+
+// SSE2 kernels, 8 depth samples (L16) or 4 depth samples (float) at a time
+
+CEL_TARGET("sse2")
+static uint64 overlap16SSE2( const uint16* src, const uint16* other, uint16* dest )
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i o = _mm_loadu_si128((const __m128i*)(other + i));
+		
+		// in = !(s == 0) && !(o == 0)
+		__m128i out = _mm_or_si128(_mm_cmpeq_epi16(s, zero), _mm_cmpeq_epi16(o, zero));
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_andnot_si128(out, s));
+		
+		bits |= (uint64)(~_mm_movemask_epi8(_mm_packs_epi16(out, zero)) & 0xFF) << i;
+	}
+	return bits;
+}
+
+CEL_TARGET("sse2")
+static uint64 coveredBy16SSE2( const uint16* src, const uint16* other, uint16* dest )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i o = _mm_loadu_si128((const __m128i*)(other + i));
+		
+		// unsigned s > o through a signed compare on biased samples, and o != 0
+		__m128i greater = _mm_cmpgt_epi16(_mm_xor_si128(s, bias), _mm_xor_si128(o, bias));
+		__m128i in = _mm_andnot_si128(_mm_cmpeq_epi16(o, zero), greater);
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_and_si128(in, s));
+		
+		bits |= (uint64)(_mm_movemask_epi8(_mm_packs_epi16(in, zero)) & 0xFF) << i;
+	}
+	return bits;
+}
+
+CEL_TARGET("sse2")
+static uint64 overlap32SSE2( const float* src, const float* other, float* dest )
+{
+	const __m128 zero = _mm_setzero_ps();
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 4) {
+		__m128 s = _mm_loadu_ps(src + i);
+		__m128 o = _mm_loadu_ps(other + i);
+		
+		__m128 in = _mm_and_ps(_mm_cmpgt_ps(s, zero), _mm_cmpgt_ps(o, zero));
+		_mm_storeu_ps(dest + i, _mm_and_ps(in, s));
+		
+		bits |= (uint64)_mm_movemask_ps(in) << i;
+	}
+	return bits;
+}
+
+CEL_TARGET("sse2")
+static uint64 coveredBy32SSE2( const float* src, const float* other, float* dest )
+{
+	const __m128 zero = _mm_setzero_ps();
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 4) {
+		__m128 s = _mm_loadu_ps(src + i);
+		__m128 o = _mm_loadu_ps(other + i);
+		
+		__m128 in = _mm_and_ps(_mm_cmpgt_ps(o, zero), _mm_cmpgt_ps(s, o));
+		_mm_storeu_ps(dest + i, _mm_and_ps(in, s));
+		
+		bits |= (uint64)_mm_movemask_ps(in) << i;
+	}
+	return bits;
+}
+
+
+// AVX2 kernels, 16 depth samples (L16) or 8 depth samples (float) at a time
+
+/** Packs the 16 lanes of a 16 bit compare result into a 16 bit mask */
+CEL_TARGET("avx2")
+static inline uint64 movemask16AVX2( __m256i m )
+{
+	// packs works within 128 bit lanes, the permutation brings the two halves together
+	__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(m, _mm256_setzero_si256()), 0xD8);
+	return (uint64)(_mm256_movemask_epi8(packed) & 0xFFFF);
+}
+
+CEL_TARGET("avx2")
+static uint64 overlap16AVX2( const uint16* src, const uint16* other, uint16* dest )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 16) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i o = _mm256_loadu_si256((const __m256i*)(other + i));
+		
+		__m256i out = _mm256_or_si256(_mm256_cmpeq_epi16(s, zero), _mm256_cmpeq_epi16(o, zero));
+		_mm256_storeu_si256((__m256i*)(dest + i), _mm256_andnot_si256(out, s));
+		
+		bits |= (~movemask16AVX2(out) & 0xFFFF) << i;
+	}
+	return bits;
+}
+
+CEL_TARGET("avx2")
+static uint64 coveredBy16AVX2( const uint16* src, const uint16* other, uint16* dest )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i bias = _mm256_set1_epi16((short)0x8000);
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 16) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i o = _mm256_loadu_si256((const __m256i*)(other + i));
+		
+		__m256i greater = _mm256_cmpgt_epi16(_mm256_xor_si256(s, bias), _mm256_xor_si256(o, bias));
+		__m256i in = _mm256_andnot_si256(_mm256_cmpeq_epi16(o, zero), greater);
+		_mm256_storeu_si256((__m256i*)(dest + i), _mm256_and_si256(in, s));
+		
+		bits |= movemask16AVX2(in) << i;
+	}
+	return bits;
+}
+
+CEL_TARGET("avx2")
+static uint64 overlap32AVX2( const float* src, const float* other, float* dest )
+{
+	const __m256 zero = _mm256_setzero_ps();
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 8) {
+		__m256 s = _mm256_loadu_ps(src + i);
+		__m256 o = _mm256_loadu_ps(other + i);
+		
+		__m256 in = _mm256_and_ps(_mm256_cmp_ps(s, zero, _CMP_GT_OQ), _mm256_cmp_ps(o, zero, _CMP_GT_OQ));
+		_mm256_storeu_ps(dest + i, _mm256_and_ps(in, s));
+		
+		bits |= (uint64)_mm256_movemask_ps(in) << i;
+	}
+	return bits;
+}
+
+CEL_TARGET("avx2")
+static uint64 coveredBy32AVX2( const float* src, const float* other, float* dest )
+{
+	const __m256 zero = _mm256_setzero_ps();
+	uint64 bits = 0;
+	
+	for (int i = 0; i < 64; i += 8) {
+		__m256 s = _mm256_loadu_ps(src + i);
+		__m256 o = _mm256_loadu_ps(other + i);
+		
+		__m256 in = _mm256_and_ps(_mm256_cmp_ps(o, zero, _CMP_GT_OQ), _mm256_cmp_ps(s, o, _CMP_GT_OQ));
+		_mm256_storeu_ps(dest + i, _mm256_and_ps(in, s));
+		
+		bits |= (uint64)_mm256_movemask_ps(in) << i;
+	}
+	return bits;
+}
+
+/** Checks if the CPU supports SSE2, always true on x86-64 */
+static bool hasSSE2()
+{
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#else
+	return true;
+#endif
+}
+
+/** Checks if the CPU and the OS support AVX2 */
+static bool hasAVX2()
+{
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	
+	// OSXSAVE and AVX, then YMM state enabled by the OS, then AVX2
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+	
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+#endif // CEL_X86_KERNELS
+
+
+const PixelSetKernels& PixelSetKernels::scalar()
+{
+	static const PixelSetKernels kernels = {
+		overlapScalar<uint16>, overlapScalar<float>,
+		coveredByScalar<uint16>, coveredByScalar<float>,
+		"scalar"
+	};
+	return kernels;
+}
+
+const PixelSetKernels& PixelSetKernels::get()
+{
+	// the widest instruction set the CPU supports
+	static const PixelSetKernels* selected = supported().back();
+	return *selected;
+}
+
+std::vector<const PixelSetKernels*> PixelSetKernels::supported()
+{
+	std::vector<const PixelSetKernels*> kernels(1, &scalar());
+	
+#ifdef CEL_X86_KERNELS
+	static const PixelSetKernels sse2 = {
+		overlap16SSE2, overlap32SSE2,
+		coveredBy16SSE2, coveredBy32SSE2,
+		"SSE2"
+	};
+	static const PixelSetKernels avx2 = {
+		overlap16AVX2, overlap32AVX2,
+		coveredBy16AVX2, coveredBy32AVX2,
+		"AVX2"
+	};
+	if (hasSSE2())
+		kernels.push_back(&sse2);
+	if (hasAVX2())
+		kernels.push_back(&avx2);
+#endif
+	
+	return kernels;
+}
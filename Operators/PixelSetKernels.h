@@ -0,0 +1,70 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#ifndef _dPixelSetKernels // to avoid duplicate inclusions
+#define _dPixelSetKernels
+
+#include "Ogre.h"
+#include <vector>
+
+/** @brief Per-pixel kernels used by the PixelSet operators, selected at runtime 
+	according to the instruction sets supported by the CPU (AVX2, SSE2 or plain C++).
+ @remarks every kernel processes one word of the occupancy bitmap, i.e. 64 contiguous
+	depth samples of a row, writes the 64 resulting samples to dest (0 for pixels that 
+	are not in the result) and returns the occupancy word of the result.
+	Define CEL_NO_SIMD to always use the scalar kernels.
+*/
+struct PixelSetKernels
+{
+	typedef Ogre::uint64 (*Kernel16)( const Ogre::uint16* src, const Ogre::uint16* other, Ogre::uint16* dest );
+	typedef Ogre::uint64 (*Kernel32)( const float* src, const float* other, float* dest );
+	
+	/** Overlap: dest = src where both src and other are in the set */
+	Kernel16 overlap16;
+	Kernel32 overlap32;
+	
+	/** CoveredBy: dest = src where other is in the set and src > other */
+	Kernel16 coveredBy16;
+	Kernel32 coveredBy32;
+	
+	/** Name of the selected instruction set, for logging */
+	const char* isa;
+	
+	/** Returns the kernels for the current CPU, detected on the first call */
+	static const PixelSetKernels& get();
+	
+	/** Returns the portable kernels, used as reference */
+	static const PixelSetKernels& scalar();
+	
+	/** Returns all the kernels the CPU supports, the scalar ones first, e.g. to check them against each other */
+	static std::vector<const PixelSetKernels*> supported();
+};
+
+#endif
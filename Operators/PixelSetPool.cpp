@@ -0,0 +1,374 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+
+#include "PixelSetPool.h"
+#include "PixelSet.h"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace Ogre;
+
+
+/** The scratch buffers of a thread, the first `borrowed` of them are lent */
+struct PixelSetScratchStack
+{
+	std::vector<std::vector<uint64>*> buffers;
+	size_t borrowed;
+};
+
+/** Scratch buffers of the calling thread, created the first time it asks for one */
+static PixelSetScratchStack* threadScratch = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(threadScratch)
+#endif
+
+
+bool PixelSetPool::Key::operator<( const Key& k ) const
+{
+	if (width != k.width)
+		return width < k.width;
+	if (height != k.height)
+		return height < k.height;
+	if (faces != k.faces)
+		return faces < k.faces;
+	return format < k.format;
+}
+
+/** Size class of a bitmap of the given number of words, the next power of two, so that the 
+	bitmaps of parts of renders of all sizes recycle each other */
+static size_t maskClass( size_t words )
+{
+	size_t size = 1;
+	while (size < words)
+		size <<= 1;
+	return size;
+}
+
+PixelSetPool::PixelSetPool() : budget(64 * 1024 * 1024), evictions(0), requests(0), hits(0), liveBytes(0), pooledBytes(0), peakBytes(0), 
+	allocations(0), allocatedBytes(0)
+{
+}
+
+PixelSetPool::~PixelSetPool()
+{
+	clear();
+	
+	for (size_t i = 0; i < scratchStacks.size(); i++) {
+		for (size_t j = 0; j < scratchStacks[i]->buffers.size(); j++)
+			delete scratchStacks[i]->buffers[j];
+		delete scratchStacks[i];
+	}
+}
+
+PixelSetPool& PixelSetPool::get()
+{
+	static PixelSetPool pool;
+	return pool;
+}
+
+Image* PixelSetPool::acquire( int width, int height, PixelFormat format, int faces, bool clear )
+{
+	Key key = { width, height, faces, format };
+	Image* image;
+	
+	requests++;
+	
+	std::vector<Image*>& available = freeImages[key];
+	
+	if ( !available.empty() ) {
+		
+		image = available.back();
+		available.pop_back();
+		hits++;
+		
+		Buffer& buffer = buffers[image];
+		idleImages.erase(buffer.idle);
+		pooledBytes -= buffer.size;
+		
+	} else {
+		
+		// A new buffer, owned by the pool and not by the image
+		size_t size = width * height * PixelUtil::getNumElemBytes(format) * faces;
+		Buffer buffer = { key, OGRE_ALLOC_T( uchar, size, MEMCATEGORY_GENERAL ), size, idleImages.end() };
+		
+		image = new Image();
+		image->loadDynamicImage(buffer.data, width, height, 1, format, false, faces, 0);
+		
+		buffers[image] = buffer;
+		clear = true;
+	}
+	
+	Buffer& buffer = buffers[image];
+	liveBytes += buffer.size;
+	updatePeak();
+	
+	if (clear)
+		memset(buffer.data, 0, buffer.size);
+	
+	return image;
+}
+
+void PixelSetPool::shrink( Image* image, int width, int height )
+{
+	Buffer& buffer = buffers[image];
+	
+	if ( width > buffer.key.width || height > buffer.key.height )
+		throw PixelSetException("An image of the pool can't grow.");
+	
+	image->loadDynamicImage(buffer.data, width, height, 1, buffer.key.format, false, buffer.key.faces, 0);
+}
+
+void PixelSetPool::release( Image* image )
+{
+	if (image == 0)
+		return;
+	
+	std::map<Image*, Buffer>::iterator it = buffers.find(image);
+	
+	if ( it == buffers.end() ) {
+		delete image;
+		return;
+	}
+	
+	// The image may have been pointed to another buffer, or shrunk, in the meantime
+	Buffer& buffer = it->second;
+	if ( image->getData() != buffer.data || (int)image->getWidth() != buffer.key.width || (int)image->getHeight() != buffer.key.height )
+		image->loadDynamicImage(buffer.data, buffer.key.width, buffer.key.height, 1, buffer.key.format, false, buffer.key.faces, 0);
+	
+	liveBytes -= buffer.size;
+	pooledBytes += buffer.size;
+	
+	freeImages[buffer.key].push_back(image);
+	buffer.idle = idleImages.insert(idleImages.end(), image);
+	
+	evict();
+}
+
+void PixelSetPool::acquireMask( size_t words, std::vector<uint64>& mask )
+{
+	requests++;
+	
+	size_t size = maskClass(words);
+	std::vector<std::vector<uint64> >& available = freeMasks[size];
+	
+	if ( !available.empty() ) {
+		
+		mask.swap(available.back());
+		available.pop_back();
+		hits++;
+		
+		pooledBytes -= size * sizeof(uint64);
+	} else {
+		mask.reserve(size);
+	}
+	
+	mask.assign(words, 0);
+	
+	liveBytes += size * sizeof(uint64);
+	updatePeak();
+}
+
+void PixelSetPool::releaseMask( std::vector<uint64>& mask )
+{
+	size_t words = mask.size();
+	
+	if (words == 0)
+		return;
+	
+	size_t size = maskClass(words);
+	liveBytes -= size * sizeof(uint64);
+	
+	// a bitmap that didn't come from acquireMask() may hold less than its size class
+	if (mask.capacity() < size) {
+		std::vector<uint64>().swap(mask);
+		return;
+	}
+	
+	std::vector<std::vector<uint64> >& available = freeMasks[size];
+	available.push_back(std::vector<uint64>());
+	available.back().swap(mask);
+	
+	pooledBytes += size * sizeof(uint64);
+	
+	evict();
+}
+
+void* PixelSetPool::acquireScratch( size_t bytes )
+{
+	if (!threadScratch) {
+		
+		threadScratch = new PixelSetScratchStack();
+		threadScratch->borrowed = 0;
+		
+#ifdef _OPENMP
+		#pragma omp critical(PixelSetPoolScratch)
+#endif
+		scratchStacks.push_back(threadScratch);
+	}
+	
+	PixelSetScratchStack& stack = *threadScratch;
+	
+	if (stack.borrowed == stack.buffers.size())
+		stack.buffers.push_back(new std::vector<uint64>());
+	
+	std::vector<uint64>& buffer = *stack.buffers[stack.borrowed++];
+	
+	// Grown to the largest size asked so far
+	size_t words = std::max<size_t>((bytes + sizeof(uint64) - 1) / sizeof(uint64), 1);
+	
+	if (buffer.size() < words) {
+		buffer.resize(words);
+		countAllocation(words * sizeof(uint64));
+	}
+	
+	return &buffer[0];
+}
+
+void PixelSetPool::releaseScratch()
+{
+	threadScratch->borrowed--;
+}
+
+void PixelSetPool::countAllocation( size_t bytes )
+{
+#ifdef _OPENMP
+	#pragma omp atomic
+#endif
+	allocations++;
+	
+#ifdef _OPENMP
+	#pragma omp atomic
+#endif
+	allocatedBytes += bytes;
+}
+
+size_t PixelSetPool::ScratchBytes()
+{
+	size_t bytes = 0;
+	
+	for (size_t i = 0; i < scratchStacks.size(); i++)
+		for (size_t j = 0; j < scratchStacks[i]->buffers.size(); j++)
+			bytes += scratchStacks[i]->buffers[j]->size() * sizeof(uint64);
+	
+	return bytes;
+}
+
+void PixelSetPool::clear()
+{
+	std::list<Image*>::iterator it;
+	
+	for (it = idleImages.begin(); it != idleImages.end(); ++it)
+		destroy(*it);
+	
+	idleImages.clear();
+	freeImages.clear();
+	freeMasks.clear();
+	pooledBytes = 0;
+	
+	// The scratch buffers of threads that aren't running an operator
+	for (size_t i = 0; i < scratchStacks.size(); i++) {
+		
+		PixelSetScratchStack* stack = scratchStacks[i];
+		
+		if (stack->borrowed > 0)
+			continue;
+		
+		for (size_t j = 0; j < stack->buffers.size(); j++)
+			delete stack->buffers[j];
+		
+		stack->buffers.clear();
+	}
+}
+
+void PixelSetPool::setBudget( size_t maxBytes )
+{
+	budget = maxBytes;
+	evict();
+}
+
+void PixelSetPool::evict()
+{
+	while (pooledBytes > budget && !idleImages.empty()) {
+		
+		Image* image = idleImages.front();
+		idleImages.pop_front();
+		
+		std::vector<Image*>& available = freeImages[buffers[image].key];
+		available.erase( std::find(available.begin(), available.end(), image) );
+		
+		pooledBytes -= buffers[image].size;
+		evictions++;
+		
+		destroy(image);
+	}
+	
+	std::map<size_t, std::vector<std::vector<uint64> > >::iterator masks = freeMasks.begin();
+	
+	while (pooledBytes > budget && masks != freeMasks.end()) {
+		
+		if (masks->second.empty()) {
+			++masks;
+			continue;
+		}
+		
+		masks->second.pop_back();
+		pooledBytes -= masks->first * sizeof(uint64);
+		evictions++;
+	}
+}
+
+void PixelSetPool::destroy( Image* image )
+{
+	OGRE_FREE( buffers[image].data, MEMCATEGORY_GENERAL );
+	buffers.erase(image);
+	delete image;
+}
+
+void PixelSetPool::updatePeak()
+{
+	if (liveBytes + pooledBytes > peakBytes)
+		peakBytes = liveBytes + pooledBytes;
+}
+
+void PixelSetPool::logStatistics()
+{
+	LogManager::getSingleton().logMessage("Pixel set pool, requests: " + StringConverter::toString(requests) + 
+		", hit rate: " + StringConverter::toString(HitRate()));
+	LogManager::getSingleton().logMessage("Pixel set pool, live bytes: " + StringConverter::toString(liveBytes) + 
+		", idle bytes: " + StringConverter::toString(pooledBytes) + ", peak bytes: " + StringConverter::toString(peakBytes) + 
+		", evictions: " + StringConverter::toString(evictions));
+	LogManager::getSingleton().logMessage("Pixel set pool, operator allocations: " + StringConverter::toString(allocations) + 
+		", allocated bytes: " + StringConverter::toString(allocatedBytes) + ", scratch bytes: " + StringConverter::toString(ScratchBytes()));
+}
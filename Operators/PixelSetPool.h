@@ -0,0 +1,200 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#ifndef _dPixelSetPool // to avoid duplicate inclusions
+#define _dPixelSetPool
+
+#include "Ogre.h"
+
+#include <list>
+#include <map>
+#include <vector>
+
+struct PixelSetScratchStack;
+
+/** @brief Recycles the image buffers and occupancy bitmaps of pixel sets.
+ @remarks renders and operator results all have the size of the viewport, so the buffers
+	released by the pixel sets of an evaluation are handed to the pixel sets of the next 
+	one instead of going back to the heap. Image buffers are kept by (width, height, format,
+	faces), bitmaps by number of words rounded up to a power of two. When the idle buffers take more than the byte budget,
+	the ones given back the longest ago are freed.
+	The pool also keeps the scratch buffers the operators work in, one stack of them per thread, see PixelSetScratch.
+*/
+class PixelSetPool
+{
+	
+public:
+	
+	/** Returns the pool shared by all pixel sets */
+	static PixelSetPool& get();
+	
+	/** Returns an image of the given size and format, black if clear is true. 
+		The image must be given back with release(). */
+	Ogre::Image* acquire( int width, int height, Ogre::PixelFormat format, int faces, bool clear = true );
+	
+	/** Cuts an image returned by acquire() down to width x height on the same buffer, e.g. for the 
+		part of a render where the targets can be: parts of all sizes then recycle the buffers of 
+		full renders instead of each size keeping buffers of its own. release() restores the size. */
+	void shrink( Ogre::Image* image, int width, int height );
+	
+	/** Gives back an image returned by acquire(), images that don't come from the pool are deleted */
+	void release( Ogre::Image* image );
+	
+	/** Swaps an occupancy bitmap of the given number of words, all 0, into mask */
+	void acquireMask( size_t words, std::vector<Ogre::uint64>& mask );
+	
+	/** Swaps mask back into the pool, leaving it empty */
+	void releaseMask( std::vector<Ogre::uint64>& mask );
+	
+	/** Lends the calling thread a scratch buffer of at least the given bytes, aligned on 8 bytes and uninitialized. 
+		Each thread gives its scratch buffers back with releaseScratch() in the reverse order it got them, and 
+		keeps them for its next operations: they are only allocated the first times, or to grow. */
+	void* acquireScratch( size_t bytes );
+	
+	/** Gives back the last scratch buffer lent to the calling thread */
+	void releaseScratch();
+	
+	/** Counts an allocation made by an operator, e.g. the runs of a SPARSE result, see Allocations(). 
+		Can be called by several threads at the same time. */
+	void countAllocation( size_t bytes );
+	
+	/** Frees all the buffers that are not in use */
+	void clear();
+	
+	/** Sets the bytes the idle buffers may take, freeing buffers if needed. 0 keeps no buffer. */
+	void setBudget( size_t maxBytes );
+	size_t Budget() { return budget; }
+	
+	/** Number of buffers requested, and how many of them were recycled */
+	size_t Requests() { return requests; }
+	size_t Hits() { return hits; }
+	float HitRate() { return requests ? (float)hits / requests : 0; }
+	
+	/** Number of idle buffers freed to stay in the budget */
+	size_t Evictions() { return evictions; }
+	
+	/** Bytes of the buffers in use, and of all the buffers owned by the pool at most */
+	size_t LiveBytes() { return liveBytes; }
+	size_t PeakBytes() { return peakBytes; }
+	
+	/** Number of allocations and bytes allocated by the operators, scratch buffers included, 
+		and the bytes of the scratch buffers kept by the threads */
+	size_t Allocations() { return allocations; }
+	size_t AllocatedBytes() { return allocatedBytes; }
+	size_t ScratchBytes();
+	
+	/** writes the statistics of the pool to the default log */
+	void logStatistics();
+	
+private:
+	
+	PixelSetPool();
+	~PixelSetPool();
+	
+	/** Size and format of an image buffer */
+	struct Key {
+		int width, height, faces;
+		Ogre::PixelFormat format;
+		
+		bool operator<( const Key& k ) const;
+	};
+	
+	/** A buffer of the pool, wrapped by an image, and its place in idleImages while it's idle */
+	struct Buffer {
+		Key key;
+		Ogre::uchar* data;
+		size_t size;
+		std::list<Ogre::Image*>::iterator idle;
+	};
+	
+	/** Updates peakBytes after the pool got a new buffer */
+	void updatePeak();
+	
+	/** Frees the idle buffers given back the longest ago, then bitmaps, until they fit in the budget */
+	void evict();
+	
+	/** Frees an idle image and its buffer */
+	void destroy( Ogre::Image* image );
+	
+	/** Images that can be handed out, by key */
+	std::map<Key, std::vector<Ogre::Image*> > freeImages;
+	
+	/** Buffers of all the images created by the pool */
+	std::map<Ogre::Image*, Buffer> buffers;
+	
+	/** Images that can be handed out, the one given back the longest ago first */
+	std::list<Ogre::Image*> idleImages;
+	
+	/** Bitmaps that can be handed out, by size class of their number of words */
+	std::map<size_t, std::vector<std::vector<Ogre::uint64> > > freeMasks;
+	
+	/** Scratch buffers of all the threads that asked for some */
+	std::vector<PixelSetScratchStack*> scratchStacks;
+	
+	size_t budget, evictions;
+	size_t requests, hits;
+	size_t liveBytes, pooledBytes, peakBytes;
+	size_t allocations, allocatedBytes;
+	
+};
+
+
+/** @brief A scratch buffer of count elements borrowed from the pool by the calling thread while it is in scope.
+ @remarks the elements are uninitialized, T must not need to be constructed. Buffers are given back in the
+	reverse order they were borrowed, as locals and members are destroyed. Nothing is borrowed for 0 elements.
+*/
+template <typename T>
+class PixelSetScratch
+{
+
+public:
+
+	PixelSetScratch( size_t count ) : 
+		data(count ? static_cast<T*>(PixelSetPool::get().acquireScratch(count * sizeof(T))) : 0) {}
+	
+	~PixelSetScratch() 
+	{ 
+		if (data) 
+			PixelSetPool::get().releaseScratch(); 
+	}
+	
+	T& operator[]( size_t i ) { return data[i]; }
+	const T& operator[]( size_t i ) const { return data[i]; }
+	
+	T* data;
+	
+private:
+
+	PixelSetScratch( const PixelSetScratch& );
+	PixelSetScratch& operator=( const PixelSetScratch& );
+	
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#include "RenderCache.h"
+
+using namespace Ogre;
+
+RenderCache::RenderCache( size_t maxBytes ) : budget(maxBytes), bytes(0), hits(0), misses(0), evictions(0)
+{
+}
+
+
+RenderCache::~RenderCache()
+{
+	clear();
+}
+
+
+PixelSet* RenderCache::find( const String& key )
+{
+	std::map<String, std::list<Entry>::iterator>::iterator it = index.find(key);
+	
+	if (it == index.end()) {
+		misses++;
+		return NULL;
+	}
+	
+	hits++;
+	
+	// the set becomes the most recently used
+	entries.splice(entries.begin(), entries, it->second);
+	
+	return it->second->set->Share();
+}
+
+
+void RenderCache::insert( const String& key, PixelSet* ps )
+{
+	if (budget == 0)
+		return;
+	
+	std::map<String, std::list<Entry>::iterator>::iterator it = index.find(key);
+	
+	if (it != index.end()) {
+		bytes -= it->second->bytes;
+		it->second->set->Release();
+		entries.erase(it->second);
+		index.erase(it);
+	}
+	
+	Entry entry;
+	entry.key = key;
+	entry.set = ps->Share();
+	entry.bytes = entry.set->Bytes();
+	
+	entries.push_front(entry);
+	index[key] = entries.begin();
+	bytes += entry.bytes;
+	
+	evict();
+}
+
+
+void RenderCache::clear()
+{
+	std::list<Entry>::iterator it;
+	for (it = entries.begin(); it != entries.end(); ++it)
+		it->set->Release();
+	
+	entries.clear();
+	index.clear();
+	bytes = 0;
+}
+
+
+void RenderCache::setBudget( size_t maxBytes )
+{
+	budget = maxBytes;
+	evict();
+}
+
+
+void RenderCache::evict()
+{
+	while (bytes > budget && !entries.empty()) {
+		
+		Entry& last = entries.back();
+		
+		bytes -= last.bytes;
+		last.set->Release();
+		index.erase(last.key);
+		entries.pop_back();
+		
+		evictions++;
+	}
+}
+
+
+void RenderCache::logStatistics()
+{
+	LogManager::getSingleton().logMessage("Render cache, hits: " + StringConverter::toString(hits) + 
+		", misses: " + StringConverter::toString(misses) + ", hit rate: " + StringConverter::toString(HitRate()));
+	LogManager::getSingleton().logMessage("Render cache, bytes: " + StringConverter::toString(bytes) + 
+		", evictions: " + StringConverter::toString(evictions));
+}
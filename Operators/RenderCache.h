@@ -0,0 +1,112 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#ifndef _dRenderCache // to avoid duplicate inclusions
+#define _dRenderCache
+
+#include "Ogre.h"
+
+#include <list>
+#include <map>
+
+#include "PixelSet.h"
+
+/** @brief Keeps the PixelSets of recent renders, so that identical renders are served from memory.
+ @remarks sets are looked up by a key describing everything the render depends on, built by 
+	the Renderer. The sets are shared, not copied, see PixelSet::Share(): insert() keeps the given 
+	set and find() hands it out again, both callers giving it back with PixelSet::Release(). When 
+	the sets take more than the byte budget, the least recently used ones are dropped.
+*/
+class RenderCache
+{
+	
+public:
+	
+	/** Creates an empty cache
+	 @param maxBytes bytes the cached sets may take, 0 disables the cache
+	 */
+	RenderCache( size_t maxBytes = 64 * 1024 * 1024 );
+	
+	/** Deletes the cached sets */
+	~RenderCache();
+	
+	/** Returns the set cached under key, shared with the cache, or NULL if there is none */
+	PixelSet* find( const Ogre::String& key );
+	
+	/** Returns true if a set is cached under key, without counting it as a hit or a miss */
+	bool contains( const Ogre::String& key ) { return index.find(key) != index.end(); }
+	
+	/** Caches ps under key, shared with the caller, replacing the set cached under the same key if any */
+	void insert( const Ogre::String& key, PixelSet* ps );
+	
+	/** Drops all the cached sets */
+	void clear();
+	
+	/** Sets the bytes the cached sets may take, dropping sets if needed. 0 disables the cache. */
+	void setBudget( size_t maxBytes );
+	size_t Budget() { return budget; }
+	
+	/** Number of lookups served from the cache, number of lookups that weren't, 
+		and number of sets dropped to stay in the budget */
+	size_t Hits() { return hits; }
+	size_t Misses() { return misses; }
+	size_t Evictions() { return evictions; }
+	float HitRate() { return hits + misses ? (float)hits / (hits + misses) : 0; }
+	
+	/** Bytes taken by the cached sets */
+	size_t Bytes() { return bytes; }
+	
+	/** writes the statistics of the cache to the default log */
+	void logStatistics();
+	
+private:
+	
+	/** A cached set */
+	struct Entry {
+		Ogre::String key;
+		PixelSet* set;
+		size_t bytes;
+	};
+	
+	/** Drops the least recently used sets until the cached ones fit in the budget */
+	void evict();
+	
+	/** Cached sets, the most recently used first */
+	std::list<Entry> entries;
+	
+	/** Position of each cached set in entries, by key */
+	std::map<Ogre::String, std::list<Entry>::iterator> index;
+	
+	size_t budget, bytes;
+	size_t hits, misses, evictions;
+	
+};
+
+#endif
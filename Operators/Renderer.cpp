@@ -29,23 +29,90 @@ http://www.gnu.org/copyleft/lesser.txt.
 */
 
 #include "Renderer.h"
+#include "PixelSetPool.h"
+#include "GpuPixelSet.h"
 #include <sstream>
+#include <algorithm>
 
 using namespace Ogre;
 
 // #define PRINT_SHOTS
 
+/** Index of the custom parameter of renderables holding their object id, and the largest id.
+	Ids are written normalized to the id texture, so that they survive 16 bit formats. */
+static const size_t CEL_OBJECT_ID_PARAMETER = 7;
+static const Real CEL_MAX_OBJECT_ID = 65535;
+
+/** Object id of a pixel of the id texture, as written by Renderer::setObjectId() */
+static inline size_t objectId(uint16 id) { return id; }
+static inline size_t objectId(float id) { return (size_t)(id * CEL_MAX_OBJECT_ID + 0.5f); }
+
+/** Copies the depth of each pixel to the box of the target whose id it holds, if that target has
+	a box: targets[i] receives the pixels of id i + 1. T is the depth and id sample type. */
+template <typename T>
+static void splitTargets(const PixelBox& depthBox, const PixelBox& idBox, const std::vector<PixelBox>& targets)
+{
+	int width = (int)depthBox.getWidth(), height = (int)depthBox.getHeight();
+	
+	for (int y = 0; y < height; y++) {
+		
+		const T* depthRow = static_cast<const T*>(depthBox.data) + y * depthBox.rowPitch;
+		const T* idRow = static_cast<const T*>(idBox.data) + y * idBox.rowPitch;
+		
+		for (int x = 0; x < width; x++) {
+			
+			size_t target = objectId(idRow[x]);
+			
+			if (target == 0 || target > targets.size() || targets[target - 1].data == 0)
+				continue;
+			
+			const PixelBox& box = targets[target - 1];
+			static_cast<T*>(box.data)[y * box.rowPitch + x] = depthRow[x];
+		}
+	}
+}
+
+/** Mixes size bytes at data into an FNV-1a hash */
+static inline void hashBytes(const void* data, size_t size, uint64& hash)
+{
+	const uchar* bytes = static_cast<const uchar*>(data);
+	
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= ((uint64)0x100 << 32) | 0x1b3;
+	}
+}
+
 /** Frames and view volumes */
 int Renderer::frameIndex = 0;
 std::vector<SceneNode* > Renderer::auxiliaries = std::vector<SceneNode* >();
 
 Renderer *Renderer::OgreRenderer = NULL;
 
-Renderer::Renderer(SceneManager* sm, int viewportWidth, int viewportHeight): sceneManager(sm), m_viewportWidth(viewportWidth), m_viewportHeight(viewportHeight)
+unsigned long Renderer::bindingVersion = 0;
+
+Renderer::Renderer(SceneManager* sm, int viewportWidth, int viewportHeight, bool software): sceneManager(sm), m_viewportWidth(viewportWidth), m_viewportHeight(viewportHeight)
 {
 		
 	OgreRenderer = this;
 	
+	nextHandle = 0;
+	sceneVersion = 0;
+	persistentCache = false;
+	windowedReadback = true;
+	sceneFrozen = false;
+	sceneHashed = false;
+	renderCount = 0;
+	skippedRenders = 0;
+	idRenderTarget = 0;
+	rasterizer = 0;
+	countQuery = 0;
+	countQuad = 0;
+	counting = countIssued = false;
+	
+	for (int i = 0; i < asyncDepth; i++)
+		asyncHandles[i] = -1;
+	
 	// Create a camera for offscreen rendering
 	offScreenCamera = sceneManager->createCamera("CEL_OffScreenCamera");
 	
@@ -55,6 +122,34 @@ Renderer::Renderer(SceneManager* sm, int viewportWidth, int viewportHeight): sce
 	// Attach camera to SceneManager
 	sceneManager->getRootSceneNode()->addChild(cameraNode);
 	cameraNode->attachObject(offScreenCamera); 	
+	
+	// Estimate the size of the cube texture in order to have the 
+	// same resolution as the planar texture
+	
+	int extWidth = (int) floor(viewportHeight / offScreenCamera->getFOVy().valueRadians()) * 1.5;
+	m_cubeWidth = (extWidth % 2 == 0) ? extWidth : extWidth + 1;
+	
+	// Each face of the cube is rendered by its own camera, so that the
+	// six faces can be rendered back to back before reading any of them back
+	for (int face = 0; face < 6; face++) {
+		
+		cubeCameras[face] = sceneManager->createCamera("CEL_OffScreenCubeCamera" + StringConverter::toString(face));
+		cameraNode->attachObject(cubeCameras[face]);
+		
+		cubeCameras[face]->setNearClipDistance(0.00001);	
+		cubeCameras[face]->setAspectRatio(1.0);
+		cubeCameras[face]->setFOVy(Degree(90)); 
+		cubeCameras[face]->setProjectionType(PT_PERSPECTIVE);
+	}
+	
+	// Set the visibility flag of all scene nodes to 0xFFFFFFF0
+	setVisible( sceneManager->getRootSceneNode(), 0xFFFFFFF0 );
+	
+	// Without a render system, there are no textures nor materials to set up
+	if (software) {
+		rasterizer = new DepthRasterizer();
+		return;
+	}
 		
 	// Initialise render texture using PF_FLOAT32_R. The PixelFormat
 	// choice is due to the fact that apparently there's no C++ data type
@@ -88,41 +183,93 @@ Renderer::Renderer(SceneManager* sm, int viewportWidth, int viewportHeight): sce
 	// Associate the material scheme to the offscreen viewport
 	offScreenViewport->setMaterialScheme("CEL_Depth_Scheme");
 	
-	// Estimate the size of the cube texture in order to have the 
-	// same resolution as the planar texture
-	
-	int extWidth = (int) floor(viewportHeight / offScreenCamera->getFOVy().valueRadians()) * 1.5;
-	int evenWidth = (extWidth % 2 == 0) ? extWidth : extWidth + 1;
-	
 	// Initialize cube texture with the same settings as the previous one.
 	cubeTexture = Root::getSingletonPtr()->getTextureManager()->createManual(
 		"CEL_OSR_Depth_CubeRenderTarget",	// Name of texture
 		"Default",							// Name of resource group in which the texture should be created
-		TEX_TYPE_2D,					    // Texture type
-		evenWidth,							// Width
-		evenWidth,							// Height 
+		TEX_TYPE_CUBE_MAP,				    // Texture type
+		m_cubeWidth,						// Width
+		m_cubeWidth,						// Height 
 		0,									// number of default mipmaps
 		PF_L16,								// Pixel format with one float component of 32 bits.
 		TU_RENDERTARGET						// Usage
 	);
 	
-
-	// Get cube map RenderTargets, set-up them and attach them to the RenderSystem
-	offScreenRenderTarget = cubeTexture->getBuffer(0)->getRenderTarget();
-	offScreenRenderTarget->setAutoUpdated(false);
-	Root::getSingletonPtr()->getRenderSystem()->attachRenderTarget(*offScreenRenderTarget);
+	// Each face of the cube map is a RenderTarget with the camera of the face
+	for (int face = 0; face < 6; face++) {
 		
-	// Add a viewport to the render target
-	offScreenViewport = offScreenRenderTarget->addViewport(offScreenCamera);
+		// Get cube map RenderTargets, set-up them and attach them to the RenderSystem
+		offScreenRenderTarget = cubeTexture->getBuffer(face)->getRenderTarget();
+		offScreenRenderTarget->setAutoUpdated(false);
+		Root::getSingletonPtr()->getRenderSystem()->attachRenderTarget(*offScreenRenderTarget);
+		
+		// Add a viewport to the render target
+		offScreenViewport = offScreenRenderTarget->addViewport(cubeCameras[face]);
+		offScreenViewport->setSkiesEnabled(false);
+		offScreenViewport->setShadowsEnabled(false);
+		offScreenViewport->setBackgroundColour( ColourValue(0,0,0,1));
+		offScreenViewport->setOverlaysEnabled( false );
+		offScreenViewport->setClearEveryFrame ( true );
+		
+		// Associate the material scheme to the offscreen viewport
+		offScreenViewport->setMaterialScheme("CEL_Depth_Scheme");
+	}
+
+	
+	// Texture receiving the object id of each pixel, rendered together with the
+	// depth texture through a multiple render target
+	idTexture = Root::getSingletonPtr()->getTextureManager()->createManual(
+		"CEL_OSR_Id_RenderTarget",			// Name of texture
+		"Default",							// Name of resource group in which the texture should be created
+		TEX_TYPE_2D,						// Texture type
+		viewportWidth,						// Width
+		viewportHeight,						// Height 
+		0,									// number of default mipmaps
+		imageTexture->getFormat(),			// Same format as the depth texture, as MRTs require
+		TU_RENDERTARGET						// Usage
+	);
+	
+	idRenderTarget = Root::getSingletonPtr()->getRenderSystem()->createMultiRenderTarget("CEL_OSR_DepthId_RenderTarget");
+	idRenderTarget->bindSurface(0, imageTexture->getBuffer()->getRenderTarget());
+	idRenderTarget->bindSurface(1, idTexture->getBuffer()->getRenderTarget());
+	idRenderTarget->setAutoUpdated(false);
+	
+	offScreenViewport = idRenderTarget->addViewport(offScreenCamera);
 	offScreenViewport->setSkiesEnabled(false);
 	offScreenViewport->setShadowsEnabled(false);
 	offScreenViewport->setBackgroundColour( ColourValue(0,0,0,1));
 	offScreenViewport->setOverlaysEnabled( false );
 	offScreenViewport->setClearEveryFrame ( true );
+	
+	offScreenViewport->setMaterialScheme("CEL_DepthId_Scheme");
+	
+	// Textures rendered in turn by RenderAsync(), read back only when the 
+	// PixelSet is needed so that the GPU doesn't wait for the CPU
+	for (int i = 0; i < asyncDepth; i++) {
 		
-	// Associate the material scheme to the offscreen viewport
-	offScreenViewport->setMaterialScheme("CEL_Depth_Scheme");
-
+		asyncTextures[i] = Root::getSingletonPtr()->getTextureManager()->createManual(
+			"CEL_OSR_Depth_AsyncRenderTarget" + StringConverter::toString(i),
+			"Default",
+			TEX_TYPE_2D,
+			viewportWidth,
+			viewportHeight,
+			0,
+			PF_L16,
+			TU_RENDERTARGET
+		);
+		
+		offScreenRenderTarget = asyncTextures[i]->getBuffer()->getRenderTarget();
+		offScreenRenderTarget->setAutoUpdated(false);
+		Root::getSingletonPtr()->getRenderSystem()->attachRenderTarget(*offScreenRenderTarget);
+		
+		offScreenViewport = offScreenRenderTarget->addViewport(offScreenCamera);
+		offScreenViewport->setSkiesEnabled(false);
+		offScreenViewport->setShadowsEnabled(false);
+		offScreenViewport->setBackgroundColour( ColourValue(0,0,0,1));
+		offScreenViewport->setOverlaysEnabled( false );
+		offScreenViewport->setClearEveryFrame ( true );
+		offScreenViewport->setMaterialScheme("CEL_Depth_Scheme");
+	}
 	
 	// Prepare materials for off-screen depth rendering, for each
 	// material in the scene we add a new technique for depth
@@ -141,10 +288,33 @@ Renderer::Renderer(SceneManager* sm, int viewportWidth, int viewportHeight): sce
 		Pass* depthPass = depthTech->createPass();
 		depthPass->setVertexProgram("Depth_VS");
 		depthPass->setFragmentProgram("Depth_FS");
-	} 
 		
-	// Set the visibility flag of all scene nodes to 0xFFFFFFF0
-	setVisible( sceneManager->getRootSceneNode(), 0xFFFFFFF0 );
+		// The depth and id technique is a copy of the first depth technique, 
+		// which may come from the material script, writing the object id too
+		for (unsigned short i = 0; i < mat->getNumTechniques(); i++) {
+			
+			if (mat->getTechnique(i)->getSchemeName() != "CEL_Depth_Scheme")
+				continue;
+			
+			Technique* idTech = mat->createTechnique();
+			*idTech = *mat->getTechnique(i);
+			idTech->setSchemeName("CEL_DepthId_Scheme");
+			
+			Pass* idPass = idTech->getPass(0);
+			idPass->setFragmentProgram("DepthId_FS");
+			idPass->getFragmentProgramParameters()->setNamedAutoConstant(
+				"objectId", GpuProgramParameters::ACT_CUSTOM, CEL_OBJECT_ID_PARAMETER);
+			break;
+		}
+	} 
+	
+	// Pixels are counted by occlusion queries when the render system has them
+	RenderSystem* renderSystem = Root::getSingletonPtr()->getRenderSystem();
+	
+	if (renderSystem->getCapabilities()->hasCapability(RSC_HWOCCLUSION)) {
+		countQuery = renderSystem->createHardwareOcclusionQuery();
+		createCountQuad();
+	}
 	
 }
 
@@ -152,6 +322,46 @@ Renderer::Renderer(SceneManager* sm, int viewportWidth, int viewportHeight): sce
 Renderer::~Renderer()
 {
 	
+	// the GPU pixel sets render with the cameras and scheme of the Renderer
+	GpuPixelSet::shutdown();
+	
+	// Cleanup the depth and id target, which binds the depth texture too
+	ClearTargets();
+	
+	// the nodes outlive the renderer, and the ones it resolved are resolved again by the next one
+	std::set<Node*>::iterator watched;
+	for (watched = watchedNodes.begin(); watched != watchedNodes.end(); ++watched)
+		(*watched)->setListener(0);
+	
+	bindingVersion++;
+	
+	std::map<RenderHandle, PixelSet*>::iterator early;
+	for (early = earlyRenders.begin(); early != earlyRenders.end(); ++early)
+		early->second->Release();
+	
+	if (rasterizer) {
+		destroyCameras();
+		delete rasterizer;
+		return;
+	}
+	
+	if (countQuery) {
+		Root::getSingletonPtr()->getRenderSystem()->destroyHardwareOcclusionQuery(countQuery);
+		sceneManager->destroyManualObject(countQuad);
+	}
+	
+	idRenderTarget->removeAllViewports();
+	Root::getSingletonPtr()->getRenderSystem()->destroyRenderTarget(idRenderTarget->getName());
+	Root::getSingletonPtr()->getRenderSystem()->destroyRenderTexture(idTexture->getName());
+	
+	// Cleanup the asynchronous textures
+	for (int i = 0; i < asyncDepth; i++) {
+		RenderTarget* asyncRenderTarget = asyncTextures[i]->getBuffer()->getRenderTarget();
+		asyncRenderTarget->removeAllViewports();
+		Root::getSingletonPtr()->getRenderSystem()->destroyRenderTarget(asyncRenderTarget->getName());
+		Root::getSingletonPtr()->getRenderSystem()->destroyRenderTexture(asyncTextures[i]->getName());
+	}
+	
 	RenderTarget* offScreenRenderTarget = imageTexture->getBuffer()->getRenderTarget();
 	
 	// Cleanup normal texture
@@ -159,15 +369,29 @@ Renderer::~Renderer()
 	Root::getSingletonPtr()->getRenderSystem()->destroyRenderTarget(offScreenRenderTarget->getName());
 	Root::getSingletonPtr()->getRenderSystem()->destroyRenderTexture(imageTexture->getName());
 	
-	offScreenRenderTarget = cubeTexture->getBuffer()->getRenderTarget();
+	// Cleanup cube texture, face by face
+	for (int face = 0; face < 6; face++) {
+		offScreenRenderTarget = cubeTexture->getBuffer(face)->getRenderTarget();
+		offScreenRenderTarget->removeAllViewports();
+		Root::getSingletonPtr()->getRenderSystem()->destroyRenderTarget(offScreenRenderTarget->getName());
+	}
 	
-	// Cleanup cube texture
-	offScreenRenderTarget->removeAllViewports();
-	Root::getSingletonPtr()->getRenderSystem()->destroyRenderTarget(offScreenRenderTarget->getName());
-	Root::getSingletonPtr()->getRenderSystem()->destroyRenderTexture(cubeTexture->getName());
-		
-	delete offScreenCamera;
+	// No render texture is named after the cube texture, it goes back to the texture manager
+	TextureManager::getSingleton().remove(cubeTexture->getName());
+	
+	destroyCameras();
+	
+}
+
+
+void Renderer::destroyCameras()
+{
+	// the SceneManager keeps the cameras it created until they are destroyed through it
+	for (int face = 0; face < 6; face++)
+		sceneManager->destroyCamera(cubeCameras[face]);
 	
+	sceneManager->destroyCamera(offScreenCamera);
+	sceneManager->destroySceneNode("CEL_offScreenCameraNode");
 }
 
 
@@ -191,43 +415,112 @@ void Renderer::setVisible( SceneNode* sceneNode, uint32 nodeFlag)
 
 PixelSet* Renderer::Render(Ogre::String sceneNode, RenderingMode mode)
 {
-	SceneNode* node = sceneManager->getSceneNode(sceneNode);
-	return Render( node, this->renderingCamera, mode);
+	return Render( std::vector<SceneNode*>(1, sceneManager->getSceneNode(sceneNode)), mode );
 }
 
 
-PixelSet* Renderer::Render(SceneNode* sceneNode, Camera* camera, RenderingMode mode)
+PixelSet* Renderer::Render(const std::vector<Ogre::String>& sceneNodes, RenderingMode mode)
 {
+	std::vector<SceneNode*> nodes;
+	ResolveNodes( sceneNodes, nodes );
+	
+	return Render( nodes, mode );
+}
 
-	RenderTarget* offScreenRenderTarget = imageTexture->getBuffer()->getRenderTarget();
-	Viewport* offScreenViewport = offScreenRenderTarget->getViewport(0);
+
+PixelSet* Renderer::Render(const std::vector<SceneNode*>& sceneNodes, RenderingMode mode)
+{
+	// The node may have been rendered already with the other targets of the evaluation
+	if (sceneNodes.size() == 1 && mode == NODE) {
+		
+		SceneNode* node = sceneNodes[0];
+		
+		std::map<SceneNode*, PixelSet*>::iterator it = renderedTargets.find(node);
+		if (it != renderedTargets.end())
+			return it->second->Share();
+		
+		// or be on its way, in which case it is kept for the following evaluators
+		std::map<SceneNode*, RenderHandle>::iterator issued = issuedTargets.find(node);
+		if (issued != issuedTargets.end()) {
+			
+			PixelSet* result = Resolve(issued->second);
+			issuedTargets.erase(issued);
+			issueTargets();
+			
+			if (result) {
+				cache.insert(renderKey(sceneNodes, this->renderingCamera, NODE, false), result);
+				
+				renderedTargets[node] = result;
+				return result->Share();
+			}
+		}
+		
+		// it is needed before its turn came, no point in rendering it asynchronously
+		std::deque<SceneNode*>::iterator queued = std::find(queuedTargets.begin(), queuedTargets.end(), node);
+		if (queued != queuedTargets.end())
+			queuedTargets.erase(queued);
+	}
 	
-	//Viewport* defaultViewport = camera->getViewport();
-	//defaultVisibilityMask = defaultViewport->getVisibilityMask();
+	return Render( sceneNodes, this->renderingCamera, mode );
+}
 
-	// We allocate memory for the image where the rendering will be stored
-	PixelFormat pf = imageTexture->getFormat();
+
+PixelSet* Renderer::Render(SceneNode* sceneNode, Camera* camera, RenderingMode mode)
+{
+	return Render( std::vector<SceneNode*>(1, sceneNode), camera, mode );
+}
+
+
+PixelSet* Renderer::Render(const std::vector<SceneNode*>& sceneNodes, Camera* camera, RenderingMode mode)
+{
+	// The same render may have been done already, with nothing changed since
+	String key = renderKey(sceneNodes, camera, mode, false);
 	
-	uchar *data = OGRE_ALLOC_T(
-		uchar, 
-		imageTexture->getWidth() * imageTexture->getHeight() * imageTexture->getDepth() * PixelUtil::getNumElemBytes(pf), 
-		MEMCATEGORY_GENERAL
-	);
+	if (PixelSet* cached = cache.find(key))
+		return cached;
 	
-	memset(data, 0, imageTexture->getWidth() * imageTexture->getHeight() * imageTexture->getDepth() * PixelUtil::getNumElemBytes(pf));
+	// Set the parameters of offScreenCamera 
+	setOffScreenCamera(camera);
+	
+	// Nodes that can't show in the viewport give an empty PixelSet without rendering
+	PixelWindow bounds = renderBounds(sceneNodes, mode);
+	
+	if (bounds.isEmpty()) {
+		skippedRenders++;
 		
-	Image* renderedImage = new Image();
-	renderedImage->loadDynamicImage(
-		data, 
-		imageTexture->getWidth(), 
-		imageTexture->getHeight(), 
-		imageTexture->getDepth(), 
-		pf, 
-		true, 
-		1, 
-		0
-	);
+		PixelSet* result = PixelSet::Empty( m_viewportWidth, m_viewportHeight, PF_L16, renderName(sceneNodes, mode) );
+		cache.insert(key, result);
+		
+		return result;
+	}
+	
+	renderCount++;
+	
+	if (rasterizer) {
+		
+		// Only the bounds are rasterized, into an image of the viewport cut down to their size
+		Image* renderedImage = PixelSetPool::get().acquire(m_viewportWidth, m_viewportHeight, PF_L16, 1, false);
+		PixelSetPool::get().shrink(renderedImage, bounds.maxX - bounds.minX + 1, bounds.maxY - bounds.minY + 1);
+		
+		// The same visibility flags select the objects the rasterizer draws
+		uint32 visibilityMask;
+		String PSName = showNodes(sceneNodes, mode, visibilityMask);
+		
+		rasterizer->render(sceneManager, offScreenCamera, visibilityMask, m_viewportWidth, m_viewportHeight, bounds, renderedImage);
+		
+		resetNodes(sceneNodes);
+		
+		PixelSet* result = new PixelSet( renderedImage, PSName, m_viewportWidth, m_viewportHeight, bounds.minX, bounds.minY );
+		cache.insert(key, result);
+		
+		return result;
+	}
+
+	RenderTarget* offScreenRenderTarget = imageTexture->getBuffer()->getRenderTarget();
+	Viewport* offScreenViewport = offScreenRenderTarget->getViewport(0);
 	
+	//Viewport* defaultViewport = camera->getViewport();
+	//defaultVisibilityMask = defaultViewport->getVisibilityMask();
 	
 	/*	We use Ogre Visibility Mask to control what we want to render. 
 		This approach has some drawbacks:
@@ -241,254 +534,938 @@ PixelSet* Renderer::Render(SceneNode* sceneNode, Camera* camera, RenderingMode m
 		less state changes.
 	 */
 	
-	/*	Set visibility masks for sceneNode and viewport:
-		
-			-	if mode == NODE, just set the node visibility flags to 1, 
-				and the viewport visibility mask to 1
-			-	if mode == ALL, do nothing
-			-	if mode == ALL_BUT_NODE, just set the node visibility flags to 1, 
-				and keep the previous viewport visibility mask
-	*/
+	uint32 visibilityMask;
+	String PSName = showNodes(sceneNodes, mode, visibilityMask);
+	offScreenViewport->setVisibilityMask(visibilityMask);
 	
-	String PSName = "R";
-
-	switch (mode) {
-	case NODE: 
-		
-		offScreenViewport->setVisibilityMask(0x0000000F);
-		
-		setAuxiliariesInvisible(offScreenViewport);
+	/* We render the scene to the off-screen RenderTarget */	
+	beginScissor(bounds);
+	offScreenRenderTarget->update(true);
+	endScissor();
+	
+	resetNodes(sceneNodes, offScreenViewport);
 		
-		setVisible( sceneNode, 0x0000000F);
+	#ifdef PRINT_SHOTS
+	offScreenRenderTarget->writeContentsToFile("render.png");
+	#endif
 		
+	/* we create a PixelSet from the part of the rendering the nodes can cover, cache it and return it */
+	PixelSet* result = readWindow(imageTexture, bounds, PSName);
+	cache.insert(key, result);
+	
+	return result;
+}
 
-		PSName = PSName + "(" + sceneNode->getName() + ")";
-		break;
-				
-	case ALL:
+
+int Renderer::Count(const std::vector<Ogre::String>& sceneNodes, RenderingMode mode)
+{
+	std::vector<SceneNode*> nodes;
+	ResolveNodes( sceneNodes, nodes );
+	
+	return Count( nodes, mode );
+}
+
+
+int Renderer::Count(const std::vector<SceneNode*>& sceneNodes, RenderingMode mode)
+{
+	// A target rendered ahead is counted already, one on its way has to be read back anyway
+	if (sceneNodes.size() == 1 && mode == NODE) {
 		
-		setAuxiliariesInvisible(offScreenViewport);
-		PSName = PSName + "(scene)";
-		break;
+		std::map<SceneNode*, PixelSet*>::iterator it = renderedTargets.find(sceneNodes[0]);
+		if (it != renderedTargets.end())
+			return it->second->Count();
 		
-	case ALL_BUT_NODE:
+		if (issuedTargets.find(sceneNodes[0]) != issuedTargets.end()) {
+			PixelSet* pixelSet = Render(sceneNodes, mode);
+			int count = pixelSet->Count();
+			pixelSet->Release();
+			return count;
+		}
+	}
+	
+	return Count( sceneNodes, this->renderingCamera, mode );
+}
 
-		if (!isAnAuxiliary(sceneNode))
-			setAuxiliariesInvisible(offScreenViewport);
-			
-		setVisible( sceneNode, 0x0000000F);
-		
-		PSName = PSName + "(scene-" + sceneNode->getName() + ")";
-		break;
+
+int Renderer::Count(const std::vector<SceneNode*>& sceneNodes, Camera* camera, RenderingMode mode)
+{
+	// Without queries, or with the PixelSet at hand, the PixelSet is counted
+	if (!countQuery || cache.contains(renderKey(sceneNodes, camera, mode, false))) {
+		PixelSet* pixelSet = Render(sceneNodes, camera, mode);
+		int count = pixelSet->Count();
+		pixelSet->Release();
+		return count;
 	}
 	
-	// Set the parameters of offScreenCamera 
+	setOffScreenCamera(camera);
 	
-	offScreenCamera->setPosition(camera->getDerivedPosition());
-	offScreenCamera->setOrientation(camera->getDerivedOrientation());
-	offScreenCamera->setAspectRatio(camera->getAspectRatio());
-	offScreenCamera->setFOVy( camera->getFOVy());
-	offScreenCamera->setNearClipDistance(camera->getNearClipDistance());
-	offScreenCamera->setFarClipDistance(camera->getFarClipDistance());
-	offScreenCamera->setProjectionType(PT_PERSPECTIVE);
+	PixelWindow bounds = renderBounds(sceneNodes, mode);
 	
-	/* We render the scene to the off-screen RenderTarget */	
+	if (bounds.isEmpty()) {
+		skippedRenders++;
+		return 0;
+	}
+	
+	renderCount++;
+	
+	RenderTarget* offScreenRenderTarget = imageTexture->getBuffer()->getRenderTarget();
+	Viewport* offScreenViewport = offScreenRenderTarget->getViewport(0);
+	
+	uint32 visibilityMask;
+	showNodes(sceneNodes, mode, visibilityMask);
+	offScreenViewport->setVisibilityMask(visibilityMask);
+	
+	// The quad is drawn last, in the query, and only passes the depth test where the depth 
+	// buffer isn't cleared anymore: each rendered pixel counts once, however many objects cover it
+	countQuad->setVisibilityFlags(visibilityMask);
+	countQuad->setVisible(true);
+	counting = true;
+	countIssued = false;
+	
+	beginScissor(bounds);
 	offScreenRenderTarget->update(true);
+	endScissor();
 	
-	/* We re-set SceneNode to be visible (using the default flags) */
-	setVisible( sceneNode, 0xFFFFFFF0 );
+	counting = false;
+	countQuad->setVisible(false);
 	
-	/* We re-set the offScreenViewport mask (using the default mask) */
-	offScreenViewport->setVisibilityMask(0xFFFFFFF0);
+	resetNodes(sceneNodes, offScreenViewport);
 	
-	offScreenRenderTarget->copyContentsToMemory(renderedImage->getPixelBox());
-		
-	#ifdef PRINT_SHOTS
-	offScreenRenderTarget->writeContentsToFile("render.png");
-	#endif
-		
-	/* we create a PixelSet from the obtained image and return it */
-	return new PixelSet( renderedImage, PSName );
+	// The only wait for the GPU, no pixel is transferred
+	unsigned int samples = 0;
+	if (countIssued)
+		countQuery->pullOcclusionQuery(&samples);
+	
+	return (int)samples;
 }
 
 
-PixelSet* Renderer::CubeRender(Ogre::String sceneNode, RenderingMode mode)
+bool Renderer::RenderInto(const std::vector<Ogre::String>& sceneNodes, RenderingMode mode, RenderTarget* target)
 {
+	std::vector<SceneNode*> nodes;
+	ResolveNodes( sceneNodes, nodes );
 	
-	SceneNode* node = sceneManager->getSceneNode(sceneNode);
-	return CubeRender( node, this->renderingCamera, mode);
-	
+	return RenderInto( nodes, mode, target );
 }
 
 
-PixelSet* Renderer::CubeRender(SceneNode* sceneNode, Camera* camera, RenderingMode mode)
+bool Renderer::RenderInto(const std::vector<SceneNode*>& nodes, RenderingMode mode, RenderTarget* target)
 {
-
-	// Pointers
-	RenderTarget* offScreenRenderTarget = cubeTexture->getBuffer()->getRenderTarget();
-	Viewport* offScreenViewport = offScreenRenderTarget->getViewport(0);
+	setOffScreenCamera(this->renderingCamera);
 	
-	//Viewport* defaultViewport = camera->getViewport();
-	//defaultVisibilityMask = defaultViewport->getVisibilityMask();
-
-	// We allocate memory for the image where the rendering will be stored
-	PixelFormat pf = cubeTexture->getFormat();
+	Viewport* viewport = target->getViewport(0);
+	PixelWindow bounds = renderBounds(nodes, mode);
 	
-	uchar *data = OGRE_ALLOC_T(
-		uchar, 
-		cubeTexture->getWidth() * cubeTexture->getHeight() * PixelUtil::getNumElemBytes(pf) * 6, 
-		MEMCATEGORY_GENERAL
-	);
+	if (bounds.isEmpty()) {
+		skippedRenders++;
+		viewport->clear(FBT_COLOUR | FBT_DEPTH, viewport->getBackgroundColour());
+		return false;
+	}
 	
-	memset(data, 0, cubeTexture->getWidth() * cubeTexture->getHeight() * PixelUtil::getNumElemBytes(pf) * 6);
-
-		
-	Image* renderedImage = new Image();
-	renderedImage->loadDynamicImage(
-		data,
-		cubeTexture->getWidth(), 
-		cubeTexture->getHeight(),
-		cubeTexture->getDepth(),
-		pf,
-		true,
-		6,
-		0
-	);
+	renderCount++;
 	
-	/*	We use Ogre Visibility Mask to control what we want to render. 
-		This approach has some drawbacks:
-		
-			-	it could interfere with scenes that use visibility masks for some purpose. 
-			-	we are using original materials and lighting settings, therefore rendering 
-				could be expensive
+	uint32 visibilityMask;
+	showNodes(nodes, mode, visibilityMask);
+	viewport->setVisibilityMask(visibilityMask);
 	
-		The advantage, compared to using specific materials, is that we 
-		don't need to create specific materials and we should perform far 
-		less state changes.
-	 */
+	beginScissor(bounds);
+	target->update(true);
+	endScissor();
+	
+	resetNodes(nodes, viewport);
 	
-	/*	Set visibility masks for sceneNode and viewport:
+	return true;
+}
+
+
+void Renderer::createCountQuad()
+{
+	// Passes where the scene is nearer than the far plane, writing nothing
+	MaterialPtr material = MaterialManager::getSingleton().create("CEL/Count", "Default");
+	
+	Technique* technique = material->getTechnique(0);
+	technique->setSchemeName("CEL_Depth_Scheme");
+	
+	Pass* pass = technique->getPass(0);
+	pass->setLightingEnabled(false);
+	pass->setColourWriteEnabled(false);
+	pass->setDepthWriteEnabled(false);
+	pass->setDepthCheckEnabled(true);
+	pass->setDepthFunction(CMPF_GREATER);
+	pass->setCullingMode(CULL_NONE);
+	pass->setManualCullingMode(MANUAL_CULL_NONE);
+	
+	// Covers the viewport at the far plane, whatever the camera, after all the other queues
+	countQuad = sceneManager->createManualObject("CEL_CountQuad");
+	countQuad->setUseIdentityProjection(true);
+	countQuad->setUseIdentityView(true);
+	
+	countQuad->begin("CEL/Count", RenderOperation::OT_TRIANGLE_LIST);
+	countQuad->position(-1, -1, 1);
+	countQuad->position( 1, -1, 1);
+	countQuad->position( 1,  1, 1);
+	countQuad->position(-1,  1, 1);
+	countQuad->quad(0, 1, 2, 3);
+	countQuad->end();
+	
+	AxisAlignedBox infinite;
+	infinite.setInfinite();
+	countQuad->setBoundingBox(infinite);
+	
+	countQuad->setRenderQueueGroup(RENDER_QUEUE_MAX);
+	countQuad->setCastShadows(false);
+	countQuad->setVisible(false);
+	
+	sceneManager->getRootSceneNode()->attachObject(countQuad);
+}
+
+
+String Renderer::showNodes(const std::vector<SceneNode*>& sceneNodes, RenderingMode mode, uint32& visibilityMask, const String& prefix)
+{
+	/*	Set visibility masks for the scene nodes and viewport:
 		
-			-	if mode == NODE, just set the node visibility flags to 1, 
+			-	if mode == NODE, just set the nodes visibility flags to 1, 
 				and the viewport visibility mask to 1
 			-	if mode == ALL, do nothing
-			-	if mode == ALL_BUT_NODE, just set the node visibility flags to 1, 
+			-	if mode == ALL_BUT_NODE, just set the nodes visibility flags to 1, 
 				and keep the previous viewport visibility mask
 	*/
 	
-	String PSName = "CR";
+	visibilityMask = 0xFFFFFFF0;
 
 	switch (mode) {
 	case NODE: 
 		
-		offScreenViewport->setVisibilityMask(0x0000000F);
+		visibilityMask = 0x0000000F;
 		
-		setAuxiliariesInvisible(offScreenViewport);
+		setAuxiliariesInvisible(visibilityMask);
 		
-		setVisible( sceneNode, 0x0000000F);
+		for (size_t i = 0; i < sceneNodes.size(); i++)
+			setVisible( sceneNodes[i], 0x0000000F);
 		
-
-		PSName = PSName + "(" + sceneNode->getName() + ")";
 		break;
 				
 	case ALL:
 		
-		setAuxiliariesInvisible(offScreenViewport);
-		PSName = PSName + "(scene)";
+		setAuxiliariesInvisible(visibilityMask);
 		break;
 		
 	case ALL_BUT_NODE:
 
-		if (!isAnAuxiliary(sceneNode))
-			setAuxiliariesInvisible(offScreenViewport);
+		{
+			bool auxiliary = false;
+			for (size_t i = 0; i < sceneNodes.size(); i++)
+				auxiliary = auxiliary || isAnAuxiliary(sceneNodes[i]);
 			
-		setVisible( sceneNode, 0x0000000F);
+			if (!auxiliary)
+				setAuxiliariesInvisible(visibilityMask);
+		}
+		
+		for (size_t i = 0; i < sceneNodes.size(); i++)
+			setVisible( sceneNodes[i], 0x0000000F);
 		
-		PSName = PSName + "(scene-" + sceneNode->getName() + ")";
 		break;
 	}
 	
-	// Set the parameters of offScreenCamera 
-	offScreenCamera->setPosition(camera->getDerivedPosition());
-	offScreenCamera->setOrientation(camera->getDerivedOrientation());
-	offScreenCamera->setFarClipDistance(camera->getFarClipDistance());
-	offScreenCamera->setNearClipDistance(0.00001);	
-	offScreenCamera->setAspectRatio(1.0);
-	offScreenCamera->setFOVy(Degree(90)); 
-	offScreenCamera->setProjectionType(PT_PERSPECTIVE);
-	
-	// Right   Left    Up      Down    Back    Front
-	// +X (0), -X (1), +Y (2), -Y (3), +Z (4), -Z (5) 
+	return renderName(sceneNodes, mode, prefix);
+}
+
 
-	/* Get quaternion to rotate horizontally */
-	Quaternion rotate = Quaternion(Degree(-90), offScreenCamera->getDerivedUp());
+String Renderer::renderName(const std::vector<SceneNode*>& sceneNodes, RenderingMode mode, const String& prefix)
+{
+	String nodeNames = "";
 	
-	// Front
-	offScreenRenderTarget->update(true);
-	offScreenRenderTarget->copyContentsToMemory(renderedImage->getPixelBox(5, 0));
+	for (size_t i = 0; i < sceneNodes.size(); i++)
+		nodeNames = nodeNames + ((i > 0) ? "," : "") + sceneNodes[i]->getName();
 	
-	#ifdef PRINT_SHOTS
-	offScreenRenderTarget->writeContentsToFile("cube_front.png");
-	#endif
+	switch (mode) {
+	case NODE:
+		return prefix + "(" + nodeNames + ")";
+	case ALL:
+		return prefix + "(scene)";
+	default:
+		return prefix + "(scene-" + nodeNames + ")";
+	}
+}
+
+
+void Renderer::resetNodes(const std::vector<SceneNode*>& sceneNodes, Viewport* offScreenViewport)
+{
+	/* We re-set SceneNodes to be visible (using the default flags) */
+	for (size_t i = 0; i < sceneNodes.size(); i++)
+		setVisible( sceneNodes[i], 0xFFFFFFF0 );
 	
-	// Right
-	offScreenCamera->setOrientation(rotate * offScreenCamera->getOrientation());
-	offScreenRenderTarget->update(true);
-	offScreenRenderTarget->copyContentsToMemory(renderedImage->getPixelBox(0, 0));
+	/* We re-set the offScreenViewport mask (using the default mask) */
+	if (offScreenViewport)
+		offScreenViewport->setVisibilityMask(0xFFFFFFF0);
+}
+
+
+void Renderer::RenderTargets(const std::vector<Ogre::String>& targets)
+{
+	std::vector<SceneNode*> nodes;
+	ResolveNodes( targets, nodes );
 	
-	#ifdef PRINT_SHOTS
-	offScreenRenderTarget->writeContentsToFile("cube_right.png");
-	#endif
+	RenderTargets( nodes );
+}
+
+
+void Renderer::RenderTargets(const std::vector<SceneNode*>& targets)
+{
+	ClearTargets();
 	
-	// Back
-	offScreenCamera->setOrientation(rotate * offScreenCamera->getOrientation());
-	offScreenRenderTarget->update(true);
-	offScreenRenderTarget->copyContentsToMemory(renderedImage->getPixelBox(4, 0));
+	// The renders of the whole scene key it by a hash taken once, until ClearTargets()
+	sceneFrozen = true;
+	
+	// Without object ids, Render() rasterizes each target when it's needed
+	if (rasterizer)
+		return;
+	
+	// The targets in the cache are served by Render() already, and so are the ones out of the view
+	std::vector<SceneNode*> nodes;
+	std::vector<String> keys;
+	
+	setOffScreenCamera(this->renderingCamera);
+	
+	for (size_t i = 0; i < targets.size(); i++) {
+		
+		SceneNode* node = targets[i];
+		String key = renderKey(std::vector<SceneNode*>(1, node), this->renderingCamera, NODE, false);
+		
+		if (cache.contains(key) || renderBounds(std::vector<SceneNode*>(1, node), NODE).isEmpty())
+			continue;
+		
+		nodes.push_back( node );
+		keys.push_back( key );
+	}
+	
+	if (nodes.size() < 2)
+		return;
+	
+	Viewport* idViewport = idRenderTarget->getViewport(0);
+	
+	// All the targets are rendered as in NODE mode, each one with its own id
+	idViewport->setVisibilityMask(0x0000000F);
+	setAuxiliariesInvisible(0x0000000F);
+	
+	for (size_t i = 0; i < nodes.size(); i++) {
+		setVisible( nodes[i], 0x0000000F );
+		setObjectId( nodes[i], i + 1 );
+	}
+	
+	idRenderTarget->update(true);
+	
+	for (size_t i = 0; i < nodes.size(); i++) {
+		setVisible( nodes[i], 0xFFFFFFF0 );
+		setObjectId( nodes[i], 0 );
+	}
+	
+	idViewport->setVisibilityMask(0xFFFFFFF0);
+	
+	// Read back depth and ids
+	int width = imageTexture->getWidth(), height = imageTexture->getHeight();
+	PixelFormat depthFormat = imageTexture->getFormat();
+	
+	Image* depth = PixelSetPool::get().acquire(width, height, depthFormat, 1, false);
+	Image* ids = PixelSetPool::get().acquire(width, height, idTexture->getFormat(), 1, false);
+	
+	imageTexture->getBuffer()->blitToMemory(depth->getPixelBox());
+	idTexture->getBuffer()->blitToMemory(ids->getPixelBox());
+	
+	// Formats the rows can't be read typed in are converted once, as PixelSet does
+	if (depthFormat != PF_L16 && depthFormat != PF_FLOAT32_R) {
+		
+		Image* convertedDepth = PixelSetPool::get().acquire(width, height, PF_FLOAT32_R, 1, false);
+		Image* convertedIds = PixelSetPool::get().acquire(width, height, PF_FLOAT32_R, 1, false);
+		
+		PixelUtil::bulkPixelConversion(depth->getPixelBox(), convertedDepth->getPixelBox());
+		PixelUtil::bulkPixelConversion(ids->getPixelBox(), convertedIds->getPixelBox());
+		
+		PixelSetPool::get().release(depth);
+		PixelSetPool::get().release(ids);
+		
+		depth = convertedDepth;
+		ids = convertedIds;
+		depthFormat = PF_FLOAT32_R;
+	}
+	
+	// A target is split out of the frame only if no other target can hide part of it,
+	// i.e. its screen rectangle doesn't meet the rectangle of any other target
+	std::vector<PixelWindow> bounds;
+	for (size_t i = 0; i < nodes.size(); i++)
+		bounds.push_back( screenBounds(nodes[i], offScreenCamera) );
+	
+	std::vector<Image*> images(nodes.size(), (Image*)0);
+	
+	for (size_t i = 0; i < nodes.size(); i++) {
+		
+		bool alone = true;
+		for (size_t j = 0; j < nodes.size() && alone; j++)
+			if (j != i && !bounds[i].intersect(bounds[j]).isEmpty())
+				alone = false;
+		
+		if (alone)
+			images[i] = PixelSetPool::get().acquire(width, height, depthFormat, 1);
+	}
+	
+	// Each pixel goes to the image of the target whose id it holds
+	std::vector<PixelBox> boxes(nodes.size(), PixelBox(0, 0, 0, depthFormat));
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (images[i])
+			boxes[i] = images[i]->getPixelBox();
+	
+	if (depthFormat == PF_L16)
+		splitTargets<uint16>(depth->getPixelBox(), ids->getPixelBox(), boxes);
+	else
+		splitTargets<float>(depth->getPixelBox(), ids->getPixelBox(), boxes);
+	
+	PixelSetPool::get().release(depth);
+	PixelSetPool::get().release(ids);
+	
+	// The other targets are rendered on their own, asynchronously, in the order they are given
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (images[i]) {
+			renderedTargets[nodes[i]] = new PixelSet( images[i], "R(" + nodes[i]->getName() + ")" );
+			cache.insert(keys[i], renderedTargets[nodes[i]]);
+		} else
+			queuedTargets.push_back( nodes[i] );
+	
+	issueTargets();
+}
 
-	#ifdef PRINT_SHOTS
-	offScreenRenderTarget->writeContentsToFile("cube_back.png");
-	#endif
+
+void Renderer::ClearTargets()
+{
+	sceneFrozen = sceneHashed = false;
 	
-	// Left
-	offScreenCamera->setOrientation(rotate * offScreenCamera->getOrientation());
-	offScreenRenderTarget->update(true);
-	offScreenRenderTarget->copyContentsToMemory(renderedImage->getPixelBox(1, 0));
+	std::map<SceneNode*, PixelSet*>::iterator it;
+	for (it = renderedTargets.begin(); it != renderedTargets.end(); ++it)
+		it->second->Release();
 	
-	#ifdef PRINT_SHOTS
-	offScreenRenderTarget->writeContentsToFile("cube_left.png");
-	#endif
+	renderedTargets.clear();
 	
-	// Front again
-	offScreenCamera->setOrientation(rotate * offScreenCamera->getOrientation());
+	// Renderings still on their way are read back and dropped
+	std::map<SceneNode*, RenderHandle>::iterator issued;
+	for (issued = issuedTargets.begin(); issued != issuedTargets.end(); ++issued)
+		if (PixelSet* dropped = Resolve(issued->second))
+			dropped->Release();
 	
-	// Up
-	Quaternion look_up = Quaternion(Degree(90), offScreenCamera->getDerivedRight());
-	offScreenCamera->setOrientation(look_up * offScreenCamera->getOrientation());
-	offScreenRenderTarget->update(true);
-	offScreenRenderTarget->copyContentsToMemory(renderedImage->getPixelBox(2, 0));
+	issuedTargets.clear();
+	queuedTargets.clear();
 	
-	#ifdef PRINT_SHOTS
-	offScreenRenderTarget->writeContentsToFile("cube_up.png");
-	#endif
+	// the renders cached during the evaluation may not show the scene of the next one
+	if (!persistentCache)
+		cache.clear();
+}
+
+
+void Renderer::issueTargets()
+{
+	while (!queuedTargets.empty() && (int)issuedTargets.size() < asyncDepth) {
+		
+		SceneNode* node = queuedTargets.front();
+		queuedTargets.pop_front();
+		
+		issuedTargets[node] = RenderAsync( std::vector<SceneNode*>(1, node), this->renderingCamera, NODE );
+	}
+}
+
+
+void Renderer::ResolveNodes(const std::vector<Ogre::String>& names, std::vector<SceneNode*>& sceneNodes)
+{
+	sceneNodes.clear();
 	
-	// Down
-	Quaternion look_down = Quaternion(Degree(-180), offScreenCamera->getDerivedRight());
-	offScreenCamera->setOrientation(look_down * offScreenCamera->getOrientation());
-	offScreenRenderTarget->update(true);
-	offScreenRenderTarget->copyContentsToMemory(renderedImage->getPixelBox(3, 0));
+	for (size_t i = 0; i < names.size(); i++)
+		sceneNodes.push_back( ResolveNode(names[i]) );
+}
+
+
+SceneNode* Renderer::ResolveNode(const Ogre::String& name)
+{
+	SceneNode* node = sceneManager->getSceneNode(name);
+	
+	if (!node->getListener()) {
+		node->setListener(this);
+		watchedNodes.insert(node);
+	}
+	
+	return node;
+}
+
+
+void Renderer::nodeDestroyed(const Node* node)
+{
+	watchedNodes.erase( const_cast<Node*>(node) );
+	bindingVersion++;
+}
+
+
+RenderHandle Renderer::RenderAsync(const std::vector<SceneNode*>& sceneNodes, Camera* camera, RenderingMode mode)
+{
+	RenderHandle handle = nextHandle++;
+	
+	// The rasterizer has nothing to overlap with, the rendering is done now and kept until resolved
+	if (rasterizer) {
+		earlyRenders[handle] = Render(sceneNodes, camera, mode);
+		return handle;
+	}
+	
+	setOffScreenCamera(camera);
+	
+	PixelWindow bounds = renderBounds(sceneNodes, mode);
+	
+	if (bounds.isEmpty()) {
+		skippedRenders++;
+		earlyRenders[handle] = PixelSet::Empty( m_viewportWidth, m_viewportHeight, PF_L16, renderName(sceneNodes, mode) );
+		return handle;
+	}
+	
+	renderCount++;
+	
+	int slot = handle % asyncDepth;
+	
+	// The texture still holds a rendering nobody asked for yet: read it back before it's overwritten
+	if (asyncHandles[slot] >= 0)
+		earlyRenders[asyncHandles[slot]] = readBack(slot);
+	
+	RenderTarget* asyncRenderTarget = asyncTextures[slot]->getBuffer()->getRenderTarget();
+	Viewport* asyncViewport = asyncRenderTarget->getViewport(0);
+	
+	uint32 visibilityMask;
+	asyncNames[slot] = showNodes(sceneNodes, mode, visibilityMask);
+	asyncBounds[slot] = bounds;
+	asyncViewport->setVisibilityMask(visibilityMask);
+	asyncHandles[slot] = handle;
+	
+	// This only queues the rendering commands, nothing waits for the GPU until readBack()
+	beginScissor(bounds);
+	asyncRenderTarget->update(true);
+	endScissor();
+	
+	resetNodes(sceneNodes, asyncViewport);
+	
+	return handle;
+}
+
+
+PixelSet* Renderer::Resolve(RenderHandle handle)
+{
+	std::map<RenderHandle, PixelSet*>::iterator early = earlyRenders.find(handle);
+	if (early != earlyRenders.end()) {
+		PixelSet* result = early->second;
+		earlyRenders.erase(early);
+		return result;
+	}
+	
+	if (handle < 0 || asyncHandles[handle % asyncDepth] != handle)
+		return NULL;
+	
+	int slot = handle % asyncDepth;
+	PixelSet* result = readBack(slot);
+	asyncHandles[slot] = -1;
+	
+	return result;
+}
+
+
+PixelSet* Renderer::readBack(int slot)
+{
+	return readWindow(asyncTextures[slot], asyncBounds[slot], asyncNames[slot]);
+}
+
+
+PixelSet* Renderer::readWindow(TexturePtr texture, const PixelWindow& window, const String& name)
+{
+	// Depth in a format the pixel sets can't read as is is converted to float by the transfer
+	PixelFormat format = texture->getFormat();
+	if (format != PF_L16 && format != PF_FLOAT32_R)
+		format = PF_FLOAT32_R;
+	
+	// The image is recycled from the pool at the size of the texture, then cut down to the 
+	// window, which overwrites all of it
+	Image* renderedImage = PixelSetPool::get().acquire(texture->getWidth(), texture->getHeight(), format, 1, false);
+	PixelSetPool::get().shrink(renderedImage, window.maxX - window.minX + 1, window.maxY - window.minY + 1);
+	
+	// Pixels out of the window were scissored away, no need to transfer and scan them
+	Box box(window.minX, window.minY, window.maxX + 1, window.maxY + 1);
+	texture->getBuffer()->blitToMemory(box, renderedImage->getPixelBox());
+	
+	return new PixelSet( renderedImage, name, texture->getWidth(), texture->getHeight(), window.minX, window.minY );
+}
+
+
+void Renderer::setOffScreenCamera(Camera* camera)
+{
+	offScreenCamera->setPosition(camera->getDerivedPosition());
+	offScreenCamera->setOrientation(camera->getDerivedOrientation());
+	offScreenCamera->setAspectRatio(camera->getAspectRatio());
+	offScreenCamera->setFOVy( camera->getFOVy());
+	offScreenCamera->setNearClipDistance(camera->getNearClipDistance());
+	offScreenCamera->setFarClipDistance(camera->getFarClipDistance());
+	offScreenCamera->setProjectionType(PT_PERSPECTIVE);
+}
+
 
+String Renderer::renderKey(const std::vector<SceneNode*>& sceneNodes, Camera* camera, RenderingMode mode, bool cube)
+{
+	String key = (cube ? "CR" : "R") + StringConverter::toString((int)mode);
+	
+	for (size_t i = 0; i < sceneNodes.size(); i++) {
+		key += ",";
+		key += sceneNodes[i]->getName();
+	}
+	
+	// The camera, as setOffScreenCamera() sets it
+	Vector3 position = camera->getDerivedPosition();
+	Quaternion orientation = camera->getDerivedOrientation();
+	
+	Real view[] = { 
+		position.x, position.y, position.z, 
+		orientation.w, orientation.x, orientation.y, orientation.z,
+		camera->getFOVy().valueRadians(), camera->getAspectRatio(), 
+		camera->getNearClipDistance(), camera->getFarClipDistance()
+	};
+	key.append(reinterpret_cast<const char*>(view), sizeof(view));
+	
+	// The scene: in NODE mode, only the rendered nodes show
+	uint64 hash = ((uint64)0xcbf29ce4 << 32) | 0x84222325;
+	
+	if (mode == NODE) {
+		for (size_t i = 0; i < sceneNodes.size(); i++)
+			hashNode(sceneNodes[i], hash);
+	} else {
+		// the whole scene is walked once while it is frozen, see RenderTargets()
+		if (!sceneHashed) {
+			sceneHash = hash;
+			hashNode(sceneManager->getRootSceneNode(), sceneHash);
+			sceneHashed = sceneFrozen;
+		}
+		hash = sceneHash;
+	}
+	
+	key.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+	key.append(reinterpret_cast<const char*>(&sceneVersion), sizeof(sceneVersion));
+	
+	return key;
+}
+
+
+void Renderer::hashNode(SceneNode* sceneNode, uint64& hash)
+{
+	const Vector3& position = sceneNode->_getDerivedPosition();
+	const Quaternion& orientation = sceneNode->_getDerivedOrientation();
+	const Vector3& scale = sceneNode->_getDerivedScale();
+	
+	Real placement[] = {
+		position.x, position.y, position.z,
+		orientation.w, orientation.x, orientation.y, orientation.z,
+		scale.x, scale.y, scale.z,
+		(Real)sceneNode->numAttachedObjects(), (Real)sceneNode->numChildren()
+	};
+	
+	hashBytes(placement, sizeof(placement), hash);
+	
+	Ogre::SceneNode::ObjectIterator objectIt = sceneNode->getAttachedObjectIterator();
+	while (objectIt.hasMoreElements()) {
+		uchar visible = objectIt.getNext()->isVisible() ? 1 : 0;
+		hashBytes(&visible, 1, hash);
+	}
+	
+	Ogre::SceneNode::ChildNodeIterator childIt = sceneNode->getChildIterator();
+	while (childIt.hasMoreElements())
+	{
+		SceneNode* child = static_cast<SceneNode*>(childIt.getNext());
+		hashNode( child, hash );
+	}
+}
+
+
+void Renderer::setObjectId( SceneNode* sceneNode, uint32 id )
+{
+	Vector4 value((Real)id / CEL_MAX_OBJECT_ID, 0, 0, 0);
+	
+	Ogre::SceneNode::ObjectIterator objectIt = sceneNode->getAttachedObjectIterator();
+	while (objectIt.hasMoreElements())
+	{
+		MovableObject* object = objectIt.getNext();
+		
+		if (object->getMovableType() == "Entity") {
+			Entity* ent = static_cast<Entity*>(object);
+			for (unsigned int i = 0; i < ent->getNumSubEntities(); i++)
+				ent->getSubEntity(i)->setCustomParameter(CEL_OBJECT_ID_PARAMETER, value);
+		} else if (object->getMovableType() == "ManualObject") {
+			ManualObject* manual = static_cast<ManualObject*>(object);
+			for (unsigned int i = 0; i < manual->getNumSections(); i++)
+				manual->getSection(i)->setCustomParameter(CEL_OBJECT_ID_PARAMETER, value);
+		} else if (Renderable* renderable = dynamic_cast<Renderable*>(object)) {
+			renderable->setCustomParameter(CEL_OBJECT_ID_PARAMETER, value);
+		}
+	}
+	
+	Ogre::SceneNode::ChildNodeIterator childIt = sceneNode->getChildIterator();
+	while (childIt.hasMoreElements())
+	{
+		SceneNode* child = static_cast<SceneNode*>(childIt.getNext());
+		setObjectId( child, id );
+	}
+}
+
+
+PixelWindow Renderer::screenBounds( SceneNode* sceneNode, Camera* camera )
+{
+	int width = m_viewportWidth, height = m_viewportHeight;
+	PixelWindow all = { 0, width - 1, 0, height - 1 };
+	PixelWindow none = { 0, -1, 0, -1 };
+	
+	const AxisAlignedBox& box = sceneNode->_getWorldAABB();
+	
+	if (box.isNull())
+		return none;
+	
+	if (box.isInfinite())
+		return all;
+	
+	const Vector3* corners = box.getAllCorners();
+	const Matrix4& view = camera->getViewMatrix();
+	const Matrix4& projection = camera->getProjectionMatrix();
+	
+	Real minX = 1, maxX = -1, minY = 1, maxY = -1;
+	Real farDistance = camera->getFarClipDistance();
+	int beyondFar = 0;
+	
+	for (int i = 0; i < 8; i++) {
+		
+		Vector3 eye = view * corners[i];
+		
+		// Corners behind the near plane can project anywhere
+		if (eye.z > -camera->getNearClipDistance())
+			return all;
+		
+		if (farDistance > 0 && eye.z < -farDistance)
+			beyondFar++;
+		
+		Vector3 ndc = projection * eye;
+		
+		minX = std::min(minX, ndc.x); maxX = std::max(maxX, ndc.x);
+		minY = std::min(minY, ndc.y); maxY = std::max(maxY, ndc.y);
+	}
+	
+	if (beyondFar == 8)
+		return none;
+	
+	// From normalized device coordinates to pixels, y going down, with a pixel of margin
+	PixelWindow bounds = {
+		(int)Math::Floor((minX + 1) * 0.5f * width) - 1,
+		(int)Math::Ceil((maxX + 1) * 0.5f * width) + 1,
+		(int)Math::Floor((1 - maxY) * 0.5f * height) - 1,
+		(int)Math::Ceil((1 - minY) * 0.5f * height) + 1
+	};
+	
+	return bounds.intersect(all);
+}
+
+
+PixelWindow Renderer::renderBounds( const std::vector<SceneNode*>& sceneNodes, RenderingMode mode )
+{
+	PixelWindow bounds = { 0, m_viewportWidth - 1, 0, m_viewportHeight - 1 };
+	
+	// The rest of the scene can be anywhere
+	if (mode != NODE)
+		return bounds;
+	
+	bounds.minX = m_viewportWidth;
+	bounds.maxX = -1;
+	bounds.minY = m_viewportHeight;
+	bounds.maxY = -1;
+	
+	for (size_t i = 0; i < sceneNodes.size(); i++) {
+		
+		// World bounding boxes are only brought up to date by the frames
+		sceneNodes[i]->_update(true, false);
+		
+		PixelWindow node = screenBounds(sceneNodes[i], offScreenCamera);
+		
+		if (node.isEmpty())
+			continue;
+		
+		bounds.minX = std::min(bounds.minX, node.minX);
+		bounds.maxX = std::max(bounds.maxX, node.maxX);
+		bounds.minY = std::min(bounds.minY, node.minY);
+		bounds.maxY = std::max(bounds.maxY, node.maxY);
+	}
+	
+	// Nodes out of the view are still skipped, the others are rendered in the whole viewport
+	if (!windowedReadback && !bounds.isEmpty()) {
+		PixelWindow viewport = { 0, m_viewportWidth - 1, 0, m_viewportHeight - 1 };
+		return viewport;
+	}
+	
+	return bounds;
+}
+
+
+void Renderer::beginScissor( const PixelWindow& window )
+{
+	scissor = window;
+	sceneManager->addRenderQueueListener(this);
+}
+
+
+void Renderer::endScissor()
+{
+	sceneManager->removeRenderQueueListener(this);
+	Root::getSingletonPtr()->getRenderSystem()->setScissorTest(false);
+}
+
+
+void Renderer::renderQueueStarted( uint8 queueGroupId, const String& invocation, bool& skipThisInvocation )
+{
+	// Right and bottom are excluded
+	Root::getSingletonPtr()->getRenderSystem()->setScissorTest(true, scissor.minX, scissor.minY, scissor.maxX + 1, scissor.maxY + 1);
+	
+	if (counting && queueGroupId == RENDER_QUEUE_MAX)
+		countQuery->beginOcclusionQuery();
+}
+
+
+void Renderer::renderQueueEnded( uint8 queueGroupId, const String& invocation, bool& repeatThisInvocation )
+{
+	if (counting && queueGroupId == RENDER_QUEUE_MAX) {
+		countQuery->endOcclusionQuery();
+		countIssued = true;
+	}
+}
+
+
+PixelSet* Renderer::CubeRender(Ogre::String sceneNode, RenderingMode mode)
+{
+	
+	SceneNode* node = sceneManager->getSceneNode(sceneNode);
+	return CubeRender( node, this->renderingCamera, mode);
+	
+}
+
+
+PixelSet* Renderer::CubeRender(SceneNode* sceneNode, Camera* camera, RenderingMode mode)
+{
+	String key = renderKey(std::vector<SceneNode*>(1, sceneNode), camera, mode, true);
+	
+	if (PixelSet* cached = cache.find(key))
+		return cached;
+
+	// We allocate memory for the image where the rendering will be stored
+	PixelFormat pf = rasterizer ? PF_L16 : cubeTexture->getFormat();
+	
+	// The image is recycled from the pool, the six faces overwrite all of it 
+	Image* renderedImage = PixelSetPool::get().acquire(
+		m_cubeWidth, 
+		m_cubeWidth, 
+		pf, 
+		6, 
+		false
+	);
+	
+	/*	We use Ogre Visibility Mask to control what we want to render. 
+		This approach has some drawbacks:
+		
+			-	it could interfere with scenes that use visibility masks for some purpose. 
+			-	we are using original materials and lighting settings, therefore rendering 
+				could be expensive
+	
+		The advantage, compared to using specific materials, is that we 
+		don't need to create specific materials and we should perform far 
+		less state changes.
+	 */
+	
+	std::vector<SceneNode*> sceneNodes(1, sceneNode);
+	uint32 visibilityMask;
+	String PSName = showNodes(sceneNodes, mode, visibilityMask, "CR");
+	
+	if (!rasterizer)
+		for (int face = 0; face < 6; face++)
+			cubeTexture->getBuffer(face)->getRenderTarget()->getViewport(0)->setVisibilityMask(visibilityMask);
+	
+	// Right   Left    Up      Down    Back    Front
+	// +X (0), -X (1), +Y (2), -Y (3), +Z (4), -Z (5) 
+	
+	// The faces are turned horizontally around the up axis of the camera, 
+	// and vertically around its right axis
+	Vector3 position = camera->getDerivedPosition();
+	Quaternion orientation = camera->getDerivedOrientation();
+	Vector3 up = orientation * Vector3::UNIT_Y;
+	Vector3 right = orientation * Vector3::UNIT_X;
+	
+	Quaternion faceOrientations[6] = {
+		Quaternion(Degree(-90), up) * orientation,
+		Quaternion(Degree(90), up) * orientation,
+		Quaternion(Degree(90), right) * orientation,
+		Quaternion(Degree(-90), right) * orientation,
+		Quaternion(Degree(180), up) * orientation,
+		orientation
+	};
+	
 	#ifdef PRINT_SHOTS
-	offScreenRenderTarget->writeContentsToFile("cube_down.png");
+	const char* faceNames[6] = { "right", "left", "up", "down", "back", "front" };
 	#endif
 	
-	/* We re-set SceneNode to be visible (using the default flags) */
-	setVisible( sceneNode, 0xFFFFFFF0 );
+	// In NODE mode, the faces whose frustum misses the node stay empty. 
+	// World bounding boxes are only brought up to date by the frames
+	sceneNode->_update(true, false);
+	const AxisAlignedBox& bounds = sceneNode->_getWorldAABB();
+	bool rendered[6];
 	
-	/* We re-set the offScreenViewport mask (using the default mask) */
-	offScreenViewport->setVisibilityMask(0xFFFFFFF0);
+	for (int face = 0; face < 6; face++) {
+		
+		cubeCameras[face]->setPosition(position);
+		cubeCameras[face]->setOrientation(faceOrientations[face]);
+		cubeCameras[face]->setFarClipDistance(camera->getFarClipDistance());
+		
+		rendered[face] = mode != NODE || bounds.isInfinite() || (!bounds.isNull() && cubeCameras[face]->isVisible(bounds));
+		
+		if (rendered[face] && !rasterizer)
+			cubeTexture->getBuffer(face)->getRenderTarget()->update(true);
+	}
+	
+	if (std::find(rendered, rendered + 6, true) == rendered + 6)
+		skippedRenders++;
+	else
+		renderCount++;
+	
+	// The faces are read back once all of them are rendered
+	for (int face = 0; face < 6; face++) {
+		
+		PixelBox faceBox = renderedImage->getPixelBox(face, 0);
+		
+		if (!rendered[face]) {
+			memset(faceBox.data, 0, PixelUtil::getMemorySize(faceBox.getWidth(), faceBox.getHeight(), 1, pf));
+			continue;
+		}
+		
+		if (rasterizer) {
+			rasterizer->render(sceneManager, cubeCameras[face], visibilityMask, renderedImage, face);
+			continue;
+		}
+		
+		RenderTarget* offScreenRenderTarget = cubeTexture->getBuffer(face)->getRenderTarget();
+		offScreenRenderTarget->copyContentsToMemory(faceBox);
+		
+		#ifdef PRINT_SHOTS
+		offScreenRenderTarget->writeContentsToFile(String("cube_") + faceNames[face] + ".png");
+		#endif
+	}
+	
+	/* We re-set SceneNode and the viewports mask (using the default flags) */
+	resetNodes(sceneNodes);
+	
+	if (!rasterizer)
+		for (int face = 0; face < 6; face++)
+			cubeTexture->getBuffer(face)->getRenderTarget()->getViewport(0)->setVisibilityMask(0xFFFFFFF0);
 
-	/* We create a PixelSet from the obtained image and return it */
-	return new PixelSet( renderedImage, PSName );
+	/* We create a PixelSet from the obtained image, cache it and return it */
+	PixelSet* result = new PixelSet( renderedImage, PSName );
+	cache.insert(key, result);
+	
+	return result;
 
 }
 
@@ -527,9 +1504,9 @@ bool Renderer::isAnAuxiliary(SceneNode* toCheck) {
 	return false;
 }
 
-void Renderer::setAuxiliariesInvisible(Viewport* offScreenViewport) {
+void Renderer::setAuxiliariesInvisible(uint32 visibilityMask) {
 	
-	int invisibleMask = ( offScreenViewport->getVisibilityMask() == 0x0000000F ) ? 0xFFFFFFF0 : 0x0000000F;
+	int invisibleMask = ( visibilityMask == 0x0000000F ) ? 0xFFFFFFF0 : 0x0000000F;
 
 	std::vector<SceneNode* >::iterator vit;
 	
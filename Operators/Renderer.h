@@ -32,8 +32,13 @@ http://www.gnu.org/copyleft/lesser.txt.
 #define _dRenderer
 
 #include <Ogre.h>
+#include <map>
+#include <deque>
+#include <set>
 
 #include "PixelSet.h"
+#include "RenderCache.h"
+#include "DepthRasterizer.h"
 
 /** Used to set rendering mode:
  - NODE just the node passed as input is rendered
@@ -42,12 +47,17 @@ http://www.gnu.org/copyleft/lesser.txt.
  */
 enum RenderingMode { NODE, ALL, ALL_BUT_NODE };
 
+/** Handle of a rendering issued by Renderer::RenderAsync(), to be read back by Renderer::Resolve() */
+typedef int RenderHandle;
+
 	
 /** @brief Defines an object that is able to render scene nodes and create a Pixel Set,
  i.e. a rendering operator in CEL.
  @remarks this class renders a subpart of a scene into a texture which is then transferred to RAM.
+ In NODE mode, the bounding boxes of the nodes are projected first: nodes that can't show in the
+ viewport are not rendered at all, and the others are rendered with a scissor around them.
 */	
-class Renderer
+class Renderer : public Ogre::RenderQueueListener, public Ogre::Node::Listener
 {
 		
 public:
@@ -58,8 +68,13 @@ public:
 	 @param sm					Pointer to the Ogre::SceneManager for the actual scene.
 	 @param viewportWidth		Width of the textures to be created.
 	 @param viewportHeight		Height of the textures to be created.
+	 @param software			If true, renderings are rasterized on the CPU by a DepthRasterizer 
+								instead of the render system, which is then not needed: a Root 
+								without a render system and a DefaultHardwareBufferManager, so 
+								that meshes are loaded in memory, are enough to evaluate CEL
+								e.g. from a command line tool.
 	 */
-	Renderer(Ogre::SceneManager* sm, int viewportWidth, int viewportHeight);
+	Renderer(Ogre::SceneManager* sm, int viewportWidth, int viewportHeight, bool software=false);
 	
 	/** Renderer destructor. */
 	~Renderer();
@@ -67,12 +82,126 @@ public:
 	PixelSet* Render(Ogre::String sceneNode, RenderingMode mode=NODE);
 	
 	/** Renders a SceneNode into a PixelSet of resolution viewportWidth, viewportHeight and returns a pointer to it.
+	 The PixelSet may be shared with the cache of the renderer: it is given back with PixelSet::Release(), 
+	 never deleted, and so are the ones returned by all the Render(), CubeRender() and Resolve() methods.
 	 @param sceneNode		Pointer to the Ogre::SceneNode we want to render 
 	 @param mode			select between NODE (we render just sceneNode), ALL (we render all the scene),
 							and ALL_BUT_NODE (we render all the scene but sceneNode)
 	 */
 	PixelSet* Render(Ogre::SceneNode* sceneNode, Ogre::Camera* camera, RenderingMode mode=NODE);
 	
+	/** Renders a group of SceneNodes together, as if they were a single node. 
+		The rendering camera is used. */
+	PixelSet* Render(const std::vector<Ogre::String>& sceneNodes, RenderingMode mode=NODE);
+	
+	/** Same as above, with the SceneNodes given by ResolveNodes() instead of their names */
+	PixelSet* Render(const std::vector<Ogre::SceneNode*>& sceneNodes, RenderingMode mode=NODE);
+	
+	/** Renders a group of SceneNodes together into a PixelSet and returns a pointer to it.
+	 @param sceneNodes		the Ogre::SceneNodes we want to render 
+	 @param mode			as in Render(), NODE and ALL_BUT_NODE apply to all the nodes of the group
+	 */
+	PixelSet* Render(const std::vector<Ogre::SceneNode*>& sceneNodes, Ogre::Camera* camera, RenderingMode mode=NODE);
+	
+	/** Counts the pixels of Render(sceneNodes, mode) with the rendering camera, see below */
+	int Count(const std::vector<Ogre::String>& sceneNodes, RenderingMode mode=NODE);
+	int Count(const std::vector<Ogre::SceneNode*>& sceneNodes, RenderingMode mode=NODE);
+	
+	/** Counts the pixels of Render(sceneNodes, camera, mode) without transferring the rendering to RAM:
+	 the scene is rendered as usual, then a full screen quad at the far plane is drawn behind it in
+	 a hardware occlusion query, passing the depth test only where something was rendered.
+	 @remarks Render() is used instead, and its PixelSet counted, when the render is cached, when it 
+	 is rasterized on the CPU or when the render system has no occlusion queries.
+	 */
+	int Count(const std::vector<Ogre::SceneNode*>& sceneNodes, Ogre::Camera* camera, RenderingMode mode=NODE);
+	
+	/** Renders a group of SceneNodes as Render() does with the rendering camera, into a render target 
+	 of the size of the viewport whose viewport uses the off-screen camera, and leaves the rendering there.
+	 @return false if the nodes can't show in the viewport, the target is then only cleared
+	 */
+	bool RenderInto(const std::vector<Ogre::String>& sceneNodes, RenderingMode mode, Ogre::RenderTarget* target);
+	bool RenderInto(const std::vector<Ogre::SceneNode*>& sceneNodes, RenderingMode mode, Ogre::RenderTarget* target);
+	
+	/** Renders the given SceneNodes in a single pass with the rendering camera, writing depth
+	 and an object id for each pixel, and keeps a PixelSet for each node until ClearTargets(). 
+	 The following Render(sceneNode, NODE) calls share it instead of rendering again.
+	 @remarks a node is only kept if the screen rectangle of its bounding box doesn't meet the 
+	 one of any other node, since another node in front of it would hide some of its pixels.
+	 The other nodes are rendered on their own by RenderAsync(), a few at a time in the given order, 
+	 and Render(sceneNode, NODE) resolves them when they are needed.
+	 Until ClearTargets(), the scene is taken not to change: the renders of the whole scene are 
+	 keyed by a hash of the scene taken by the first of them, see sceneChanged().
+	 */
+	void RenderTargets(const std::vector<Ogre::String>& sceneNodes);
+	void RenderTargets(const std::vector<Ogre::SceneNode*>& sceneNodes);
+	
+	/** Looks up the SceneNodes of the given names once, e.g. for the targets of an expression evaluated
+	 again and again, which then renders them without looking their names up in the scene manager.
+	 The nodes are watched, so that getBindingVersion() changes as soon as one of them is destroyed. 
+	 @remarks a node with a listener of its own can't be watched, sceneChanged() has to be called 
+	 when it is destroyed.
+	 */
+	void ResolveNodes(const std::vector<Ogre::String>& names, std::vector<Ogre::SceneNode*>& sceneNodes);
+	Ogre::SceneNode* ResolveNode(const Ogre::String& name);
+	
+	/** Changes whenever the nodes given by ResolveNodes() before may not be the nodes of their names
+	 anymore, i.e. when one of them is destroyed, sceneChanged() is called or the renderer is destroyed */
+	static unsigned long getBindingVersion() { return bindingVersion; }
+	
+	/** Drops a destroyed node from the nodes given by ResolveNodes(), see Ogre::Node::Listener */
+	void nodeDestroyed(const Ogre::Node* node);
+	
+	/** Drops the PixelSets kept by RenderTargets(), e.g. once the camera or the scene changed, 
+	 and the cached renders unless the cache is persistent, see setPersistentCache() */
+	void ClearTargets();
+	
+	/** Renders a group of SceneNodes as Render() does, without waiting for the GPU. The rendering goes 
+	 to one of asyncDepth render textures used in turn, and is read back only by Resolve(), so that 
+	 the CPU can evaluate a PixelSet while the GPU renders the next ones. 
+	 @return the handle to pass to Resolve()
+	 @remarks issuing more than asyncDepth renderings before resolving them reads back the oldest 
+	 ones early. The PixelSet shows the scene as it was when RenderAsync() was called.
+	 */
+	RenderHandle RenderAsync(const std::vector<Ogre::SceneNode*>& sceneNodes, Ogre::Camera* camera, RenderingMode mode=NODE);
+	
+	/** Reads back the PixelSet of a rendering issued by RenderAsync() and returns a pointer to it,
+	 or NULL if the handle is unknown or was already resolved. */
+	PixelSet* Resolve(RenderHandle handle);
+	
+	/** Tells the renderer that the scene changed in a way it can't see, so that the renders cached 
+	 before are not used anymore. Moving, showing, hiding, adding or removing nodes and objects is 
+	 seen, changing materials or meshes or animating skeletons is not. */
+	void sceneChanged() { sceneVersion++; bindingVersion++; }
+	
+	/** By default the cached renders only last until ClearTargets(), i.e. an evaluation, so that 
+	 the changes of the scene the keys can't see never give stale PixelSets. A persistent cache keeps 
+	 them from one evaluation to the next, sceneChanged() has to be called on such changes then. */
+	void setPersistentCache(bool persistent) { persistentCache = persistent; }
+	bool isPersistentCache() { return persistentCache; }
+	
+	/** By default the renderings in NODE mode are scissored to the screen rectangle of their nodes, 
+	 and only that rectangle is read back and scanned. Without it they cover the whole viewport, 
+	 e.g. to measure what the rectangles save. */
+	void setWindowedReadback(bool windowed) { windowedReadback = windowed; }
+	bool isWindowedReadback() { return windowedReadback; }
+	
+	/** Gets the cache of the renders, e.g. to set its budget or read its statistics */
+	RenderCache& getCache() { return cache; }
+	
+	/** Number of renderings done by the render system or the rasterizer */
+	unsigned long getRenderCount() { return renderCount; }
+	
+	/** Number of renderings skipped since the bounding boxes of their nodes are out of the view */
+	unsigned long getSkippedRenders() { return skippedRenders; }
+	
+	/** Sets the scissor of the rendering under way, and runs the occlusion query of Count() around
+	 its quad, see Ogre::RenderQueueListener */
+	void renderQueueStarted(Ogre::uint8 queueGroupId, const Ogre::String& invocation, bool& skipThisInvocation);
+	void renderQueueEnded(Ogre::uint8 queueGroupId, const Ogre::String& invocation, bool& repeatThisInvocation);
+	
+	/** Number of render textures used in turn by RenderAsync() */
+	static const int asyncDepth = 3;
+	
 	PixelSet* CubeRender(Ogre::String sceneNode, RenderingMode mode=NODE);
 	
 	/** Renders a cubemap from a SceneNode into a PixelSet of resolution ??? and returns a pointer to it.
@@ -86,6 +215,10 @@ public:
 	 @param camera the Ogre camera to be used for offscreen rendering
 	 */
 	void setCamera(Ogre::Camera* camera ) { this->renderingCamera = camera; }
+	
+	/** Gets the camera used for offscreen rendering
+	 */
+	Ogre::Camera* getCamera() { return renderingCamera; }
 
 	/** Adds a screen-aligned quad to the scene. The quad is set to non-visible. 
 	 The method returns the name of the scene node to which the quad is attached.
@@ -121,6 +254,10 @@ public:
 	/** Gets the offscreen camera
 	 */
 	Ogre::Camera* getOffScreenCamera() {return offScreenCamera;}
+	
+	/** Tells whether renderings are rasterized on the CPU
+	 */
+	bool isSoftware() {return rasterizer != 0;}
 
 			
 protected:
@@ -133,6 +270,56 @@ private:
 	
 	void setVisible( Ogre::SceneNode* sceneNode, Ogre::uint32 nodeFlag);
 	
+	/** Sets the object id written by the renderables of the scene node and its children, 0 for none */
+	void setObjectId( Ogre::SceneNode* sceneNode, Ogre::uint32 id );
+	
+	/** Copies position, orientation and projection of camera to the off-screen camera */
+	void setOffScreenCamera( Ogre::Camera* camera );
+	
+	/** Gives the off-screen and cube cameras, and their node, back to the SceneManager */
+	void destroyCameras();
+	
+	/** Rectangle of the viewport that can be covered by the scene node, as seen from camera */
+	PixelWindow screenBounds( Ogre::SceneNode* sceneNode, Ogre::Camera* camera );
+	
+	/** Rectangle of the viewport that the rendering of the scene nodes can cover, as seen from
+	 the off-screen camera: the whole viewport unless mode is NODE */
+	PixelWindow renderBounds( const std::vector<Ogre::SceneNode*>& sceneNodes, RenderingMode mode );
+	
+	/** Restricts the renderings to the window until endScissor() */
+	void beginScissor( const PixelWindow& window );
+	void endScissor();
+	
+	/** Name of the PixelSet rendering the scene nodes in the given mode, starting with prefix */
+	Ogre::String renderName( const std::vector<Ogre::SceneNode*>& sceneNodes, RenderingMode mode, const Ogre::String& prefix = "R" );
+	
+	/** Sets the visibility flags of the scene nodes for the rendering mode, gets the visibility mask
+	 the rendering must use and returns the name of the resulting PixelSet, starting with prefix */
+	Ogre::String showNodes( const std::vector<Ogre::SceneNode*>& sceneNodes, RenderingMode mode, Ogre::uint32& visibilityMask, const Ogre::String& prefix = "R" );
+	
+	/** Restores the default visibility flags of the scene nodes and mask of the viewport, if any */
+	void resetNodes( const std::vector<Ogre::SceneNode*>& sceneNodes, Ogre::Viewport* viewport = 0 );
+	
+	/** Creates the material and the quad Count() draws, invisible until it counts */
+	void createCountQuad();
+	
+	/** Reads back the rendering held by an asynchronous render texture into a new PixelSet */
+	PixelSet* readBack( int slot );
+	
+	/** Reads back only the window of the rendering held by a texture into a new PixelSet 
+	 of the size of the texture, the pixels out of the window being left out of the set */
+	PixelSet* readWindow( Ogre::TexturePtr texture, const PixelWindow& window, const Ogre::String& name );
+	
+	/** Key of a render in the cache: the nodes, the mode, the camera and the state of the part 
+	 of the scene that is rendered */
+	Ogre::String renderKey( const std::vector<Ogre::SceneNode*>& sceneNodes, Ogre::Camera* camera, RenderingMode mode, bool cube );
+	
+	/** Mixes the placement and the objects of the scene node and its children into hash */
+	void hashNode( Ogre::SceneNode* sceneNode, Ogre::uint64& hash );
+	
+	/** Issues asynchronous renderings of the targets left over by RenderTargets(), while a render texture is free */
+	void issueTargets();
+	
 	/** Pointer to the Ogre::SceneManager for the actual scene. */
 	Ogre::SceneManager* sceneManager;
 	
@@ -142,12 +329,78 @@ private:
 	/** Pointers to the image and cube RenderTextures */
 	Ogre::TexturePtr imageTexture;
 	Ogre::TexturePtr cubeTexture;
+	
+	/** Cameras rendering the faces of the cube texture, in the order of the faces */
+	Ogre::Camera* cubeCameras[6];
+	
+	/** Side of the faces of the cube renderings */
+	int m_cubeWidth;
+	
+	/** Rasterizer of the renderings in software mode, NULL when the render system renders them */
+	DepthRasterizer* rasterizer;
+	
+	/** Texture of object ids, and the target rendering depth and ids in a single pass */
+	Ogre::TexturePtr idTexture;
+	Ogre::MultiRenderTarget* idRenderTarget;
+	
+	/** PixelSets of the nodes rendered by RenderTargets(), by node */
+	std::map<Ogre::SceneNode*, PixelSet*> renderedTargets;
+	
+	/** Render textures used in turn by RenderAsync(), with the handle, name and bounds of the 
+	 rendering each one holds (-1 when there's none) */
+	Ogre::TexturePtr asyncTextures[asyncDepth];
+	RenderHandle asyncHandles[asyncDepth];
+	Ogre::String asyncNames[asyncDepth];
+	PixelWindow asyncBounds[asyncDepth];
+	RenderHandle nextHandle;
+	
+	/** Renderings read back early since their texture was needed again, by handle */
+	std::map<RenderHandle, PixelSet*> earlyRenders;
+	
+	/** Renders served again while the scene and the camera don't change */
+	RenderCache cache;
+	
+	/** Number of calls to sceneChanged(), part of the keys of the cache */
+	unsigned long sceneVersion;
+	
+	/** Whether the cached renders outlive ClearTargets(), see setPersistentCache() */
+	bool persistentCache;
+	
+	/** Whether the renderings in NODE mode are cut down to their nodes, see setWindowedReadback() */
+	bool windowedReadback;
+	
+	/** Hash of the whole scene for the keys of the cache, and whether it holds until ClearTargets(), 
+	 between which the scene is taken not to change, see RenderTargets() */
+	Ogre::uint64 sceneHash;
+	bool sceneFrozen, sceneHashed;
+	
+	/** Nodes given by ResolveNodes() and watched by the renderer, and the number of times one of 
+	 them was destroyed or sceneChanged() was called */
+	std::set<Ogre::Node*> watchedNodes;
+	static unsigned long bindingVersion;
+	
+	/** Renderings done and skipped */
+	unsigned long renderCount;
+	unsigned long skippedRenders;
+	
+	/** Window the rendering under way is restricted to */
+	PixelWindow scissor;
+	
+	/** Occlusion query and quad of Count(), NULL without occlusion queries. counting is true while 
+	 Count() renders, countIssued once the query ran around the quad. */
+	Ogre::HardwareOcclusionQuery* countQuery;
+	Ogre::ManualObject* countQuad;
+	bool counting, countIssued;
+	
+	/** Nodes left over by RenderTargets(), still to be rendered or rendering asynchronously */
+	std::deque<Ogre::SceneNode*> queuedTargets;
+	std::map<Ogre::SceneNode*, RenderHandle> issuedTargets;
 		
 	Ogre::uint32 defaultVisibilityMask;
 	
 	Ogre::Camera* renderingCamera;
 	
-	void setAuxiliariesInvisible(Ogre::Viewport* offScreenViewport);
+	void setAuxiliariesInvisible(Ogre::uint32 visibilityMask);
 	bool isAnAuxiliary(Ogre::SceneNode* toCheck);
 	
 	int m_viewportWidth;
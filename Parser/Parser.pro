@@ -25,6 +25,7 @@ HEADERS += basetype.h \
            buffer.h \
            callfunction.h \
            comparisionoperator.h \
+           compiledexpression.h \
            conditionaloperator.h \
            count.h \
            minmaxpixelsetoperator.h \
@@ -62,6 +63,7 @@ SOURCES += basetype.cpp \
            buffer.cpp \
            expression.cpp \
            celparser.cpp \
+           compiledexpression.cpp \
            symbol.cpp \
            symboltable.cpp \
            target.cpp \
@@ -70,6 +72,7 @@ SOURCES += basetype.cpp \
            targetnegation.cpp \
            vectoroftargets.cpp \
            main.cpp \
+ pixelsetexpression.cpp \
  rendererpsexpression.cpp \
  targetfunction.cpp \
  callfunction.cpp \
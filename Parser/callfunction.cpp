@@ -35,9 +35,117 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include "callfunction.h"
 
 #include "targetexpressionvisitor.h"
+#include "celparserexception.h"
 
 namespace CEL {
 
+CallFunctionOperator::ActivationFrame *CallFunctionOperator::s_currentFrame = NULL;
+
+std::vector<CallFunctionOperator *> CallFunctionOperator::s_unresolved;
+
+class CallFunctionOperator::FrameScope {
+	
+	ActivationFrame *m_saved;
+	
+public :
+	FrameScope(ActivationFrame *frame) : m_saved(s_currentFrame) { s_currentFrame = frame; }
+	~FrameScope() { s_currentFrame = m_saved; }
+};
+
+CallFunctionOperator::ActivationFrame *CallFunctionOperator::parameterFrame() {
+	
+	if (!s_currentFrame || (int)s_currentFrame->call->size() <= m_parameterSlot)
+		throw CelParserException((std::string("Parameter ") + m_functionName + " used out of its function").c_str());
+	
+	return s_currentFrame;
+}
+
+void CallFunctionOperator::resolveCalls(SymbolTable &table) {
+	
+	std::vector<CallFunctionOperator *>::iterator it;
+	for (it = s_unresolved.begin(); it != s_unresolved.end(); ++it)
+		if (!(*it)->isParameter() && table.existsSymbol((*it)->m_functionName))
+			(*it)->m_binding = table[(*it)->m_functionName];
+	
+	s_unresolved.clear();
+}
+
+Expression *CallFunctionOperator::function() {
+	
+	if (!m_binding) {
+		if (!m_table || !m_table->existsSymbol(m_functionName))
+			throw CelParserException((std::string("Unknown symbol ") + m_functionName).c_str());
+		
+		m_binding = (*m_table)[m_functionName];
+		
+		if (!m_binding)
+			throw CelParserException((std::string("Symbol ") + m_functionName + " has no expression").c_str());
+	}
+	
+	return m_binding;
+}
+
+double CallFunctionOperator::evaluate() {
+	
+	if (m_parameterSlot >= 0)
+		return argument();
+	
+	ActivationFrame frame = { this, NULL, s_currentFrame };
+	
+	FrameScope scope(&frame);
+	return function()->evaluate();
+}
+
+double CallFunctionOperator::call(Expression *body, const double *arguments) {
+	
+	ActivationFrame frame = { this, arguments, s_currentFrame };
+	
+	FrameScope scope(&frame);
+	return body->evaluate();
+}
+
+double CallFunctionOperator::argument() {
+	
+	ActivationFrame *frame = parameterFrame();
+	
+	if (frame->values)
+		return frame->values[m_parameterSlot];
+	
+	FrameScope scope(frame->caller);
+	return (*frame->call)[m_parameterSlot]->evaluate();
+}
+
+Expression *CallFunctionOperator::getBinding() {
+	
+	if (m_parameterSlot < 0)
+		return function();
+	
+	// an argument that is a parameter itself is bound in the frame of the caller
+	ActivationFrame *frame = parameterFrame();
+	Expression *argument = (*frame->call)[m_parameterSlot];
+	
+	FrameScope scope(frame->caller);
+	CallFunctionOperator *parameter = dynamic_cast<CallFunctionOperator *>(argument);
+	
+	return parameter && parameter->isParameter() ? parameter->getBinding() : argument;
+}
+
+void CallFunctionOperator::visitBinding(TargetExpressionVisitor &v) {
+	
+	if (m_parameterSlot >= 0) {
+		ActivationFrame *frame = parameterFrame();
+		
+		FrameScope scope(frame->caller);
+		(*frame->call)[m_parameterSlot]->visit(v);
+		return;
+	}
+	
+	ActivationFrame frame = { this, NULL, s_currentFrame };
+	
+	FrameScope scope(&frame);
+	function()->visit(v);
+}
+
 void CallFunctionOperator::visit(TargetExpressionVisitor &v) {
 	v.visit(*this);
 }
@@ -33,6 +33,7 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include <stdlib.h>
 #include <vector>
 #include <string>
+#include <algorithm>
 
 #include "operator.h"
 #include "symboltable.h"
@@ -43,9 +44,12 @@ http://www.gnu.org/copyleft/lesser.txt.
 namespace CEL {
 
 /** models a call function : functionName(exp1,...,expn)
-    and a call function declaration: functionName(sym1,...symn) = exp
-    exp1,...expn are all stored in the vector of expressions 
-    sym1,...symn are stored in the localSymbolTable
+    and a reference to a parameter of the function whose body it is in.
+    exp1,...expn are all stored in the vector of expressions, and are the arguments of an 
+    activation frame while the function is evaluated: a parameter is resolved at parse time to 
+    its slot in the frame, and evaluates the argument there in the frame of the caller.
+    A call compiled to bytecode evaluates its arguments before the call instead, and the 
+    parameters load their values from the slots of the frame, see CompiledExpression.
     */
 
 class TargetExpressionVisitor;
@@ -54,73 +58,107 @@ class CallFunctionOperator : public Operator
 {
 
    std::string	m_functionName;
-	
-   SymbolTable  m_localSymbolTable;
+   
+   // names of the parameters the arguments are assigned to
+   Parameters	m_parameterNames;
+   
+   // slot of the parameter in the frame of its function, -1 for a call
+   int		m_parameterSlot;
+   
+   // the expression of the symbol called, once resolved
+   Expression	*m_binding;
+   
+   // the symbol table of the parser the call was parsed by, where the symbol is looked up
+   SymbolTable	*m_table;
 	
 public :
-    CallFunctionOperator(const std::string & s) : m_functionName(s) {};
+    // a call to the symbol s, whose arguments are assigned afterwards
+    CallFunctionOperator(const std::string & s) : m_functionName(s), m_parameterSlot(-1), m_binding(NULL), m_table(SymbolTable::m_globalSymbolTable) { s_unresolved.push_back(this); };
+    
+    // a reference to the parameter s of the function whose body it is in, declared at parameterSlot
+    CallFunctionOperator(const std::string & s, int parameterSlot) : m_functionName(s), m_parameterSlot(parameterSlot), m_binding(NULL), m_table(SymbolTable::m_globalSymbolTable) { s_unresolved.push_back(this); };
+    
+    virtual ~CallFunctionOperator() { 
+    	std::vector<CallFunctionOperator *>::iterator it = std::find ( s_unresolved.begin(), s_unresolved.end(), this );
+    	if (it != s_unresolved.end())
+    		s_unresolved.erase(it);
+    }
         
     /** assigns the function parameter to the expression, + stores it in the vector of expressions */
-    void assignParameterInLocalSymbolTable(const std::string &s, Expression *e) {
-       m_localSymbolTable.addSymbol(s,e);
-       std::cout << " and Storing the expression " << e << std::endl;
+    void assignParameter(const std::string &s, Expression *e) {
+       m_parameterNames.push_back(s);
        push_back(e);
     }
     
-        
     // calls the function, by :
-    //  -pushing the parameters on the SymbolTable,
+    //  -pushing a frame with the arguments,
     //  -evaluating the function
-    //  -poping the parameters on the SymbolTable
-    virtual double evaluate() {
-    	
-		std::cout << "local symbol table is " << std::endl;
-		m_localSymbolTable.printSymbolTable();
-
-		std::cout << "assign values in local table " << std::endl;
-		// make the assignments in the local table: replace the right arg (if its a FunctionCall) by the corresponding expression in the table..
-		SymbolTable assignedArgs = getSymbolTableSingleton().assignLocalArgs(m_localSymbolTable);
-		assignedArgs.printSymbolTable();
-
-    	SymbolTable savedSymbols = getSymbolTableSingleton().pushSymbols(assignedArgs);
-		std::cout << " We saved the following symbols " << std::endl;
-		savedSymbols.printSymbolTable();
-    	
-    	std::cout << " Pushing local symbols  ...the context is " << std::endl; 
-    	getSymbolTableSingleton().printSymbolTable();
-    	
-		std::cout << " Call to function " << m_functionName << std::endl;
-    	double result = getSymbolTableSingleton()[Symbol(m_functionName)]->evaluate();
-    	
-		std::cout << " We restore the symbols... " << std::endl; 
-    	getSymbolTableSingleton().popSymbols( savedSymbols );
-		std::cout << " Restored table is " << std::endl; 
-		getSymbolTableSingleton().printSymbolTable();
-    	
-    	return result;
-    }
+    //  -poping the frame
+    // or evaluates the argument of the parameter, in the frame of the caller
+    virtual double evaluate();
+    
+    // calls the function with the arguments evaluated already, by evaluating its compiled body 
+    // in a frame the parameters load the arguments from
+    double call(Expression *body, const double *arguments);
+    
+    // the value of the parameter: the argument evaluated by a compiled call, or else the 
+    // argument evaluated now in the frame of the caller
+    double argument();
+    
+    // the expression the symbol is bound to now: the function, or the argument of the parameter
+    Expression *getBinding();
+    
+    // visits the expression the symbol is bound to, in the frame it is evaluated in
+    void visitBinding(TargetExpressionVisitor &v);
     
     const std::string& getFunctionName() const {return m_functionName;};
+    
+    bool isParameter() const {return m_parameterSlot >= 0;};
+    
+    // binds the calls created since the last resolveCalls(), i.e. the calls of the file just parsed, 
+    // to the expressions of the symbols they call in the table, so that evaluating them doesn't look 
+    // their names up anymore. The calls of the other files keep their bindings
+    static void resolveCalls(SymbolTable &table);
  
 	std::ostream& print(std::ostream &os) {
 		os << getFunctionName();
 
-		std::vector<Symbol> vec = m_localSymbolTable.getSymbols();
-		std::vector<Symbol>::iterator it;
-		if (vec.size() > 0) {
+		if (m_parameterNames.size() > 0) {
 			os << "(";
-			for (it = vec.begin(); it != vec.end(); it++) {
-				(*it).print(os); 
-			}
+			for (size_t i = 0; i < m_parameterNames.size(); i++)
+				os << (i > 0 ? "," : "") << m_parameterNames[i]; 
 			os << ")";
 		}
 		return os;
 	}
 
-    virtual SymbolTable getSymbolTable() {return m_localSymbolTable;};
-
 	void visit(TargetExpressionVisitor &v);
 
+private :
+	
+	// the arguments of a call under way, their values if the call is compiled (NULL otherwise), 
+	// and the frame of the call it was made from
+	struct ActivationFrame {
+		CallFunctionOperator *call;
+		const double *values;
+		ActivationFrame *caller;
+	};
+	
+	// makes a frame the current one while it is in scope
+	class FrameScope;
+	
+	// the frame of the innermost call under way, NULL out of any function
+	static ActivationFrame *s_currentFrame;
+	
+	// the frame the parameter is in
+	ActivationFrame *parameterFrame();
+	
+	// the expression of the symbol called, looked up in the table of its parser if it isn't resolved yet
+	Expression *function();
+	
+	// the calls and parameters created since the last resolveCalls()
+	static std::vector<CallFunctionOperator *> s_unresolved;
+
 };
 
 }
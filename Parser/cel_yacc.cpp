@@ -154,8 +154,11 @@ int yyterminate();
 CEL::SymbolTable savedSymbols;
 CEL::SymbolTable localSymbols;
 
+// the parameters of the function being declared, in the order of their slots in its frame
+CEL::Parameters declaredParameters;
 
-#line 53 "cel.ypp"
+
+#line 56 "cel.ypp"
 typedef union {
 	int intType;
 	double doubleType;
@@ -1439,7 +1442,7 @@ YYLABEL(yyreduce)
   switch (yyn) {
 
 case 2:
-#line 112 "cel.ypp"
+#line 115 "cel.ypp"
 { 
 		
 		std::cout << "[corpus]: Rule 'corpus' read " << endl;
@@ -1447,19 +1450,19 @@ case 2:
 		;
     break;}
 case 4:
-#line 121 "cel.ypp"
+#line 124 "cel.ypp"
 {
 		std::cout << "[list_of_includes]: Rule 'list_of_includes' read" << endl;
 	;
     break;}
 case 5:
-#line 125 "cel.ypp"
+#line 128 "cel.ypp"
 {
 		std::cout << "[include_declaration]: 'include_declaration' read " << endl;
 	;
     break;}
 case 6:
-#line 131 "cel.ypp"
+#line 134 "cel.ypp"
 {		
 		std::cout << "[include] : " << std::endl;
 		std::cout << "Switching to buffer " << yyvsp[-1].stringType << endl;
@@ -1472,7 +1475,7 @@ case 6:
 	;
     break;}
 case 7:
-#line 143 "cel.ypp"
+#line 146 "cel.ypp"
 {
 		std::cout << "[eof]: " << std::endl;
 		std::cout << " Buffer size is "
@@ -1492,7 +1495,7 @@ case 7:
 	;
     break;}
 case 10:
-#line 165 "cel.ypp"
+#line 168 "cel.ypp"
 {
 			std::cout << "[declaration]:" << std::endl;
 			if (CEL::CelParser::getSingletonParser()->existsSymbol(*yyvsp[-3].symbolType) ) {
@@ -1516,18 +1519,21 @@ case 10:
 
 
 			}		
+			// the parameters are out of scope after the body
+			declaredParameters.clear();
 		;
     break;}
 case 11:
-#line 191 "cel.ypp"
+#line 196 "cel.ypp"
 {
 			std::cout << "[leftBodyRelation]:" << std::endl;
 			std::cout << "Creating a symbol" << yyvsp[0].stringType << std::endl;
 			yyval.symbolType = new CEL::Symbol(yyvsp[0].stringType);
+			declaredParameters.clear();
 		;
     break;}
 case 12:
-#line 198 "cel.ypp"
+#line 204 "cel.ypp"
 {			
 			std::cout << "[lefBodyRelation]:" << std::endl;
 			yyval.symbolType = new CEL::Symbol(yyvsp[-3].stringType);
@@ -1538,6 +1544,7 @@ case 12:
 				yyval.symbolType->addParameter(it->first.getSymbolName());
 				localSymbols.addSymbol(it->first, NULL);
 			}
+			declaredParameters = yyval.symbolType->getParameters();
 			// we add these local parameters on the symboltable (and save the similar ones if necessary)
 			std::cout << " Adding local parameters in the symbolTable and saving older symbols... " << std::endl;
 			savedSymbols = CEL::getSymbolTableSingleton().addSymbols( localSymbols );
@@ -1545,7 +1552,7 @@ case 12:
 		;
     break;}
 case 13:
-#line 217 "cel.ypp"
+#line 224 "cel.ypp"
 {
 			std::cout << "[list_of_leftArguments]:" << std::endl;
 			yyval.hashTableType = new CEL::HashTable();
@@ -1558,7 +1565,7 @@ case 13:
 		 ;
     break;}
 case 14:
-#line 228 "cel.ypp"
+#line 235 "cel.ypp"
 {
 			std::cout << "[list_of_leftArguments]:" << std::endl;
 			yyval.hashTableType = yyvsp[-2].hashTableType;
@@ -1572,47 +1579,47 @@ case 14:
 		 ;
     break;}
 case 15:
-#line 242 "cel.ypp"
+#line 249 "cel.ypp"
 { 
 			std::cout << "[leftArgument]:" << std::endl;
 			yyval.stringType = yyvsp[0].stringType;
 		;
     break;}
 case 16:
-#line 249 "cel.ypp"
+#line 256 "cel.ypp"
 {
 			std::cout << "[rightBodyRelation]:" << std::endl;
 			yyval.expressionType = yyvsp[0].expressionType;
 		;
     break;}
 case 17:
-#line 255 "cel.ypp"
+#line 262 "cel.ypp"
 {  yyval.doubleType = yyvsp[0].doubleType; ;
     break;}
 case 18:
-#line 257 "cel.ypp"
+#line 264 "cel.ypp"
 { yyval.doubleType = -yyvsp[0].doubleType; ;
     break;}
 case 19:
-#line 259 "cel.ypp"
+#line 266 "cel.ypp"
 { yyval.doubleType = yyvsp[0].doubleType; ;
     break;}
 case 20:
-#line 263 "cel.ypp"
+#line 270 "cel.ypp"
 { 
 			std::cout << "[expression]: DOUBLE" << std::endl;
 			yyval.expressionType = new CEL::BaseType(yyvsp[0].doubleType);
 		;
     break;}
 case 21:
-#line 268 "cel.ypp"
+#line 275 "cel.ypp"
 { 
 			std::cout << "[expression]: ( )" << std::endl;
 			yyval.expressionType = yyvsp[-1].expressionType;
 		;
     break;}
 case 22:
-#line 274 "cel.ypp"
+#line 281 "cel.ypp"
 {
 			std::cout << "[expression]: SQRT ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_SQRT);
@@ -1621,7 +1628,7 @@ case 22:
 		;
     break;}
 case 23:
-#line 281 "cel.ypp"
+#line 288 "cel.ypp"
 {
 			std::cout << "[expression]: SQR ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_SQR);
@@ -1630,7 +1637,7 @@ case 23:
 		;
     break;}
 case 24:
-#line 288 "cel.ypp"
+#line 295 "cel.ypp"
 {
 			std::cout << "[expression]: SIN ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_SIN);
@@ -1639,7 +1646,7 @@ case 24:
 		;
     break;}
 case 25:
-#line 295 "cel.ypp"
+#line 302 "cel.ypp"
 {
 			std::cout << "[expression]: COS ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_COS);
@@ -1648,7 +1655,7 @@ case 25:
 		;
     break;}
 case 26:
-#line 302 "cel.ypp"
+#line 309 "cel.ypp"
 {
 			std::cout << "[expression]: TAN ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_TAN);
@@ -1657,7 +1664,7 @@ case 26:
 		;
     break;}
 case 27:
-#line 309 "cel.ypp"
+#line 316 "cel.ypp"
 {
 			std::cout << "[expression]: ASIN ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_ASIN);
@@ -1666,7 +1673,7 @@ case 27:
 		;
     break;}
 case 28:
-#line 316 "cel.ypp"
+#line 323 "cel.ypp"
 {
 			std::cout << "[expression]: ACOS ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_ACOS);
@@ -1675,7 +1682,7 @@ case 28:
 		;
     break;}
 case 29:
-#line 323 "cel.ypp"
+#line 330 "cel.ypp"
 {
 			std::cout << "[expression]: ATAN ( )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_ATAN);
@@ -1684,7 +1691,7 @@ case 29:
 		;
     break;}
 case 30:
-#line 331 "cel.ypp"
+#line 338 "cel.ypp"
 {
 			std::cout << "[expression]: ATAN2 (  exp , exp )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_ATAN2);
@@ -1694,7 +1701,7 @@ case 30:
 		;
     break;}
 case 31:
-#line 340 "cel.ypp"
+#line 347 "cel.ypp"
 {
 			std::cout << "[expression]: EXP (   )" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_EXP);
@@ -1703,56 +1710,56 @@ case 31:
 		;
     break;}
 case 32:
-#line 348 "cel.ypp"
+#line 355 "cel.ypp"
 {
 			std::cout << "[expression]: COUNT (  )" << std::endl;
 			yyval.expressionType = new CEL::CountPixelSetOperator(yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 33:
-#line 354 "cel.ypp"
+#line 361 "cel.ypp"
 {
 			std::cout << "[expression]: MAXX (  )" << std::endl;
 			yyval.expressionType = new CEL::MaxXPixelSetOperator(yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 34:
-#line 360 "cel.ypp"
+#line 367 "cel.ypp"
 {
 			std::cout << "[expression]: MINX (  )" << std::endl;
 			yyval.expressionType = new CEL::MinXPixelSetOperator(yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 35:
-#line 367 "cel.ypp"
+#line 374 "cel.ypp"
 {
 			std::cout << "[expression]: MAXY (  )" << std::endl;
 			yyval.expressionType = new CEL::MaxYPixelSetOperator(yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 36:
-#line 373 "cel.ypp"
+#line 380 "cel.ypp"
 {
 			std::cout << "[expression]: MINY (  )" << std::endl;
 			yyval.expressionType = new CEL::MinYPixelSetOperator(yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 37:
-#line 379 "cel.ypp"
+#line 386 "cel.ypp"
 {
 			std::cout << "[expression]: DISTANCE (  )" << std::endl;
 			yyval.expressionType = new CEL::DistancePixelSetOperator(yyvsp[-3].pixelSetExpressionType,yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 38:
-#line 385 "cel.ypp"
+#line 392 "cel.ypp"
 {
 			std::cout << "[expression]: RECT (  )" << std::endl;
 			yyval.expressionType = new CEL::QuadFrame(yyvsp[-7].doubleType,yyvsp[-5].doubleType,yyvsp[-3].doubleType,yyvsp[-1].doubleType);
 		;
     break;}
 case 39:
-#line 391 "cel.ypp"
+#line 398 "cel.ypp"
 {
 			std::cout << "[expression]: VIEWVOLUME" << std::endl;
 			yyval.expressionType = new CEL::ViewVolume();
@@ -1760,7 +1767,7 @@ case 39:
 		;
     break;}
 case 40:
-#line 398 "cel.ypp"
+#line 405 "cel.ypp"
 {			
 			std::cout << "[expression]: UMINUS " << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_UNARY_MINUS);
@@ -1769,7 +1776,7 @@ case 40:
 		;
     break;}
 case 41:
-#line 406 "cel.ypp"
+#line 413 "cel.ypp"
 {  
 			std::cout << "[expression]: exp - exp" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_MINUS);
@@ -1779,7 +1786,7 @@ case 41:
 		;
     break;}
 case 42:
-#line 414 "cel.ypp"
+#line 421 "cel.ypp"
 {  
 			std::cout << "[expression]: exp + exp" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_PLUS);
@@ -1789,7 +1796,7 @@ case 42:
 		;
     break;}
 case 43:
-#line 422 "cel.ypp"
+#line 429 "cel.ypp"
 {  
 			std::cout << "[expression]: exp * exp" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_MULTIPLICATION);
@@ -1799,7 +1806,7 @@ case 43:
 		;
     break;}
 case 44:
-#line 430 "cel.ypp"
+#line 437 "cel.ypp"
 {  
 			std::cout << "[expression]: exp / exp" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_DIVISION);
@@ -1809,7 +1816,7 @@ case 44:
 		;
     break;}
 case 45:
-#line 438 "cel.ypp"
+#line 445 "cel.ypp"
 {  
 			std::cout << "[expression]: exp ^ exp" << std::endl;
 			CEL::Operator *op = new CEL::MathOperator(CEL::MathOperator::MATH_POWER);
@@ -1819,7 +1826,7 @@ case 45:
 		;
     break;}
 case 46:
-#line 446 "cel.ypp"
+#line 453 "cel.ypp"
 {
 			std::cout << "[expression]: imageWidth" << std::endl;
 			CEL::Operator *op = new CEL::Constant(CEL::Constant::IMAGE_WIDTH);
@@ -1827,7 +1834,7 @@ case 46:
 		;
     break;}
 case 47:
-#line 453 "cel.ypp"
+#line 460 "cel.ypp"
 {
 			std::cout << "[expression]: imageHeight" << std::endl;
 			CEL::Operator *op = new CEL::Constant(CEL::Constant::IMAGE_HEIGHT);
@@ -1835,14 +1842,14 @@ case 47:
 		;
     break;}
 case 48:
-#line 460 "cel.ypp"
+#line 467 "cel.ypp"
 {
 			std::cout << "[expression]: targetExpression" << std::endl;
 			yyval.expressionType = yyvsp[0].targetExpressionType;
 		;
     break;}
 case 49:
-#line 466 "cel.ypp"
+#line 473 "cel.ypp"
 {
 			std::cout << "[expression]: functionCall " << std::endl;
 			if (CEL::CelParser::getSingletonParser()->existsSymbol(yyvsp[0].callFunctionType->getFunctionName())) {
@@ -1855,7 +1862,7 @@ case 49:
 		;
     break;}
 case 50:
-#line 477 "cel.ypp"
+#line 484 "cel.ypp"
 {
 			std::cout << "[expression]: if then else " << std::endl;
 			CEL::Operator *op = new CEL::ConditionalOperator();
@@ -1866,7 +1873,7 @@ case 50:
 		;
     break;}
 case 51:
-#line 487 "cel.ypp"
+#line 494 "cel.ypp"
 {
 			// no secure test, $2 needs to be one of the the following...
 			std::cout << " reading Comparator " << yyvsp[-1].stringType << std::endl;
@@ -1885,7 +1892,7 @@ case 51:
 		;
     break;}
 case 52:
-#line 505 "cel.ypp"
+#line 512 "cel.ypp"
 {
 			std::cout << "[pixelSetExpression]: CUBERENDER ( ) " << std::endl;
 			
@@ -1894,7 +1901,7 @@ case 52:
 		;
     break;}
 case 53:
-#line 512 "cel.ypp"
+#line 519 "cel.ypp"
 {
 			std::cout << "[pixelSetExpression]: RENDER ( ) " << std::endl;
 			
@@ -1902,98 +1909,98 @@ case 53:
 		;
     break;}
 case 54:
-#line 518 "cel.ypp"
+#line 525 "cel.ypp"
 {
 			std::cout << "[pixelSetExpression]: SILHOUETTE ( ) " << std::endl;
 			yyval.pixelSetExpressionType = new CEL::SilhouettePixelSetExpression(yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 55:
-#line 523 "cel.ypp"
+#line 530 "cel.ypp"
 {
 			std::cout << "[expression]: COVEREDBY (  )" << std::endl;
 			yyval.pixelSetExpressionType = new CEL::CoveredByPixelSetExpression(yyvsp[-3].pixelSetExpressionType,yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 56:
-#line 529 "cel.ypp"
+#line 536 "cel.ypp"
 {
 			std::cout << "[expression]: LEFTOF (  )" << std::endl;
 			yyval.pixelSetExpressionType = new CEL::LeftOfPixelSetExpression(yyvsp[-3].pixelSetExpressionType,yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 57:
-#line 535 "cel.ypp"
+#line 542 "cel.ypp"
 {
 			std::cout << "[expression]: RIGHTOF (  )" << std::endl;
 			yyval.pixelSetExpressionType = new CEL::RightOfPixelSetExpression(yyvsp[-3].pixelSetExpressionType,yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 58:
-#line 541 "cel.ypp"
+#line 548 "cel.ypp"
 {
 			std::cout << "[expression]: ABOVEOF (  )" << std::endl;
 			yyval.pixelSetExpressionType = new CEL::AboveOfPixelSetExpression(yyvsp[-3].pixelSetExpressionType,yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 59:
-#line 547 "cel.ypp"
+#line 554 "cel.ypp"
 {
 			std::cout << "[expression]: BELOWOF (  )" << std::endl;
 			yyval.pixelSetExpressionType = new CEL::BelowOfPixelSetExpression(yyvsp[-3].pixelSetExpressionType,yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 60:
-#line 553 "cel.ypp"
+#line 560 "cel.ypp"
 {
 			std::cout << "[expression]: OVERLAP (  )" << std::endl;
 			yyval.pixelSetExpressionType = new CEL::OverlapPixelSetExpression(yyvsp[-3].pixelSetExpressionType,yyvsp[-1].pixelSetExpressionType);
 		;
     break;}
 case 61:
-#line 560 "cel.ypp"
+#line 567 "cel.ypp"
 {
 			std::cout << "[TargetExpression]: target " << std::endl;
 			yyval.targetExpressionType = yyvsp[0].targetType;
 		;
     break;}
 case 62:
-#line 564 "cel.ypp"
+#line 571 "cel.ypp"
 {
 			std::cout << "[TargetExpression]: ! targets " << std::endl;
 			yyval.targetExpressionType = new CEL::TargetNegation(yyvsp[0].targetExpressionType);
 		;
     break;}
 case 63:
-#line 570 "cel.ypp"
+#line 577 "cel.ypp"
 {
 			std::cout << "[Targets]: target " << std::endl;
 			yyval.targetExpressionType = yyvsp[0].targetType;
 		;
     break;}
 case 64:
-#line 575 "cel.ypp"
+#line 582 "cel.ypp"
 {
 			std::cout << "[Targets]: [ list of targets ] " << std::endl;
 			yyval.targetExpressionType = yyvsp[-1].vectorOfTargetsType;
 		;
     break;}
 case 65:
-#line 581 "cel.ypp"
+#line 588 "cel.ypp"
 {
 			std::cout << "[target]: \" targetname\"  " << std::endl;
 			yyval.targetType = new CEL::Target(yyvsp[-1].stringType);
 		;
     break;}
 case 66:
-#line 587 "cel.ypp"
+#line 594 "cel.ypp"
 {
 			std::cout << "[target]: RECT (  )" << std::endl;
 			yyval.targetType = new CEL::QuadFrame(yyvsp[-7].doubleType,yyvsp[-5].doubleType,yyvsp[-3].doubleType,yyvsp[-1].doubleType);
 		;
     break;}
 case 67:
-#line 592 "cel.ypp"
+#line 599 "cel.ypp"
 {
 			std::cout << "[target]: VIEWVOLUME" << std::endl;
 			yyval.targetType = new CEL::ViewVolume();
@@ -2001,14 +2008,14 @@ case 67:
 		;
     break;}
 case 68:
-#line 598 "cel.ypp"
+#line 605 "cel.ypp"
 {
 			std::cout << "[functionCall] (TargetFunction)" << std::endl;
 			yyval.targetType = new CEL::Target(yyvsp[0].callFunctionType);
 		;
     break;}
 case 69:
-#line 604 "cel.ypp"
+#line 611 "cel.ypp"
 {	
 			std::cout << "[ListOfTargets]: target  " << std::endl;
 			yyval.vectorOfTargetsType = new CEL::VectorOfTargets();
@@ -2016,7 +2023,7 @@ case 69:
 		;
     break;}
 case 70:
-#line 611 "cel.ypp"
+#line 618 "cel.ypp"
 {
 			std::cout << "[ListOfTargets]: ListOfTargets , target  " << std::endl;
 			yyvsp[-2].vectorOfTargetsType->push_back(yyvsp[0].targetType);
@@ -2024,15 +2031,21 @@ case 70:
 		;
     break;}
 case 72:
-#line 620 "cel.ypp"
+#line 627 "cel.ypp"
 {
 			std::cout << "[functionCall]: functionName  " << yyvsp[0].stringType << std::endl;
-			yyval.callFunctionType = new CEL::CallFunctionOperator(yyvsp[0].stringType);
+			
+			// a parameter of the function being declared is resolved to its slot in the frame of the call
+			CEL::Parameters::iterator it = std::find(declaredParameters.begin(), declaredParameters.end(), std::string(yyvsp[0].stringType));
+			if (it != declaredParameters.end())
+				yyval.callFunctionType = new CEL::CallFunctionOperator(yyvsp[0].stringType, it - declaredParameters.begin());
+			else
+				yyval.callFunctionType = new CEL::CallFunctionOperator(yyvsp[0].stringType);
 		
 		;
     break;}
 case 73:
-#line 626 "cel.ypp"
+#line 639 "cel.ypp"
 {
 			std::cout << "[functionCall]: functionName ( arguments )  " << yyvsp[-3].stringType << std::endl;
 			// check the # of arguments is appropriate...
@@ -2051,7 +2064,7 @@ case 73:
 				
 				for (itExp = yyvsp[-1].vectorExpressionType->begin(); itExp != yyvsp[-1].vectorExpressionType->end(); ++itExp) {
 					std::cout << "  assign the arg " << *itName << std::endl;
-					yyval.callFunctionType->assignParameterInLocalSymbolTable( (*itName) , *itExp);
+					yyval.callFunctionType->assignParameter( (*itName) , *itExp);
 					++itName;
 				}
 				std::cout << "  args assigned" << std::endl;
@@ -2061,7 +2074,7 @@ case 73:
 		;
     break;}
 case 74:
-#line 655 "cel.ypp"
+#line 668 "cel.ypp"
 {
 			std::cout << "[functionName]: FUNCTION " << std::endl;
 
@@ -2078,7 +2091,7 @@ case 74:
 		;
     break;}
 case 75:
-#line 671 "cel.ypp"
+#line 684 "cel.ypp"
 {
 			std::cout << "[list_of_rightArguments]: expression  " << std::endl;
 			yyval.vectorExpressionType = new std::vector<CEL::Expression *>();
@@ -2086,7 +2099,7 @@ case 75:
 		;
     break;}
 case 76:
-#line 677 "cel.ypp"
+#line 690 "cel.ypp"
 {
 			std::cout << "[list_of_rightArguments]: list_of_rightArguments , expression  " << std::endl;
 			yyvsp[-2].vectorExpressionType->push_back(yyvsp[0].expressionType);
@@ -2094,17 +2107,17 @@ case 76:
 		;
     break;}
 case 77:
-#line 685 "cel.ypp"
+#line 698 "cel.ypp"
 {
 		;
     break;}
 case 78:
-#line 688 "cel.ypp"
+#line 701 "cel.ypp"
 {
 		;
     break;}
 case 79:
-#line 693 "cel.ypp"
+#line 706 "cel.ypp"
 {
 			std::cout << "[evaluator]:  expression  " << std::endl;
 			CEL::CelParser::getSingletonParser()->addEvaluator(yyvsp[-1].expressionType);
@@ -2314,7 +2327,7 @@ YYLABEL(yyerrhandle)
 /* END */
 
  #line 1038 "/usr/share/bison++/bison.cc"
-#line 699 "cel.ypp"
+#line 712 "cel.ypp"
 
 
 
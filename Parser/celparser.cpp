@@ -31,6 +31,7 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include "celparser.h"
 #include "cel_yacc.h"
 #include "Ogre.h"
+#include "PixelSetPool.h"
 
 using namespace Ogre;
 
@@ -38,6 +39,49 @@ int yyparse(void);
 
 namespace CEL {
 
+// puts the rendering camera back in the pose it had when the scope began, even if an evaluation throws
+class CameraPoseScope {
+	
+	Camera *m_camera;
+	CameraPose m_pose;
+	
+public :
+	CameraPoseScope(Camera *camera) : m_camera(camera) {
+		m_pose.position = camera->getPosition();
+		m_pose.orientation = camera->getOrientation();
+		m_pose.fovY = camera->getFOVy();
+		m_pose.nearClipDistance = camera->getNearClipDistance();
+		m_pose.farClipDistance = camera->getFarClipDistance();
+	}
+	
+	~CameraPoseScope() {
+		m_camera->setPosition(m_pose.position);
+		m_camera->setOrientation(m_pose.orientation);
+		m_camera->setFOVy(m_pose.fovY);
+		m_camera->setNearClipDistance(m_pose.nearClipDistance);
+		m_camera->setFarClipDistance(m_pose.farClipDistance);
+	}
+};
+
+// shares the pixel sets and keeps the targets rendered ahead while it is in scope, 
+// and drops them at the end, even if an evaluation throws
+class SharingScope {
+	
+public :
+	SharingScope(const std::vector<Ogre::SceneNode *> &targets) {
+		if (Renderer::OgreRenderer)
+			Renderer::OgreRenderer->RenderTargets(targets);
+		
+		PixelSetExpression::beginSharing();
+	}
+	
+	~SharingScope() {
+		PixelSetExpression::endSharing();
+		
+		if (Renderer::OgreRenderer)
+			Renderer::OgreRenderer->ClearTargets();
+	}
+};
 
 
 CelParser *CelParser::m_singletonParser = NULL;
@@ -62,20 +106,119 @@ int CelParser::parseFile()
         
     int res = yyparse();
     
+    // the calls of the file evaluate the symbols they call without looking them up, 
+    // and the calls of a file that failed to parse are bound to its symbols all the same
+    CallFunctionOperator::resolveCalls(*this);
+    
     return res;
 }
 
 int CelParser::evaluate() {
-	std::vector <Expression*>::iterator it;
 	m_evaluations.clear();
-	for (it = m_celEvaluators.begin(); it != m_celEvaluators.end(); it++) {	
+	
+	// the targets rendered by the evaluators are rendered once, in a single pass,
+	// unless they are evaluated on the GPU and never read back
+	std::vector<Ogre::SceneNode *> targets;
+	if (!PixelSetExpression::gpuEvaluation() || !GpuPixelSet::isAvailable())
+		RendererPixelSetExpression::collectTargets(m_celEvaluators, targets);
+	
+	evaluateShots(targets, m_evaluations, true);
+	
+	stringstream message;
+	message << "Shared pixel sets saved " << PixelSetExpression::savedRenders() << " renders and " 
+		<< PixelSetExpression::savedOperations() << " pixel set operations";
+	LogManager::getSingleton().logMessage(message.str());
+	
+	PixelSetPool::get().logStatistics();
+	if (Renderer::OgreRenderer)
+		Renderer::OgreRenderer->getCache().logStatistics();
+}
 
+void CelParser::evaluate(const std::vector<CameraPose> &poses, std::vector< std::vector<double> > &evaluations) {
+	evaluations.assign(poses.size(), std::vector<double>());
+	
+	if (!Renderer::OgreRenderer || poses.empty())
+		return;
+	
+	Camera *camera = Renderer::OgreRenderer->getCamera();
+	
+	// the targets don't depend on the pose
+	std::vector<Ogre::SceneNode *> targets;
+	if (!PixelSetExpression::gpuEvaluation() || !GpuPixelSet::isAvailable())
+		RendererPixelSetExpression::collectTargets(m_celEvaluators, targets);
+	
+	// the camera is put back where it was once all the poses are evaluated
+	CameraPoseScope current(camera);
+	
+	int savedRenders = 0, savedOperations = 0;
+	
+	for (size_t i = 0; i < poses.size(); i++) {
+		
+		camera->setPosition(poses[i].position);
+		camera->setOrientation(poses[i].orientation);
+		camera->setFOVy(poses[i].fovY);
+		camera->setNearClipDistance(poses[i].nearClipDistance);
+		camera->setFarClipDistance(poses[i].farClipDistance);
 		
-		std::cout << std::endl << " Evaluating expression " << **it << std::endl;
-		m_evaluations.push_back((*it)->evaluate());		
+		evaluations[i].reserve(m_celEvaluators.size());
+		evaluateShots(targets, evaluations[i], false);
+		
+		savedRenders += PixelSetExpression::savedRenders();
+		savedOperations += PixelSetExpression::savedOperations();
+	}
+	
+	stringstream message;
+	message << "Evaluated " << poses.size() << " camera poses, shared pixel sets saved " << savedRenders 
+		<< " renders and " << savedOperations << " pixel set operations";
+	LogManager::getSingleton().logMessage(message.str());
+	
+	PixelSetPool::get().logStatistics();
+	if (Renderer::OgreRenderer)
+		Renderer::OgreRenderer->getCache().logStatistics();
+}
+
+void CelParser::evaluateShots(const std::vector<Ogre::SceneNode *> &targets, std::vector<double> &evaluations, bool verbose) {
+	std::vector <Expression*>::iterator it;
+	
+	// the targets left over by the single pass render while the first shots are evaluated, 
+	// and the pixel sets of identical subexpressions, even in different evaluators, are rendered once
+	SharingScope sharing(targets);
+	
+	for (it = m_celEvaluators.begin(); it != m_celEvaluators.end(); it++) {	
+
+		if (verbose)
+			std::cout << std::endl << " Evaluating expression " << **it << std::endl;
+		evaluations.push_back((*it)->evaluate());		
 	}
 }
 
+void CelParser::benchmarkShots(unsigned int nbRuns, double &compiled, double &tree) {
+	std::vector <Expression*>::iterator it;
+	
+	std::vector<Ogre::SceneNode *> targets;
+	if (!PixelSetExpression::gpuEvaluation() || !GpuPixelSet::isAvailable())
+		RendererPixelSetExpression::collectTargets(m_celEvaluators, targets);
+	
+	SharingScope sharing(targets);
+	
+	for (it = m_celEvaluators.begin(); it != m_celEvaluators.end(); it++)
+		(*it)->evaluate();
+	
+	double nbShots = std::max(1.0, double(nbRuns) * m_celEvaluators.size());
+	
+	Ogre::Timer timer;
+	for (unsigned int run = 0; run < nbRuns; run++)
+		for (it = m_celEvaluators.begin(); it != m_celEvaluators.end(); it++)
+			(*it)->evaluate();
+	compiled = timer.getMicroseconds() / nbShots;
+	
+	timer.reset();
+	for (unsigned int run = 0; run < nbRuns; run++)
+		for (it = m_celEvaluators.begin(); it != m_celEvaluators.end(); it++)
+			static_cast<CompiledExpression *>(*it)->getTree()->evaluate();
+	tree = timer.getMicroseconds() / nbShots;
+}
+
 CelParser* CelParser::getSingletonParser() {
   return m_singletonParser;
 }
@@ -83,6 +226,12 @@ CelParser* CelParser::getSingletonParser() {
 CelParser::~CelParser() 
 {    
     for_each (m_celEvaluators.begin(), m_celEvaluators.end(), deleteExpression );
+    
+    // a parser of another file may be the current one already
+    if (m_singletonParser == this)
+    	m_singletonParser = NULL;
+    if (m_globalSymbolTable == this)
+    	m_globalSymbolTable = NULL;
 }
 
 
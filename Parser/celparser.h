@@ -61,6 +61,7 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include "vectoroftargets.h"
 #include "constant.h"
 #include "quadframe.h"
+#include "compiledexpression.h"
 
 
 //enum CMPOperator;
@@ -75,6 +76,19 @@ namespace CEL {
 
 
 
+/** @brief A pose of the rendering camera, relative to its parent node if it has one. 
+    The camera shots of a CEL file are evaluated for many of them by CelParser::evaluate(poses, evaluations)
+    */
+struct CameraPose
+{
+    Ogre::Vector3	position;
+    Ogre::Quaternion	orientation;
+    Ogre::Radian	fovY;
+    Ogre::Real		nearClipDistance;
+    Ogre::Real		farClipDistance;
+};
+
+
 /** @brief The Parser class is used to parse a CEL file. A file contains one to many evaluators. 
     A vector of scalars contains the result of each evaluation
     */
@@ -82,6 +96,7 @@ namespace CEL {
 class CelParser : public SymbolTable
 {  
     std::vector <Expression*> 	m_celEvaluators;
+    CompiledFunctions		m_compiledFunctions;
     std::vector <double> 	m_evaluations;
     std::string  		m_fileName;    
     
@@ -108,11 +123,33 @@ public :
     /** evaluates the camera shots. Evaluations are placed in m_evaluations */
     int evaluate();
     
+    /** evaluates the camera shots for each pose of the rendering camera, which is put back where 
+    	it was afterwards. The parsed file, the targets to render and the buffers of the renderer are 
+    	set up once for all the poses.
+    	@param poses : the poses of the rendering camera
+    	@param evaluations : one row per pose, holding the evaluation of each camera shot as m_evaluations does
+    	*/
+    void evaluate(const std::vector<CameraPose> &poses, std::vector< std::vector<double> > &evaluations);
+    
+    /** evaluates the pixel set expressions on the GPU when it can, see GpuPixelSet. 
+    	Only the measures of the pixel sets are read back then, the pixel sets never are
+    	@param gpu : true to evaluate on the GPU, false (the default) to read the renders back
+    	*/
+    void setGpuEvaluation(bool gpu) { PixelSetExpression::setGpuEvaluation(gpu); }
+    
     unsigned int getNbEvaluators();
     
     const std::vector<double> &getEvaluations ();
     
-    void addEvaluator(Expression *e) {m_celEvaluators.push_back(e);};
+    /** times the camera shots run as bytecode against the walk of their trees. The pixel sets are 
+    	rendered by a first evaluation and shared by the nbRuns evaluations timed each way
+    	@param compiled : the microseconds per camera shot run as bytecode
+    	@param tree : the microseconds per camera shot walking its tree
+    	*/
+    void benchmarkShots(unsigned int nbRuns, double &compiled, double &tree);
+    
+    /** adds a camera shot, compiled to bytecode with the functions it calls, see CompiledExpression */
+    void addEvaluator(Expression *e) {m_celEvaluators.push_back(new CompiledExpression(e, &m_compiledFunctions));};
     
     void setCurrentInputFile(const std::string &s);
     
@@ -121,6 +158,14 @@ public :
     static CelParser* getSingletonParser();	
     
 	void printEvaluations();
+	
+private :
+	
+	/** renders the targets ahead, then evaluates each camera shot into evaluations, sharing 
+		the pixel sets between them
+		@param verbose : prints each camera shot as it is evaluated
+		*/
+	void evaluateShots(const std::vector<Ogre::SceneNode *> &targets, std::vector<double> &evaluations, bool verbose);
             
 };
 
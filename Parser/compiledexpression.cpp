@@ -0,0 +1,355 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#include "compiledexpression.h"
+#include "basetype.h"
+#include "mathoperator.h"
+#include "comparisionoperator.h"
+#include "conditionaloperator.h"
+#include "tointoperator.h"
+#include "pixelsetoperator.h"
+#include "count.h"
+#include "minmaxpixelsetoperator.h"
+
+namespace CEL {
+
+CompiledFunctions::~CompiledFunctions() {
+	
+	std::map<Expression *, CompiledExpression *>::iterator it;
+	for (it = m_bodies.begin(); it != m_bodies.end(); ++it)
+		delete it->second;
+}
+
+CompiledExpression *CompiledFunctions::get(Expression *body) {
+	
+	std::map<Expression *, CompiledExpression *>::iterator it = m_bodies.find(body);
+	if (it != m_bodies.end())
+		return it->second;
+	
+	// the functions called by the body are compiled as well, before it is registered
+	CompiledExpression *compiled = new CompiledExpression(body, this, false);
+	m_bodies[body] = compiled;
+	
+	return compiled;
+}
+
+CompiledExpression::CompiledExpression(Expression *tree, CompiledFunctions *functions, bool ownsTree) 
+	: m_tree(tree), m_ownsTree(ownsTree), m_functions(functions) {
+	
+	compile(m_tree, 0);
+	
+	if (m_registers.empty())
+		m_registers.resize(1);
+}
+
+CompiledExpression::~CompiledExpression() {
+	
+	if (m_ownsTree)
+		delete m_tree;
+}
+
+int CompiledExpression::emit(Opcode opcode, int target, int a, int b) {
+	
+	Instruction instruction;
+	instruction.opcode = opcode;
+	instruction.target = target;
+	instruction.a = a;
+	instruction.b = b;
+	
+	m_code.push_back(instruction);
+	
+	// the instructions write their target and read registers below it, or above it 
+	// once their operands were compiled there
+	if ((int)m_registers.size() <= target)
+		m_registers.resize(target + 1);
+	
+	return m_code.size() - 1;
+}
+
+void CompiledExpression::compile(Expression *e, int target) {
+	
+	if (BaseType *constant = dynamic_cast<BaseType *>(e)) {
+		m_constants.push_back(constant->evaluate());
+		emit(OP_CONSTANT, target, m_constants.size() - 1);
+		return;
+	}
+	
+	if (MathOperator *math = dynamic_cast<MathOperator *>(e)) {
+		
+		MathOperator::MathOperatorType type = math->getType();
+		
+		bool binary = type == MathOperator::MATH_PLUS || type == MathOperator::MATH_MINUS || 
+			type == MathOperator::MATH_MULTIPLICATION || type == MathOperator::MATH_DIVISION || 
+			type == MathOperator::MATH_ATAN2;
+		
+		if (type == MathOperator::MATH_POWER) {
+			// not implemented by the tree either
+			m_constants.push_back(INFINITY);
+			emit(OP_CONSTANT, target, m_constants.size() - 1);
+			return;
+		}
+		
+		if (math->size() >= (binary ? 2u : 1u)) {
+			
+			compile((*math)[0], target);
+			if (binary)
+				compile((*math)[1], target + 1);
+			
+			switch (type) {
+				case MathOperator::MATH_UNARY_MINUS: emit(OP_NEGATE, target, target); break;
+				case MathOperator::MATH_UNARY_PLUS: break;
+				case MathOperator::MATH_PLUS: emit(OP_ADD, target, target, target + 1); break;
+				case MathOperator::MATH_MINUS: emit(OP_SUBTRACT, target, target, target + 1); break;
+				case MathOperator::MATH_MULTIPLICATION: emit(OP_MULTIPLY, target, target, target + 1); break;
+				case MathOperator::MATH_DIVISION: emit(OP_DIVIDE, target, target, target + 1); break;
+				case MathOperator::MATH_SQRT: emit(OP_SQRT, target, target); break;
+				case MathOperator::MATH_SQR: emit(OP_MULTIPLY, target, target, target); break;
+				case MathOperator::MATH_SIN: emit(OP_SIN, target, target); break;
+				case MathOperator::MATH_COS: emit(OP_COS, target, target); break;
+				case MathOperator::MATH_TAN: emit(OP_TAN, target, target); break;
+				case MathOperator::MATH_ASIN: emit(OP_ASIN, target, target); break;
+				case MathOperator::MATH_ACOS: emit(OP_ACOS, target, target); break;
+				case MathOperator::MATH_ATAN: emit(OP_ATAN, target, target); break;
+				case MathOperator::MATH_ATAN2: emit(OP_ATAN2, target, target, target + 1); break;
+				case MathOperator::MATH_EXP: emit(OP_EXP, target, target); break;
+				case MathOperator::MATH_POWER: break;
+			}
+			return;
+		}
+	}
+	
+	if (ComparisonOperator *comparison = dynamic_cast<ComparisonOperator *>(e)) {
+		
+		bool interval = comparison->m_type == ComparisonOperator::IN || comparison->m_type == ComparisonOperator::OUT;
+		
+		if (comparison->size() >= (interval ? 3u : 2u)) {
+			
+			compile((*comparison)[0], target);
+			compile((*comparison)[1], target + 1);
+			
+			switch (comparison->m_type) {
+				case ComparisonOperator::EQ: emit(OP_EQ, target, target, target + 1); break;
+				case ComparisonOperator::GEQ: emit(OP_GEQ, target, target, target + 1); break;
+				case ComparisonOperator::LEQ: emit(OP_LEQ, target, target, target + 1); break;
+				case ComparisonOperator::GREATER: emit(OP_GREATER, target, target, target + 1); break;
+				case ComparisonOperator::LOWER: emit(OP_LOWER, target, target, target + 1); break;
+				case ComparisonOperator::DIFFERENT: emit(OP_DIFFERENT, target, target, target + 1); break;
+				
+				// e IN [min, max] is e >= min && e <= max, e OUT [min, max] is e <= min || e >= max
+				case ComparisonOperator::IN:
+					compile((*comparison)[2], target + 2);
+					emit(OP_GEQ, target + 1, target, target + 1);
+					emit(OP_LEQ, target + 2, target, target + 2);
+					emit(OP_AND, target, target + 1, target + 2);
+					break;
+				case ComparisonOperator::OUT:
+					compile((*comparison)[2], target + 2);
+					emit(OP_LEQ, target + 1, target, target + 1);
+					emit(OP_GEQ, target + 2, target, target + 2);
+					emit(OP_OR, target, target + 1, target + 2);
+					break;
+			}
+			return;
+		}
+	}
+	
+	if (ConditionalOperator *conditional = dynamic_cast<ConditionalOperator *>(e)) {
+		
+		if (conditional->size() >= 3) {
+			
+			compile((*conditional)[0], target);
+			int jumpToElse = emit(OP_JUMP_UNLESS_ONE, target, target);
+			
+			compile((*conditional)[1], target);
+			int jumpToEnd = emit(OP_JUMP, target);
+			
+			m_code[jumpToElse].b = m_code.size();
+			compile((*conditional)[2], target);
+			
+			m_code[jumpToEnd].a = m_code.size();
+			return;
+		}
+	}
+	
+	if (ToIntOperator *toInt = dynamic_cast<ToIntOperator *>(e)) {
+		
+		if (toInt->size() >= 1) {
+			compile((*toInt)[0], target);
+			emit(OP_TO_INT, target, target);
+			return;
+		}
+	}
+	
+	if (PixelSetOperator *pixelSetOperator = dynamic_cast<PixelSetOperator *>(e)) {
+		
+		bool measured = true;
+		PixelSetExpression::Measure measure = PixelSetExpression::COUNT;
+		
+		if (dynamic_cast<CountPixelSetOperator *>(e))
+			measure = PixelSetExpression::COUNT;
+		else if (dynamic_cast<MinXPixelSetOperator *>(e))
+			measure = PixelSetExpression::MIN_X;
+		else if (dynamic_cast<MaxXPixelSetOperator *>(e))
+			measure = PixelSetExpression::MAX_X;
+		else if (dynamic_cast<MinYPixelSetOperator *>(e))
+			measure = PixelSetExpression::MIN_Y;
+		else if (dynamic_cast<MaxYPixelSetOperator *>(e))
+			measure = PixelSetExpression::MAX_Y;
+		else
+			measured = false;
+		
+		if (measured) {
+			m_pixelSets.push_back(pixelSetOperator->getPixelSetExpression());
+			emit(OP_MEASURE, target, m_pixelSets.size() - 1, measure);
+			return;
+		}
+	}
+	
+	if (CallFunctionOperator *call = dynamic_cast<CallFunctionOperator *>(e)) {
+		
+		if (call->isParameter()) {
+			m_parameters.push_back(call);
+			emit(OP_PARAMETER, target, m_parameters.size() - 1);
+			return;
+		}
+		
+		// the function is looked up and compiled when it is first called, as the tree 
+		// would, since its symbol may be declared after the file is parsed
+		if (m_functions) {
+			for (size_t i = 0; i < call->size(); i++)
+				compile((*call)[i], target + i);
+			
+			Call compiled = { call, NULL };
+			m_calls.push_back(compiled);
+			emit(OP_CALL, target, m_calls.size() - 1);
+			return;
+		}
+	}
+	
+	// anything else is evaluated as a tree
+	m_trees.push_back(e);
+	emit(OP_EVALUATE, target, m_trees.size() - 1);
+}
+
+double CompiledExpression::evaluate() {
+	
+	double *r = &m_registers[0];
+	const Instruction *code = &m_code[0];
+	const Instruction *end = code + m_code.size();
+	
+	for (const Instruction *i = code; i != end; ) {
+		
+		switch (i->opcode) {
+			case OP_CONSTANT: r[i->target] = m_constants[i->a]; break;
+			case OP_EVALUATE: r[i->target] = m_trees[i->a]->evaluate(); break;
+			case OP_MEASURE: r[i->target] = m_pixelSets[i->a]->measure((PixelSetExpression::Measure)i->b); break;
+			
+			case OP_CALL: {
+				Call &call = m_calls[i->a];
+				if (!call.body)
+					call.body = m_functions->get(call.call->getBinding());
+				r[i->target] = call.call->call(call.body, r + i->target);
+				break;
+			}
+			
+			case OP_PARAMETER: r[i->target] = m_parameters[i->a]->argument(); break;
+			case OP_NEGATE: r[i->target] = -r[i->a]; break;
+			case OP_ADD: r[i->target] = r[i->a] + r[i->b]; break;
+			case OP_SUBTRACT: r[i->target] = r[i->a] - r[i->b]; break;
+			case OP_MULTIPLY: r[i->target] = r[i->a] * r[i->b]; break;
+			case OP_DIVIDE: r[i->target] = r[i->a] / r[i->b]; break;
+			case OP_SQRT: r[i->target] = sqrt(r[i->a]); break;
+			case OP_SIN: r[i->target] = sin(r[i->a]); break;
+			case OP_COS: r[i->target] = cos(r[i->a]); break;
+			case OP_TAN: r[i->target] = tan(r[i->a]); break;
+			case OP_ASIN: r[i->target] = asin(r[i->a]); break;
+			case OP_ACOS: r[i->target] = acos(r[i->a]); break;
+			case OP_ATAN: r[i->target] = atan(r[i->a]); break;
+			case OP_ATAN2: r[i->target] = atan2(r[i->a], r[i->b]); break;
+			case OP_EXP: r[i->target] = exp(r[i->a]); break;
+			case OP_TO_INT: r[i->target] = (int)r[i->a]; break;
+			case OP_EQ: r[i->target] = r[i->a] == r[i->b]; break;
+			case OP_GEQ: r[i->target] = r[i->a] >= r[i->b]; break;
+			case OP_LEQ: r[i->target] = r[i->a] <= r[i->b]; break;
+			case OP_GREATER: r[i->target] = r[i->a] > r[i->b]; break;
+			case OP_LOWER: r[i->target] = r[i->a] < r[i->b]; break;
+			case OP_DIFFERENT: r[i->target] = r[i->a] != r[i->b]; break;
+			case OP_AND: r[i->target] = r[i->a] && r[i->b]; break;
+			case OP_OR: r[i->target] = r[i->a] || r[i->b]; break;
+			
+			case OP_JUMP: 
+				i = code + i->a; 
+				continue;
+			
+			case OP_JUMP_UNLESS_ONE: 
+				if (r[i->a] != 1.0) {
+					i = code + i->b;
+					continue;
+				}
+				break;
+		}
+		
+		i++;
+	}
+	
+	return r[0];
+}
+
+std::ostream& CompiledExpression::printBytecode(std::ostream &os) {
+	
+	static const char *names[] = {
+		"constant", "evaluate", "measure", "call", "parameter", "negate", "add", "subtract", "multiply", "divide", 
+		"sqrt", "sin", "cos", "tan", "asin", "acos", "atan", "atan2", "exp", "toInt", 
+		"eq", "geq", "leq", "greater", "lower", "different", "and", "or", "jump", "jumpUnlessOne"
+	};
+	
+	for (size_t i = 0; i < m_code.size(); i++) {
+		const Instruction &instruction = m_code[i];
+		
+		os << i << "\t" << names[instruction.opcode] << "\t";
+		
+		switch (instruction.opcode) {
+			case OP_CONSTANT: os << "r" << instruction.target << ", " << m_constants[instruction.a]; break;
+			case OP_EVALUATE: os << "r" << instruction.target << ", " << *m_trees[instruction.a]; break;
+			case OP_MEASURE: os << "r" << instruction.target << ", " << *m_pixelSets[instruction.a] << ", " << instruction.b; break;
+			case OP_CALL: os << "r" << instruction.target << ", " << m_calls[instruction.a].call->getFunctionName() << ", " << m_calls[instruction.a].call->size(); break;
+			case OP_PARAMETER: os << "r" << instruction.target << ", " << m_parameters[instruction.a]->getFunctionName(); break;
+			case OP_JUMP: os << instruction.a; break;
+			case OP_JUMP_UNLESS_ONE: os << "r" << instruction.a << ", " << instruction.b; break;
+			default: os << "r" << instruction.target << ", r" << instruction.a << ", r" << instruction.b; break;
+		}
+		
+		os << std::endl;
+	}
+	
+	return os;
+}
+
+}
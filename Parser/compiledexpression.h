@@ -0,0 +1,173 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#include <math.h>
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+#include <map>
+
+#include "expression.h"
+#include "pixelsetexpression.h"
+#include "callfunction.h"
+
+#ifndef COMPILEDEXPRESSION_HH
+#define COMPILEDEXPRESSION_HH
+
+namespace CEL {
+
+class CompiledExpression;
+
+/** the bodies of the functions called by the compiled expressions of a parser, each compiled 
+    once for all the calls to it. The bodies belong to the symbol table, their bytecode here.
+    */
+class CompiledFunctions
+{
+
+public :
+    CompiledFunctions() {}
+    ~CompiledFunctions();
+    
+    // the bytecode of the body, compiled the first time it is called
+    CompiledExpression *get(Expression *body);
+    
+private :
+    CompiledFunctions(const CompiledFunctions &);
+    CompiledFunctions &operator=(const CompiledFunctions &);
+    
+    std::map<Expression *, CompiledExpression *> m_bodies;
+};
+
+/** an expression compiled from its syntaxic tree into a linear bytecode, run by a loop over
+    a register file instead of a recursive walk of the tree.
+    Scalars, math, comparisons and conditionals are opcodes, and so are the measures of pixel 
+    sets (Count, MinX...), which go through PixelSetExpression::measure() so that pixel sets are 
+    still shared, counted without rendering or evaluated on the GPU. The other nodes are evaluated 
+    as trees by an opcode of their own.
+    A call evaluates its arguments into the registers it returns its result in, then runs the 
+    compiled body of the function in a frame whose parameters load the arguments from there. The 
+    arguments are thus evaluated once, before the call, rather than each time a parameter is. 
+    A register file isn't reentrant, which is safe since a function is declared before the 
+    functions calling it and can't be called while its body runs.
+    */
+class CompiledExpression : public Expression
+{
+
+public :
+    // compiles the tree, which is owned by the compiled expression from now on unless told 
+    // otherwise. The functions it calls are compiled into functions, and evaluated as trees 
+    // without them
+    CompiledExpression(Expression *tree, CompiledFunctions *functions = NULL, bool ownsTree = true);
+    virtual ~CompiledExpression();
+    
+    // runs the bytecode, with the same result as the tree
+    virtual double evaluate();
+    
+    Expression *getTree() { return m_tree; }
+    
+    std::ostream& print(std::ostream &os) {
+    	return m_tree->print(os);
+    }
+    
+    // prints the bytecode, an instruction per line
+    std::ostream& printBytecode(std::ostream &os);
+    
+private :
+	
+	enum Opcode {
+		OP_CONSTANT,		// r[target] = constants[a]
+		OP_EVALUATE,		// r[target] = trees[a]->evaluate()
+		OP_MEASURE,			// r[target] = pixelSets[a]->measure(b)
+		OP_CALL,			// r[target] = calls[a](r[target], ..., r[target + n - 1])
+		OP_PARAMETER,		// r[target] = the argument of parameters[a] in the current frame
+		OP_NEGATE,
+		OP_ADD,
+		OP_SUBTRACT,
+		OP_MULTIPLY,
+		OP_DIVIDE,
+		OP_SQRT,
+		OP_SIN,
+		OP_COS,
+		OP_TAN,
+		OP_ASIN,
+		OP_ACOS,
+		OP_ATAN,
+		OP_ATAN2,
+		OP_EXP,
+		OP_TO_INT,
+		OP_EQ,
+		OP_GEQ,
+		OP_LEQ,
+		OP_GREATER,
+		OP_LOWER,
+		OP_DIFFERENT,
+		OP_AND,
+		OP_OR,
+		OP_JUMP,			// goes to instruction a
+		OP_JUMP_UNLESS_ONE	// goes to instruction b unless r[a] is 1.0, as ConditionalOperator tests
+	};
+	
+	// operates on registers r[a], r[b] into r[target] unless told otherwise above
+	struct Instruction {
+		Opcode opcode;
+		int target, a, b;
+	};
+	
+	// appends the code evaluating the expression into r[target], using the registers after it 
+	// as temporaries
+	void compile(Expression *e, int target);
+	
+	// appends an instruction, returns its index
+	int emit(Opcode opcode, int target, int a = 0, int b = 0);
+	
+	// a call and the bytecode of the function it calls, compiled once it is called
+	struct Call {
+		CallFunctionOperator *call;
+		CompiledExpression *body;
+	};
+	
+	Expression *m_tree;
+	bool m_ownsTree;
+	CompiledFunctions *m_functions;
+	
+	std::vector<Instruction> m_code;
+	std::vector<double> m_constants;
+	std::vector<Expression *> m_trees;
+	std::vector<PixelSetExpression *> m_pixelSets;
+	std::vector<Call> m_calls;
+	std::vector<CallFunctionOperator *> m_parameters;
+	
+	// the register file, r[0] holds the result
+	std::vector<double> m_registers;
+ 
+};
+
+}
+#endif
@@ -60,18 +60,10 @@ public :
     };
         
         
-    // counts the number of pixels in the expression
+    // counts the number of pixels in the expression, without reading back renders when possible
     virtual double evaluate() {
     	
-    	PixelSet *pixelSet = m_pixelSetExpression->render();
-    			
-		double result = pixelSet->Count();
-		
-		delete pixelSet;
-		
-		std::cout << "Count returns " << result << std::endl;
-
-    	return result;
+    	return m_pixelSetExpression->count();
     }
 
   	std::ostream& print(std::ostream &os) {
@@ -54,18 +54,48 @@ public :
     
     virtual PixelSet *render() {
     	
-    	PixelSet *leftPixelSet = m_leftPixelSet->render();
-    	PixelSet *rightPixelSet = m_rightPixelSet->render();
+    	PixelSet *leftPixelSet = m_leftPixelSet->share();
+    	PixelSet *rightPixelSet = m_rightPixelSet->share();
 		
 		PixelSet *result = leftPixelSet->CoveredBy(rightPixelSet);
 
-		delete leftPixelSet;
-		delete rightPixelSet;
+		PixelSetExpression::release(leftPixelSet);
+		PixelSetExpression::release(rightPixelSet);
 		
     	return result;
     	
     }    
  
+	// the same operation on the GPU, when it can evaluate both operands
+	GpuPixelSet *renderOnGpu() {
+		
+		GpuPixelSet *left = m_leftPixelSet->renderOnGpu();
+		if (!left)
+			return NULL;
+		
+		GpuPixelSet *right = m_rightPixelSet->renderOnGpu();
+		if (!right) {
+			delete left;
+			return NULL;
+		}
+		
+		GpuPixelSet *result = left->CoveredBy(right);
+		
+		delete left;
+		delete right;
+		
+		return result;
+	}
+
+	void getOperands(std::vector<PixelSetExpression *> &operands) {
+		operands.push_back(m_leftPixelSet);
+		operands.push_back(m_rightPixelSet);
+	}
+
+	std::string signature() {
+		return "CoveredBy(" + m_leftPixelSet->signature() + "," + m_rightPixelSet->signature() + ")";
+	}
+
 	std::ostream& print(std::ostream &os) {
 		os << "CoveredBy(" << *m_leftPixelSet << "," << *m_rightPixelSet << ")";
 		return os;
@@ -50,6 +50,12 @@ class CoveredByPixelSetOperator : public PixelSetOperator
 
 public :
     CoveredByPixelSetOperator(PixelSetExpression *l, PixelSetExpression *r) : m_leftPixelSet(l), m_rightPixelSet(r) {};
+    
+    // both operands, there is no single pixel set expression
+    void getOperands(std::vector<PixelSetExpression *> &operands) {
+		operands.push_back(m_leftPixelSet);
+		operands.push_back(m_rightPixelSet);
+    }
         
         
     // counts the number of pixels in the expression
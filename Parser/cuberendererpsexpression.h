@@ -63,22 +63,33 @@ public :
 
 		m_targetExpression->visit(visitor);
 
-		const std::vector<std::string> & vec = visitor.getVectorOfTargets();
+		const std::vector<Ogre::SceneNode *> & vec = visitor.getNodes();
 		
 		bool negated = visitor.isNegated();
 		
-		int i = vec.size();
-		
-		// perform the rendering
-    	return Renderer::OgreRenderer->CubeRender(vec[0], negated ? ALL_BUT_NODE : NODE );
+		// perform the rendering, with the rendering camera
+    	return Renderer::OgreRenderer->CubeRender(vec[0], Renderer::OgreRenderer->getCamera(), negated ? ALL_BUT_NODE : NODE );
 		
     }
 
+	std::string signature() {
+		
+		CELTargetExpressionVisitor visitor;
+
+		m_targetExpression->visit(visitor);
+		
+		return std::string(visitor.isNegated() ? "CR(!" : "CR(") + visitor.getNodes()[0]->getName() + ")";
+	}
+
 	std::ostream& print(std::ostream &os) {
 		os << "CR(" << *m_targetExpression << ")";
 		return os;
 	}
 
+protected :
+
+	bool isRender() { return true; }
+
  
 };
 
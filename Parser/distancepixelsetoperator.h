@@ -50,18 +50,24 @@ class DistancePixelSetOperator : public PixelSetOperator
 
 public :
     DistancePixelSetOperator(PixelSetExpression *l, PixelSetExpression *r) : m_leftPixelSet(l), m_rightPixelSet(r) {};
+    
+    // both operands, there is no single pixel set expression
+    void getOperands(std::vector<PixelSetExpression *> &operands) {
+		operands.push_back(m_leftPixelSet);
+		operands.push_back(m_rightPixelSet);
+    }
         
         
     // counts the number of pixels in the expression
     virtual double evaluate() {
     	
-    	PixelSet *leftPixelSet = m_leftPixelSet->render();
-    	PixelSet *rightPixelSet = m_rightPixelSet->render();
+    	PixelSet *leftPixelSet = m_leftPixelSet->share();
+    	PixelSet *rightPixelSet = m_rightPixelSet->share();
     	    	
 		float result = leftPixelSet->Distance( rightPixelSet );
 		
-		delete leftPixelSet;
-		delete rightPixelSet;
+		PixelSetExpression::release(leftPixelSet);
+		PixelSetExpression::release(rightPixelSet);
 		
     	return  result;  
 	}    
@@ -67,6 +67,8 @@ public :
     MathOperator(MathOperatorType m) : m_type(m)  {
         
     };
+    
+    MathOperatorType getType() const { return m_type; }
         
     virtual double evaluate() {
     	switch (m_type) {
@@ -53,13 +53,7 @@ public :
     // counts the number of pixels in the expression
     virtual double evaluate() {
     	
-    	PixelSet *pixelSet = m_pixelSetExpression->render();
-    	
-		double result = pixelSet->Max_x();
-		
-		delete pixelSet;
-		
-    	return result;
+    	return m_pixelSetExpression->measure(PixelSetExpression::MAX_X);
     }    
 
  	std::ostream& print(std::ostream &os) {
@@ -84,13 +78,7 @@ public :
     // counts the number of pixels in the expression
     virtual double evaluate() {
     	
-    	PixelSet *pixelSet = m_pixelSetExpression->render();
-
-		double result = pixelSet->Max_y();
-		
-		delete pixelSet;
-		
-    	return result;
+    	return m_pixelSetExpression->measure(PixelSetExpression::MAX_Y);
     }    
 
 	std::ostream& print(std::ostream &os) {
@@ -115,14 +103,7 @@ public :
     // counts the number of pixels in the expression
     virtual double evaluate() {
     	
-    	PixelSet *pixelSet = m_pixelSetExpression->render();
-    	
-
-		double result = pixelSet->Min_x();
-		
-		delete pixelSet;
-		
-    	return result;
+    	return m_pixelSetExpression->measure(PixelSetExpression::MIN_X);
     }    
 
 	std::ostream& print(std::ostream &os) {
@@ -147,14 +128,7 @@ public :
     // counts the number of pixels in the expression
     virtual double evaluate() {
     	
-    	PixelSet *pixelSet = m_pixelSetExpression->render();
-    	
-
-		double result = pixelSet->Min_y();
-		
-		delete pixelSet;
-		
-    	return result;
+    	return m_pixelSetExpression->measure(PixelSetExpression::MIN_Y);
     }
 
 	std::ostream& print(std::ostream &os) {
@@ -35,6 +35,7 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include <string>
 
 #include "pixelsetexpression.h"
+#include "rendererpsexpression.h"
 
 #ifndef OVERLAPPIXELSETEXPRESSION_HH
 #define OVERLAPPIXELSETEXPRESSION_HH
@@ -55,21 +56,81 @@ public :
     // counts the number of pixels in the expression
     virtual PixelSet* render() {
     	
-    	PixelSet *leftPixelSet = m_leftPixelSet->render();
-    	PixelSet *rightPixelSet = m_rightPixelSet->render();
+    	PixelSet *leftPixelSet = m_leftPixelSet->share();
+    	PixelSet *rightPixelSet = m_rightPixelSet->share();
     	    	    	    	
 		PixelSet *result = leftPixelSet->Overlap(rightPixelSet);
 
-		delete leftPixelSet;
-		delete rightPixelSet;
+		PixelSetExpression::release(leftPixelSet);
+		PixelSetExpression::release(rightPixelSet);
 		
     	return result;
     }    
 
+ 	// the same operation on the GPU, when it can evaluate both operands
+ 	GpuPixelSet *renderOnGpu() {
+ 		
+ 		GpuPixelSet *left = m_leftPixelSet->renderOnGpu();
+ 		if (!left)
+ 			return NULL;
+ 		
+ 		GpuPixelSet *right = m_rightPixelSet->renderOnGpu();
+ 		if (!right) {
+ 			delete left;
+ 			return NULL;
+ 		}
+ 		
+ 		GpuPixelSet *result = left->Overlap(right);
+ 		
+ 		delete left;
+ 		delete right;
+ 		
+ 		return result;
+ 	}
+
+	void getOperands(std::vector<PixelSetExpression *> &operands) {
+		operands.push_back(m_leftPixelSet);
+		operands.push_back(m_rightPixelSet);
+	}
+
+ 	std::string signature() {
+ 		return "Overlap(" + m_leftPixelSet->signature() + "," + m_rightPixelSet->signature() + ")";
+ 	}
+
  	std::ostream& print(std::ostream &os) {
 		os << "Overlap(" << *m_leftPixelSet << "," << *m_rightPixelSet << ")";
 		return os;
 	}
+	
+protected :
+	
+	// the overlap of two renders of targets is counted from the renders of the targets, 
+	// and from the render of all of them, which covers the pixels of both: 
+	// Count(Overlap(R(a), R(b))) = Count(R(a)) + Count(R(b)) - Count(R(a, b))
+	bool countWithoutRendering(double &result) {
+		
+		RendererPixelSetExpression *left = dynamic_cast<RendererPixelSetExpression *>(m_leftPixelSet);
+		RendererPixelSetExpression *right = dynamic_cast<RendererPixelSetExpression *>(m_rightPixelSet);
+		
+		// when both are rendered already, the overlap is cheaper than another render
+		if (!left || !right || (left->isShared() && right->isShared()))
+			return false;
+		
+		bool leftNegated, rightNegated;
+		const std::vector<Ogre::SceneNode *> &leftNodes = left->getNodes(leftNegated);
+		const std::vector<Ogre::SceneNode *> &rightNodes = right->getNodes(rightNegated);
+		
+		if (leftNegated || rightNegated)
+			return false;
+		
+		std::vector<Ogre::SceneNode *> targets = leftNodes;
+		for (size_t i = 0; i < rightNodes.size(); i++)
+			if (std::find(targets.begin(), targets.end(), rightNodes[i]) == targets.end())
+				targets.push_back(rightNodes[i]);
+		
+		result = left->count() + right->count() - Renderer::OgreRenderer->Count(targets, NODE);
+		return true;
+	}
  
 };
 
@@ -0,0 +1,151 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+#include "pixelsetexpression.h"
+
+namespace CEL {
+
+bool PixelSetExpression::s_sharing = false;
+std::map<std::string, PixelSetExpression::SharedPixelSet> PixelSetExpression::s_shared;
+std::set<PixelSet *> PixelSetExpression::s_sharedPixelSets;
+
+int PixelSetExpression::s_renders = 0;
+int PixelSetExpression::s_operations = 0;
+int PixelSetExpression::s_savedRenders = 0;
+int PixelSetExpression::s_savedOperations = 0;
+
+bool PixelSetExpression::s_gpuEvaluation = false;
+
+PixelSet *PixelSetExpression::share() {
+	
+	if (!s_sharing)
+		return render();
+	
+	std::string key = signature();
+	
+	std::map<std::string, SharedPixelSet>::iterator it = s_shared.find(key);
+	if (it != s_shared.end()) {
+		// all the work under this expression is saved
+		s_savedRenders += it->second.renders;
+		s_savedOperations += it->second.operations;
+		return it->second.pixelSet;
+	}
+	
+	int renders = s_renders, operations = s_operations;
+	
+	PixelSet *pixelSet = render();
+	
+	if (isRender())
+		s_renders++;
+	else
+		s_operations++;
+	
+	SharedPixelSet shared;
+	shared.pixelSet = pixelSet;
+	shared.renders = s_renders - renders;
+	shared.operations = s_operations - operations;
+	
+	s_shared[key] = shared;
+	s_sharedPixelSets.insert(pixelSet);
+	
+	return pixelSet;
+}
+
+double PixelSetExpression::measure(Measure what) {
+	
+	double result = 0;
+	
+	if (!isShared()) {
+		
+		if (s_gpuEvaluation) {
+			GpuPixelSet *gpuPixelSet = renderOnGpu();
+			
+			if (gpuPixelSet) {
+				switch (what) {
+					case COUNT: result = gpuPixelSet->Count(); break;
+					case MIN_X: result = gpuPixelSet->Min_x(); break;
+					case MAX_X: result = gpuPixelSet->Max_x(); break;
+					case MIN_Y: result = gpuPixelSet->Min_y(); break;
+					case MAX_Y: result = gpuPixelSet->Max_y(); break;
+				}
+				delete gpuPixelSet;
+				return result;
+			}
+		}
+		
+		if (what == COUNT && countWithoutRendering(result))
+			return result;
+	}
+	
+	PixelSet *pixelSet = share();
+	switch (what) {
+		case COUNT: result = pixelSet->Count(); break;
+		case MIN_X: result = pixelSet->Min_x(); break;
+		case MAX_X: result = pixelSet->Max_x(); break;
+		case MIN_Y: result = pixelSet->Min_y(); break;
+		case MAX_Y: result = pixelSet->Max_y(); break;
+	}
+	release(pixelSet);
+	
+	return result;
+}
+
+bool PixelSetExpression::isShared() {
+	
+	return s_sharing && s_shared.find(signature()) != s_shared.end();
+}
+
+void PixelSetExpression::release(PixelSet *pixelSet) {
+	
+	if (s_sharedPixelSets.find(pixelSet) == s_sharedPixelSets.end())
+		pixelSet->Release();
+}
+
+void PixelSetExpression::beginSharing() {
+	
+	endSharing();
+	
+	s_sharing = true;
+	s_renders = s_operations = 0;
+	s_savedRenders = s_savedOperations = 0;
+}
+
+void PixelSetExpression::endSharing() {
+	
+	std::set<PixelSet *>::iterator it;
+	for (it = s_sharedPixelSets.begin(); it != s_sharedPixelSets.end(); ++it)
+		(*it)->Release();
+	
+	s_shared.clear();
+	s_sharedPixelSets.clear();
+	s_sharing = false;
+}
+
+}
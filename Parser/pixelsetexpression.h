@@ -32,7 +32,13 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include <iostream>
 #include <stdlib.h>
 
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+
 #include <Renderer.h>
+#include <GpuPixelSet.h>
 
 #ifndef PIXELSETEXPRESSION_HH
 #define PIXELSETEXPRESSION_HH
@@ -49,6 +55,52 @@ public :
     virtual ~PixelSetExpression() {}
     
     virtual PixelSet  *render() = 0;    
+    
+    // describes the pixel set rendered by the expression, with the symbols bound as they are now:
+    // two expressions with the same signature render the same pixel set during an evaluation
+    virtual std::string signature() = 0;
+    
+    // appends the pixel set expressions the expression operates on, none for a render
+    virtual void getOperands(std::vector<PixelSetExpression *> &operands) {}
+    
+    // renders the pixel set, or returns the one rendered by an expression with the same signature 
+    // since beginSharing(). The result must be given back with release(), never deleted.
+    PixelSet *share();
+    
+    // gives back a pixel set returned by share(), releasing it unless it is shared, see PixelSet::Release
+    static void release(PixelSet *pixelSet);
+    
+    // the scalars measured on pixel sets by the operators
+    enum Measure { COUNT, MIN_X, MAX_X, MIN_Y, MAX_Y };
+    
+    // measures the pixel set: the shared pixel set if there is one, otherwise on the GPU 
+    // if it evaluates expressions and the expression can, without rendering it if the 
+    // expression can count so, with share() if it can't
+    double measure(Measure what);
+    
+    // counts the pixels of the pixel set, same as measure(COUNT)
+    double count() { return measure(COUNT); }
+    
+    // renders the pixel set into a GpuPixelSet, to be deleted by the caller, 
+    // or returns NULL if the expression, or the GPU, can't
+    virtual GpuPixelSet *renderOnGpu() { return NULL; }
+    
+    // true if the pixel set of the expression is shared already
+    bool isShared();
+    
+    // pixel sets are shared between beginSharing() and endSharing(), which deletes them,
+    // e.g. during an evaluation, when neither the scene nor the camera change
+    static void beginSharing();
+    static void endSharing();
+    
+    // renders and pixel set operations saved by sharing since beginSharing()
+    static int savedRenders() { return s_savedRenders; }
+    static int savedOperations() { return s_savedOperations; }
+    
+    // when set, measure() evaluates the expressions on the GPU whenever it can, 
+    // transferring only the measures to RAM, see GpuPixelSet
+    static void setGpuEvaluation(bool gpu) { s_gpuEvaluation = gpu; }
+    static bool gpuEvaluation() { return s_gpuEvaluation; }
  
 	virtual std::ostream& print(std::ostream &os) = 0;
 
@@ -57,6 +109,34 @@ public :
 		return os;
 	}
 	
+protected :
+	
+	// true for the expressions that render the scene, false for operations on pixel sets
+	virtual bool isRender() { return false; }
+	
+	// counts the pixels of the pixel set without reading it back, e.g. with occlusion queries, 
+	// returns false if the expression can't
+	virtual bool countWithoutRendering(double &result) { return false; }
+	
+private :
+	
+	// a pixel set shared by the expressions with the same signature, 
+	// with the renders and operations it took
+	struct SharedPixelSet {
+		PixelSet *pixelSet;
+		int renders, operations;
+	};
+	
+	static bool s_sharing;
+	static std::map<std::string, SharedPixelSet> s_shared;
+	static std::set<PixelSet *> s_sharedPixelSets;
+	
+	// renders and operations done since beginSharing(), and saved by sharing
+	static int s_renders, s_operations;
+	static int s_savedRenders, s_savedOperations;
+	
+	static bool s_gpuEvaluation;
+	
 };
 
 }
@@ -53,6 +53,11 @@ public :
         
     // operates over the pixel set expression (m_pixelSetExpression)
     virtual double evaluate() = 0;
+    
+    PixelSetExpression *getPixelSetExpression() { return m_pixelSetExpression; }
+    
+    // appends the pixel set expressions the operator measures
+    virtual void getOperands(std::vector<PixelSetExpression *> &operands) { operands.push_back(m_pixelSetExpression); }
  
 };
 
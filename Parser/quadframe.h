@@ -61,6 +61,10 @@ public:
   const std::string &getFrameName() { 
 	return m_frameName;
   }
+  
+  const std::string &getNodeName() { 
+	return m_frameName;
+  }
 
   virtual double evaluate() { return INFINITY; }
 
@@ -30,20 +30,112 @@ http://www.gnu.org/copyleft/lesser.txt.
 
 #include "rendererpsexpression.h"
 #include "celparserexception.h"
+#include "compiledexpression.h"
+#include "pixelsetoperator.h"
+#include <algorithm>
+#include <set>
 
 
 namespace CEL
 {
 
+class RendererPixelSetExpression::TargetCollector
+{
+				std::vector<Ogre::SceneNode *> &m_targets;
+				
+				// the bodies of the functions walked already, each one is walked once
+				std::set<Expression *> m_bodies;
+				
+				void add ( Ogre::SceneNode *node )
+				{
+					if ( std::find ( m_targets.begin(), m_targets.end(), node ) == m_targets.end() )
+						m_targets.push_back ( node );
+				}
+				
+			public :
+				TargetCollector ( std::vector<Ogre::SceneNode *> &targets ) : m_targets ( targets ) {}
+				
+				void walk ( Expression *e )
+				{
+					if ( CompiledExpression *compiled = dynamic_cast<CompiledExpression *> ( e ) )
+					{
+						walk ( compiled->getTree() );
+						return;
+					}
+					
+					if ( PixelSetOperator *measure = dynamic_cast<PixelSetOperator *> ( e ) )
+					{
+						std::vector<PixelSetExpression *> operands;
+						measure->getOperands ( operands );
+						
+						for ( size_t i = 0; i < operands.size(); i++ )
+							walk ( operands[i] );
+						return;
+					}
+					
+					if ( CallFunctionOperator *call = dynamic_cast<CallFunctionOperator *> ( e ) )
+					{
+						// the plain targets passed to a function, which renders in its body are bound to.
+						// A target passed to a function that doesn't render it is rendered for nothing
+						for ( size_t i = 0; i < call->size(); i++ )
+						{
+							Target *target = dynamic_cast<Target *> ( ( *call ) [i] );
+							
+							if ( target && !target->getCallFunction() )
+								add ( target->getNode() );
+							else if ( !target )
+								walk ( ( *call ) [i] );
+						}
+						
+						if ( !call->isParameter() && m_bodies.insert ( call->getBinding() ).second )
+							walk ( call->getBinding() );
+						return;
+					}
+					
+					if ( Operator *op = dynamic_cast<Operator *> ( e ) )
+						for ( size_t i = 0; i < op->size(); i++ )
+							walk ( ( *op ) [i] );
+				}
+				
+				void walk ( PixelSetExpression *e )
+				{
+					RendererPixelSetExpression *render = dynamic_cast<RendererPixelSetExpression *> ( e );
+					
+					if ( !render )
+					{
+						std::vector<PixelSetExpression *> operands;
+						e->getOperands ( operands );
+						
+						for ( size_t i = 0; i < operands.size(); i++ )
+							walk ( operands[i] );
+						return;
+					}
+					
+					// only plain targets, symbols are bound when the expression is evaluated
+					Target *target = dynamic_cast<Target *> ( render->m_targetExpression );
+					
+					if ( target && !target->getCallFunction() && !render->m_callFunction )
+						add ( target->getNode() );
+				}
+};
 
-PixelSet *RendererPixelSetExpression::render()
+
+void RendererPixelSetExpression::collectTargets ( const std::vector<Expression *> &shots, std::vector<Ogre::SceneNode *> &targets )
+{
+				TargetCollector collector ( targets );
+				
+				for ( size_t i = 0; i < shots.size(); i++ )
+					collector.walk ( shots[i] );
+}
+
+
+void RendererPixelSetExpression::bindCallFunction()
 {
 				// handle the case when an argument is a Symbol (functionCall)
 				if ( m_callFunction )
 				{
-					std::cout << "***************************  TEST **********************" << std::endl;  
 					// then its a symbol, so we extract the 'TargetExpression' linked to the symbol, and assign it to  m_targetExpression
-					Expression *expression = getSymbolTableSingleton() [m_callFunction->getFunctionName() ];
+					Expression *expression = m_callFunction->getBinding();
 					//std::cout << " expression is " << expression << std::endl;
 					//std::cout << " type is " << typeid(*expression).name() << std::endl;
 
@@ -60,32 +152,98 @@ PixelSet *RendererPixelSetExpression::render()
 
 
 				}
+}
+
 
-				if ( m_targetExpression )
+void RendererPixelSetExpression::bindTargets()
+{
+				if ( m_targetsBound && !m_dependsOnArguments && m_bindingVersion == Renderer::getBindingVersion() )
+					return;
+				
+				bindCallFunction();
+				
+				if ( !m_targetExpression )
+					throw CelParserException("Argument of Render() needs to be a TargetExpression");
+				
+				// the nodes of the targets, through the arguments of the call under way if the targets
+				// are parameters: each target resolved its node once, no name is looked up here
+				CELTargetExpressionVisitor visitor ( m_visited );
+				m_targetExpression->visit ( visitor );
+				
+				// the nodes may not be the ones the signatures were made for anymore
+				bool rebound = m_bindingVersion != Renderer::getBindingVersion();
+				if ( rebound )
+					m_signatures.clear();
+				
+				if ( !m_targetsBound || rebound || m_visited != m_nodes || visitor.isNegated() != m_negated )
 				{
-					std::cout << "RendererPixelSetExpression::render()" << std::endl;
-					// visit the TargetExpression to get the list of Targets
-					CELTargetExpressionVisitor visitor;
-					m_targetExpression->visit ( visitor );
-					const std::vector<std::string> & vec = visitor.getVectorOfTargets();
+					m_nodes.swap ( m_visited );
+					m_negated = visitor.isNegated();
+					
+					// a function called with alternating arguments builds each signature once
+					std::string &signature = m_signatures[Binding ( m_negated, m_nodes )];
+					
+					if ( signature.empty() )
+					{
+						signature = m_negated ? "R(!" : "R(";
+						for ( size_t i = 0; i < m_nodes.size(); i++ )
+							signature += ( i > 0 ? "," : "" ) + m_nodes[i]->getName();
+						signature += ")";
+					}
 					
-					bool negated = visitor.isNegated();
+					m_signature = &signature;
+				}
+				
+				m_dependsOnArguments = visitor.dependsOnArguments() || ( m_callFunction && m_callFunction->isParameter() );
+				m_bindingVersion = Renderer::getBindingVersion();
+				m_targetsBound = true;
+}
 
-					std::cout << " ... nb targets=" << vec.size() << std::endl;
-					std::cout << " ...    negated=" << negated << std::endl;
 
-					// TODO: we need to handle a vector as argument to Render
-					//	PixelSet *px = Renderer::OgreRenderer->Render ( vec, negated? ALL_BUT_NODE : NODE );
-					//
-	
-					PixelSet *px = Renderer::OgreRenderer->Render ( vec[0], negated? ALL_BUT_NODE : NODE );
+std::string RendererPixelSetExpression::signature()
+{
+				bindTargets();
+				
+				return *m_signature;
+}
 
-					return px;
-				}
-				else 
-				{
-					throw CelParserException("Argument of Render() needs to be a TargetExpression");
-				}
-			}
+
+const std::vector<Ogre::SceneNode *> &RendererPixelSetExpression::getNodes ( bool &negated )
+{
+				bindTargets();
+				
+				negated = m_negated;
+				return m_nodes;
+}
+
+
+bool RendererPixelSetExpression::countWithoutRendering ( double &result )
+{
+				bool negated;
+				const std::vector<Ogre::SceneNode *> &nodes = getNodes ( negated );
+				
+				result = Renderer::OgreRenderer->Count ( nodes, negated? ALL_BUT_NODE : NODE );
+				
+				return true;
+}
+
+
+GpuPixelSet *RendererPixelSetExpression::renderOnGpu()
+{
+				bool negated;
+				const std::vector<Ogre::SceneNode *> &nodes = getNodes ( negated );
+				
+				return GpuPixelSet::Render ( nodes, negated? ALL_BUT_NODE : NODE );
+}
+
+
+PixelSet *RendererPixelSetExpression::render()
+{
+				bool negated;
+				const std::vector<Ogre::SceneNode *> &nodes = getNodes ( negated );
+				
+				// all the targets are rendered together
+				return Renderer::OgreRenderer->Render ( nodes, negated? ALL_BUT_NODE : NODE );
+}
 
 }
@@ -37,6 +37,8 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include "targetexpression.h"
 #include "targetexpressionvisitor.h"
 #include "callfunction.h"
+#include <algorithm>
+#include <map>
 
 #ifndef RENDERERPSEXPRESSION_HH
 #define RENDERERPSEXPRESSION_HH
@@ -49,25 +51,76 @@ namespace CEL
 	{
 			TargetExpression 		*m_targetExpression;
 			CallFunctionOperator 	*m_callFunction;
+			
+			// the nodes of the targets as they were bound the last time, the signature of the expression 
+			// with them, and whether they have to be bound again each time, see bindTargets()
+			std::vector<Ogre::SceneNode *>	m_nodes;
+			bool 					m_negated;
+			const std::string 			*m_signature;
+			bool 					m_targetsBound;
+			bool 					m_dependsOnArguments;
+			
+			// the binding version of the renderer the nodes were bound at, and the nodes of the 
+			// visit under way
+			unsigned long 				m_bindingVersion;
+			std::vector<Ogre::SceneNode *>	m_visited;
+			
+			// the signatures of the nodes the targets were bound to, while they are the same nodes
+			typedef std::pair<bool, std::vector<Ogre::SceneNode *> > Binding;
+			std::map<Binding, std::string>	m_signatures;
 
 		public :
 			// contruct with a targetExpression as argument
-			RendererPixelSetExpression ( TargetExpression *t ) :m_targetExpression ( t ), m_callFunction ( NULL ) {};
+			RendererPixelSetExpression ( TargetExpression *t ) :m_targetExpression ( t ), m_callFunction ( NULL ), m_negated ( false ), 
+				m_signature ( NULL ), m_targetsBound ( false ), m_dependsOnArguments ( false ), m_bindingVersion ( 0 ) {};
 
 			// or construct with a symbol as argument
 			//RendererPixelSetExpression ( CallFunctionOperator *cfo ) :m_targetExpression ( NULL ), m_callFunction ( cfo ) {};
 
 			virtual ~RendererPixelSetExpression() {}
 
-			void setCallFunction ( CallFunctionOperator *op ) {m_callFunction = op;};
+			void setCallFunction ( CallFunctionOperator *op ) {m_callFunction = op; m_targetsBound = false;};
 
 			virtual PixelSet *render();
+			
+			virtual std::string signature();
+			
+			// renders the targets into a GpuPixelSet, NULL if the GPU can't evaluate pixel sets
+			virtual GpuPixelSet *renderOnGpu();
+			
+			// gets the nodes of the targets rendered by the expression, with the symbols bound as 
+			// they are now, and whether all the scene but them is rendered
+			const std::vector<Ogre::SceneNode *> &getNodes ( bool &negated );
+			
+			// appends the nodes of the single targets rendered by the camera shots, and of the targets 
+			// passed to the functions they call, walking the bodies of the functions once, e.g. to 
+			// render them ahead with Renderer::RenderTargets
+			static void collectTargets ( const std::vector<Expression *> &shots, std::vector<Ogre::SceneNode *> &targets );
 
 			std::ostream& print(std::ostream &os) {
 				os << "R(" << *m_targetExpression << ")";
 				return os;
 			}
 
+		protected :
+		
+			bool isRender() { return true; }
+			
+			// the renderer counts the pixels with occlusion queries, see Renderer::Count
+			bool countWithoutRendering ( double &result );
+
+		private :
+		
+			// when the argument is a symbol, binds m_targetExpression to the TargetExpression behind it
+			void bindCallFunction();
+			
+			// visits the target expression for the nodes of the targets, once unless they depend on 
+			// the arguments of the call under way
+			void bindTargets();
+		
+			// walks the camera shots for collectTargets()
+			class TargetCollector;
+
 	};
 
 }
@@ -52,16 +52,24 @@ public :
         
     virtual PixelSet *render() {
 
-    		PixelSet *ps = m_pixelSetExpression->render();
+    		PixelSet *ps = m_pixelSetExpression->share();
 			
 			PixelSet *result = ps->Silhouette();
 		
-			delete ps;
+			PixelSetExpression::release(ps);
 			
 			return  result;
     }
 
  
+	void getOperands(std::vector<PixelSetExpression *> &operands) {
+		operands.push_back(m_pixelSetExpression);
+	}
+
+ 	std::string signature() {
+		return "Silhouette(" + m_pixelSetExpression->signature() + ")";
+	}
+
  	std::ostream& print(std::ostream &os) {
 		os << "Silhouette(" << *m_pixelSetExpression  << ")";
 		return os;
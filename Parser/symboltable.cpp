@@ -43,22 +43,6 @@ namespace CEL
 
 	SymbolTable *SymbolTable::m_globalSymbolTable = NULL;
 
-	// assigns the local args from s with value in *this (if the arg is a functionName)
-	// thiis modifies s (and not *this)
-	SymbolTable SymbolTable::assignLocalArgs(SymbolTable &s ) {
-		HashTable::iterator it;
-		SymbolTable temp = s;
-		for (it = temp.m_hashTable.begin(); it !=  temp.m_hashTable.end(); it++) {
-			CallFunctionOperator *cfo = dynamic_cast<CallFunctionOperator*>(it->second);
-			// if its a call, then replace it by the appropriate expression in the global symbole table
-			if (cfo) {
-				it->second = m_hashTable[cfo->getFunctionName()];
-			}
-		}
-		return temp;
-	}
-
-
 	void SymbolTable::initSymbolTable()
 	{
 		// extend the symbol table with new functions...
@@ -77,7 +61,7 @@ namespace CEL
 			// create the Expression
 			Operator *toIntOperator = new ToIntOperator();
 	
-			toIntOperator->push_back(new CallFunctionOperator ( "val" ));
+			toIntOperator->push_back(new CallFunctionOperator ( "val", 0 ));
 			// and add it to the table
 			addSymbol ( toInt, toIntOperator );
 		}
@@ -114,8 +98,8 @@ namespace CEL
 			Operator *widthOp = new MathOperator ( MathOperator::MATH_DIVISION );
 			
 			Operator *minus = new MathOperator ( MathOperator::MATH_MINUS );
-			minus->push_back ( new MaxXPixelSetOperator ( new RendererPixelSetExpression ( new Target(new CallFunctionOperator ( "T" ) ) ) ) );
-			minus->push_back ( new MinXPixelSetOperator ( new RendererPixelSetExpression ( new Target(new CallFunctionOperator ( "T" ) ) ) ) );
+			minus->push_back ( new MaxXPixelSetOperator ( new RendererPixelSetExpression ( new Target(new CallFunctionOperator ( "T", 0 ) ) ) ) );
+			minus->push_back ( new MinXPixelSetOperator ( new RendererPixelSetExpression ( new Target(new CallFunctionOperator ( "T", 0 ) ) ) ) );
 
 			// left operand
 			widthOp->push_back ( minus );
@@ -34,8 +34,7 @@ http://www.gnu.org/copyleft/lesser.txt.
 #include <string>
 
 #include <vector>
-
-#include <ext/hash_map>
+#include <utility>
 
 #include "expression.h"
 #include "symbol.h"
@@ -47,33 +46,119 @@ http://www.gnu.org/copyleft/lesser.txt.
 using namespace std;
 
 
-using namespace __gnu_cxx;
-
-
 namespace CEL {
 
 /** defines a symbol table
     Contains a Singleton that stores all the symbols
   */
 
-struct symboleq
-{
-  bool operator()(const Symbol &s1, const Symbol &s2) const
-  {
-    return s1.getSymbolName() == s2.getSymbolName();
-  }
-};
-
-struct symbolhash
+/** maps the symbols to their expressions by open addressing: the entries are kept in the order 
+    they were added, e.g. the parameters of a function in the order they are declared, and the 
+    slots, probed linearly from the hash of a name, hold the index of its entry
+  */
+class HashTable
 {
-  size_t operator()( const Symbol& x ) const
-  {
-    return hash< const char* >()( x.getSymbolName().c_str() );
-  }
-};
 
+public :
+	typedef std::pair<Symbol, Expression *> value_type;
+	typedef std::vector<value_type>::iterator iterator;
+	typedef std::vector<value_type>::const_iterator const_iterator;
+	
+	iterator begin() { return m_entries.begin(); }
+	iterator end() { return m_entries.end(); }
+	const_iterator begin() const { return m_entries.begin(); }
+	const_iterator end() const { return m_entries.end(); }
+	
+	size_t size() const { return m_entries.size(); }
+	
+	iterator find(const Symbol &s) {
+		int entry = lookup(s.getSymbolName());
+		return entry < 0 ? end() : begin() + entry;
+	}
+	
+	const_iterator find(const Symbol &s) const {
+		int entry = lookup(s.getSymbolName());
+		return entry < 0 ? end() : begin() + entry;
+	}
+	
+	// the expression of the symbol, added with none if it isn't there
+	Expression *&operator[](const Symbol &s) {
+		int entry = lookup(s.getSymbolName());
+		if (entry < 0)
+			entry = insert(s);
+		return m_entries[entry].second;
+	}
+	
+	void erase(const Symbol &s) {
+		int entry = lookup(s.getSymbolName());
+		if (entry < 0)
+			return;
+		
+		// the entries after it move down, so the slots are rebuilt
+		m_entries.erase(m_entries.begin() + entry);
+		rehash(m_slots.size());
+	}
+	
+	void clear() {
+		m_entries.clear();
+		m_slots.clear();
+	}
+	
+private :
+	
+	// FNV-1a
+	static size_t hashName(const std::string &name) {
+		size_t hash = 2166136261u;
+		for (size_t i = 0; i < name.size(); i++)
+			hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+		return hash;
+	}
+	
+	// index of the entry of the name, -1 if there's none
+	int lookup(const std::string &name) const {
+		if (m_slots.empty())
+			return -1;
+		
+		size_t mask = m_slots.size() - 1;
+		for (size_t slot = hashName(name) & mask; ; slot = (slot + 1) & mask) {
+			int entry = m_slots[slot];
+			if (entry < 0 || m_entries[entry].first.getSymbolName() == name)
+				return entry;
+		}
+	}
+	
+	// adds an entry for the symbol, keeping the slots at most half full, returns its index
+	int insert(const Symbol &s) {
+		m_entries.push_back(value_type(s, (Expression *)NULL));
+		
+		if (m_entries.size() * 2 > m_slots.size())
+			rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+		else
+			place(m_entries.size() - 1);
+		
+		return m_entries.size() - 1;
+	}
+	
+	// puts the entry in the first free slot from the hash of its name
+	void place(int entry) {
+		size_t mask = m_slots.size() - 1;
+		size_t slot = hashName(m_entries[entry].first.getSymbolName()) & mask;
+		while (m_slots[slot] >= 0)
+			slot = (slot + 1) & mask;
+		m_slots[slot] = entry;
+	}
+	
+	// rebuilds the slots, their number being a power of two
+	void rehash(size_t slots) {
+		m_slots.assign(slots, -1);
+		for (size_t entry = 0; entry < m_entries.size(); entry++)
+			place(entry);
+	}
+	
+	std::vector<value_type> m_entries;
+	std::vector<int> m_slots;
 
-typedef hash_map <Symbol, Expression *, symbolhash, symboleq > HashTable;
+};
 
 
 class SymbolTable 
@@ -124,23 +209,6 @@ public :
     	return m_hashTable[s];
     }
 
-    // save the symbols from  m_hashTable, and overwirte them with s
-    SymbolTable pushSymbols( SymbolTable &local ) {
-        HashTable::const_iterator it;
-
-		// we save the current table
-        SymbolTable temp = *this;
-
-		// and add the local symbols
-    	for (it = local.m_hashTable.begin(); it !=  local.m_hashTable.end(); it++) {
-    	
-			addSymbol(it->first, it->second);
-
-    	}
-
-    	return temp;
-    }
-
     // temporarily add of symbols, by pushing the ones that already exist...
     SymbolTable addSymbols( SymbolTable &local ) {
         HashTable::const_iterator it;
@@ -172,17 +240,6 @@ public :
     }
 
  
-    // directly copy the symbols from s into the table
-    void popSymbols( SymbolTable &s ) {
-    	HashTable::iterator it;
-
-		m_hashTable = s.m_hashTable;
-		// copy the symboltable s (replaces the current values)
-    	//for (it = s.m_hashTable.begin(); it !=  s.m_hashTable.end(); it++) {
-    	//	m_hashTable[it->first] = it->second;
-    	//}
-    } 
-
 	void restoreSymbols(SymbolTable &s ) {
     	HashTable::iterator it;
 
@@ -193,10 +250,6 @@ public :
 		
     } 
 
-	// assigns the local args from s with value in *this (if the arg is a functionName)
-	// thiis modifies s (and not *this)
-	SymbolTable assignLocalArgs(SymbolTable &s );
-
     void free() {
     	HashTable::iterator it;
     	for (it = m_hashTable.begin(); it !=  m_hashTable.end(); it++) {
@@ -30,6 +30,7 @@ http://www.gnu.org/copyleft/lesser.txt.
  
 #include "target.h"
 #include "targetexpressionvisitor.h"
+#include "Renderer.h"
 
 namespace CEL {
 
@@ -38,4 +39,14 @@ void Target::visit (TargetExpressionVisitor &v)
     	v.visit(*this);
 }
 
+Ogre::SceneNode *Target::getNode()
+{
+	if (!m_node || m_bindingVersion != Renderer::getBindingVersion()) {
+		m_node = Renderer::OgreRenderer->ResolveNode(getNodeName());
+		m_bindingVersion = Renderer::getBindingVersion();
+	}
+	
+	return m_node;
+}
+
 }
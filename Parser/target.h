@@ -39,6 +39,10 @@ http://www.gnu.org/copyleft/lesser.txt.
 #ifndef TARGET_HH
 #define TARGET_HH
 
+namespace Ogre {
+	class SceneNode;
+}
+
 namespace CEL {
 
 class TargetExpressionVisitor;
@@ -49,14 +53,18 @@ class Target : public TargetExpression
 
     std::string m_targetName;
 	CallFunctionOperator *m_callFunction;
+	
+	// the scene node of the target, and the binding version of the renderer it was resolved at
+	Ogre::SceneNode *m_node;
+	unsigned long m_bindingVersion;
 
 public :
-    Target(const std::string &t) : m_targetName(t), m_callFunction(NULL) {
+    Target(const std::string &t) : m_targetName(t), m_callFunction(NULL), m_node(NULL), m_bindingVersion(0) {
     
     	std::cout << "Adding target " << t << std::endl;
     };
     
-    Target(CallFunctionOperator *c) : m_callFunction(c) {
+    Target(CallFunctionOperator *c) : m_callFunction(c), m_node(NULL), m_bindingVersion(0) {
     
     	std::cout << "Adding CallFunction " << std::endl;
     };
@@ -64,6 +72,13 @@ public :
     
     virtual void visit (TargetExpressionVisitor &v);
     
+    // name of the scene node the target renders
+    virtual const std::string & getNodeName() { return m_targetName; }
+    
+    // the scene node the target renders, looked up by name only once until the nodes 
+    // resolved by the renderer change, see Renderer::getBindingVersion
+    Ogre::SceneNode *getNode();
+    
 	CallFunctionOperator *getCallFunction() { return m_callFunction;}
     
     const std::string & getTargetName() const {
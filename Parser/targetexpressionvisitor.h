@@ -79,12 +79,45 @@ public :
 
 class CELTargetExpressionVisitor : public TargetExpressionVisitor {
 
-	std::vector<std::string> m_targets;
+	// the scene nodes of the targets, into a vector of the visitor or of the caller
+	std::vector<Ogre::SceneNode *> m_ownNodes;
+	std::vector<Ogre::SceneNode *> &m_nodes;
 	bool m_negated;
+	
+	// number of calls made by the visit whose frames the visit is in, and whether it 
+	// reached a parameter of a call made before it
+	int m_calls;
+	bool m_dependsOnArguments;
+
+	// visits the expression behind a symbol: the expression of a function in a new frame, 
+	// or the argument of a parameter in the frame of the caller
+	void visitBinding(CallFunctionOperator &cfo) {
+		int calls = m_calls;
+		
+		if (!cfo.isParameter())
+			m_calls++;
+		else if (m_calls > 0)
+			m_calls--;
+		else
+			m_dependsOnArguments = true;
+		
+		cfo.visitBinding(*this);
+		m_calls = calls;
+	}
 
 public :
-    CELTargetExpressionVisitor() {
+    CELTargetExpressionVisitor() : m_nodes(m_ownNodes) {
 		m_negated = false;
+		m_calls = 0;
+		m_dependsOnArguments = false;
+	};
+	
+	// collects the nodes into nodes, cleared first, e.g. to reuse its storage from one visit to the next
+    CELTargetExpressionVisitor(std::vector<Ogre::SceneNode *> &nodes) : m_nodes(nodes) {
+		m_nodes.clear();
+		m_negated = false;
+		m_calls = 0;
+		m_dependsOnArguments = false;
 	};
     
     virtual ~CELTargetExpressionVisitor() {
@@ -95,8 +128,7 @@ public :
     };
 
     virtual void visit(CallFunctionOperator &t) {
-		std::cout << "Visiting a callfunctionoperator behind symbol " << t.getFunctionName() << std::endl;
-    	(getSymbolTableSingleton()[t.getFunctionName()])->visit(*this);
+    	visitBinding(t);
     };
 
 
@@ -105,23 +137,20 @@ public :
     };
 
 	virtual void visit(QuadFrame &t) {
-		m_targets.push_back(t.getFrameName());
+		m_nodes.push_back(t.getNode());
 	}
 
 	virtual void visit(ViewVolume &t) {
-		m_targets.push_back(t.getViewVolumeName());
+		m_nodes.push_back(t.getNode());
 	}
 
     
     virtual void visit(Target &t) {    	
 		CallFunctionOperator *cfo = t.getCallFunction();
-		if (cfo) {
-			std::cout << "Visiting the TargetExpression behind symbol " << cfo->getFunctionName() << std::endl;
-			
-			(getSymbolTableSingleton()[cfo->getFunctionName()])->visit(*this);
-
-		} else 
-			m_targets.push_back(t.getTargetName());
+		if (cfo)
+			visitBinding(*cfo);
+		else 
+			m_nodes.push_back(t.getNode());
 	}
     
     virtual void visit(VectorOfTargets &t) {
@@ -133,7 +162,6 @@ public :
 	}
  
     virtual void visit(TargetNegation &t) {
-    	std::cout << " TargetNegation" << std::endl;
 		m_negated = true;
 		(t.getExpression())->visit(*this);
 	}
@@ -143,19 +171,24 @@ public :
 
 		// extract the TargetExpression behind the function, and visit it!
 		CallFunctionOperator *cfo = t.getCallFunction();
-		TargetExpression *targetExpression = dynamic_cast<TargetExpression*>(getSymbolTableSingleton()[cfo->getFunctionName()]);
+		TargetExpression *targetExpression = dynamic_cast<TargetExpression*>(cfo->getBinding());
 		if (targetExpression) {
 			// then visit this expression .... (which in turn will add all the targets in targetExpression)
-			targetExpression->visit(*this);
+			visitBinding(*cfo);
 		} else {
 			throw CelParserException((std::string("Expression ") + cfo->getFunctionName() + " needs to ba a TargetExpression ").c_str());
 		}
 	}
 
-	const std::vector<std::string> &getVectorOfTargets() { return m_targets;}
+	// the nodes of the targets, resolved once by the targets themselves, see Target::getNode
+	const std::vector<Ogre::SceneNode *> &getNodes() { return m_nodes;}
 	
 	bool isNegated() { return m_negated;}
 	
+	// true if the targets depend on the arguments of the call under way, i.e. can be 
+	// different each time the expression visited is evaluated
+	bool dependsOnArguments() { return m_dependsOnArguments;}
+	
 };
 
 
@@ -64,6 +64,10 @@ public:
   const std::string &getViewVolumeName() { 
 	return m_viewVolumeName;
   }
+  
+  const std::string &getNodeName() { 
+	return m_viewVolumeName;
+  }
 
   virtual double evaluate() { return INFINITY; }
 
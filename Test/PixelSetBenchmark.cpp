@@ -0,0 +1,997 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+/** Benchmarks of the PixelSet operators on synthetic renders, which only need the images of Ogre. 
+	Run with the name of a benchmark, all of them otherwise:
+	- throughput: the operators against the ones reading each pixel through Image::getColourAt, 
+	  column by column, as PixelSet first did, in pixels of the viewport per second on 1024x768 
+	  renders of both depth formats.
+	- distance: checks Distance, a distance transform of one set queried at the edge pixels of the 
+	  other, against the scan of all the pairs of edge pixels it replaced, on random silhouettes. 
+	  Then times both on combs of more and more teeth, whose perimeter grows on a render of a 
+	  fixed size: the transform is linear in the pixels of the render and barely grows with 
+	  the perimeter, the scan grows with its square.
+	- threads: times the operators on a 4K render with PixelSet::threads at 1, 2, 4, 8 and 16, 
+	  which needs a build with OpenMP, and checks that their results don't depend on it.
+	- cache: the operators against the ones reading each pixel through Image::getColourAt, column 
+	  by column, on 4K renders of objects filling the viewport, then a corner of it: their time and, 
+	  on Linux where perf counters are available, the cache misses per pixel of the viewport. 
+	  The operators walk the rows in the order they are stored, only within the bounding boxes, 
+	  where the baseline strides a whole row from one pixel to the next.
+	- storage: checks that pixel sets stored DENSE and SPARSE, or one of each, give every operator 
+	  the same pixels, depths and statistics, on random masks of all densities.
+	- silhouette: checks Silhouette, and the edge pixels Distance finds or keeps from it, against 
+	  the pixels found by looking at the eight neighbours of each pixel, on random masks stored 
+	  DENSE and SPARSE. Then times both on a 4K render.
+	It returns non-zero if the operators don't find the same pixels, or distances, as the ones they replaced:
+	g++ -O2 -I../Operators -I$OGRE_HOME/include PixelSetBenchmark.cpp ../Operators/PixelSet.cpp 
+		../Operators/PixelSetKernels.cpp ../Operators/PixelSetPool.cpp -lOgreMain
+*/
+
+#include "PixelSet.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace Ogre;
+
+static const char* formatNames[] = { "L16", "FLOAT32" };
+static const PixelFormat formats[] = { PF_L16, PF_FLOAT32_R };
+
+
+/** A render of width x height holding an ellipse of random depths, centered on (cx, cy) with radii 
+	(rx, ry) in pixels, with one pixel in holes missing so that it has inner edges too (none if 0) */
+static Image* makeRender( int width, int height, PixelFormat format, float cx, float cy, float rx, float ry, unsigned seed, 
+						 int holes = 16 )
+{
+	size_t bytes = PixelUtil::getNumElemBytes(format);
+	uchar* data = OGRE_ALLOC_T(uchar, width * height * bytes, MEMCATEGORY_GENERAL);
+	memset(data, 0, width * height * bytes);
+	
+	srand(seed);
+	
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			
+			float dx = (x - cx) / rx, dy = (y - cy) / ry;
+			
+			if ( dx * dx + dy * dy < 1.0f && (holes == 0 || rand() % holes) ) {
+				float z = (rand() % 1000 + 1) / 1001.0f;
+				PixelUtil::packColour(z, z, z, 1.0f, format, data + (y * width + x) * bytes);
+			}
+		}
+	
+	Image* image = new Image();
+	image->loadDynamicImage(data, width, height, 1, format, true);
+	
+	return image;
+}
+
+/** A copy of a render, for the pixel sets that take it over */
+static Image* copyRender( Image* render )
+{
+	uchar* data = OGRE_ALLOC_T(uchar, render->getSize(), MEMCATEGORY_GENERAL);
+	memcpy(data, render->getData(), render->getSize());
+	
+	Image* image = new Image();
+	image->loadDynamicImage(data, render->getWidth(), render->getHeight(), 1, render->getFormat(), true);
+	
+	return image;
+}
+
+
+/** The operators as PixelSet first implemented them: each pixel read through Image::getColourAt, 
+	column by column, into a black image allocated for the result, whose statistics are then 
+	computed the same way */
+namespace Baseline
+{
+	struct Statistics {
+		int count, minX, maxX, minY, maxY;
+	};
+	
+	static Statistics statistics( Image* image )
+	{
+		Statistics s = { 0, INT_MAX, -INT_MAX, INT_MAX, -INT_MAX };
+		
+		for (int x = 0; x < (int)image->getWidth(); x++)
+			for (int y = 0; y < (int)image->getHeight(); y++)
+				if ( image->getColourAt(x, y, 0).r > 0 ) {
+					s.count++;
+					s.minX = std::min(s.minX, x); s.maxX = std::max(s.maxX, x);
+					s.minY = std::min(s.minY, y); s.maxY = std::max(s.maxY, y);
+				}
+		
+		return s;
+	}
+	
+	static Image* blackImage( Image* like )
+	{
+		uchar* data = OGRE_ALLOC_T(uchar, like->getSize(), MEMCATEGORY_GENERAL);
+		memset(data, 0, like->getSize());
+		
+		Image* image = new Image();
+		image->loadDynamicImage(data, like->getWidth(), like->getHeight(), 1, like->getFormat(), true);
+		
+		return image;
+	}
+	
+	/** a pixel of a into the result */
+	static void copyPixel( Image* a, Image* result, int x, int y )
+	{
+		size_t bytes = PixelUtil::getNumElemBytes(a->getFormat());
+		PixelUtil::packColour(a->getColourAt(x, y, 0), a->getFormat(), result->getData() + (y * a->getWidth() + x) * bytes);
+	}
+	
+	/** the count of Overlap(a, b), b over the bounding box of a */
+	static int overlap( Image* a, const Statistics& sa, Image* b )
+	{
+		Image* result = blackImage(a);
+		
+		for (int x = sa.minX; x <= sa.maxX; x++)
+			for (int y = sa.minY; y <= sa.maxY; y++)
+				if ( a->getColourAt(x, y, 0).r > 0 && b->getColourAt(x, y, 0).r > 0 )
+					copyPixel(a, result, x, y);
+		
+		int count = statistics(result).count;
+		delete result;
+		
+		return count;
+	}
+	
+	/** the count of CoveredBy(a, b) */
+	static int coveredBy( Image* a, const Statistics& sa, Image* b )
+	{
+		Image* result = blackImage(a);
+		
+		for (int x = sa.minX; x <= sa.maxX; x++)
+			for (int y = sa.minY; y <= sa.maxY; y++)
+				if ( a->getColourAt(x, y, 0).r > 0 && b->getColourAt(x, y, 0).r > 0 && 
+					a->getColourAt(x, y, 0).r > b->getColourAt(x, y, 0).r )
+					copyPixel(a, result, x, y);
+		
+		int count = statistics(result).count;
+		delete result;
+		
+		return count;
+	}
+	
+	/** the count of Left(a, b), through the slice of a left of b */
+	static int left( Image* a, const Statistics& sa, const Statistics& sb )
+	{
+		Image* result = blackImage(a);
+		
+		for (int x = sa.minX; x <= sb.minX - 1; x++)
+			for (int y = sa.minY; y <= sa.maxY; y++)
+				if ( a->getColourAt(x, y, 0).r > 0 )
+					copyPixel(a, result, x, y);
+		
+		int count = statistics(result).count;
+		delete result;
+		
+		return count;
+	}
+}
+
+
+enum Operation { OP_STATISTICS, OP_OVERLAP, OP_COVERED_BY, OP_LEFT, OP_SILHOUETTE, OP_DISTANCE, OPERATIONS };
+
+static const char* operationNames[] = { "Statistics", "Overlap", "CoveredBy", "Left", "Silhouette", "Distance" };
+
+/** Runs an operation of the baseline on renders a and b, returns the count of its result */
+static int runBaseline( Operation operation, Image* a, Image* b )
+{
+	Baseline::Statistics sa = Baseline::statistics(a);
+	
+	switch (operation) {
+		case OP_STATISTICS: return sa.count;
+		case OP_OVERLAP: return Baseline::overlap(a, sa, b);
+		case OP_COVERED_BY: return Baseline::coveredBy(a, sa, b);
+		case OP_LEFT: return Baseline::left(a, sa, Baseline::statistics(b));
+		default: return 0;
+	}
+}
+
+/** Runs an operation of PixelSet on pixel sets a and b, the statistics on a pixel set of render, 
+	returns the count of its result */
+static int runPixelSet( Operation operation, Image* render, PixelSet* a, PixelSet* b )
+{
+	PixelSet* result = 0;
+	
+	switch (operation) {
+		case OP_STATISTICS: result = new PixelSet(copyRender(render), "a"); break;
+		case OP_OVERLAP: result = a->Overlap(b); break;
+		case OP_COVERED_BY: result = a->CoveredBy(b); break;
+		case OP_LEFT: result = a->Left(b); break;
+		default: return 0;
+	}
+	
+	int count = result->Count();
+	delete result;
+	
+	return count;
+}
+
+/** Times runs of both versions of each operation, and logs the pixels of the viewport they go through 
+	per second. Returns false if they don't count the same pixels. */
+static bool throughput()
+{
+	const int width = 1024, height = 768;
+	const int baselineRuns = 3, pixelSetRuns = 200;
+	
+	bool same = true;
+	
+	for (int f = 0; f < 2; f++) {
+		
+		// two thirds of the width, overlapping in the middle
+		Image* renderA = makeRender(width, height, formats[f], 0.4f * width, 0.5f * height, 0.3f * width, 0.35f * height, 1);
+		Image* renderB = makeRender(width, height, formats[f], 0.6f * width, 0.5f * height, 0.3f * width, 0.35f * height, 2);
+		
+		PixelSet* a = new PixelSet(copyRender(renderA), "a");
+		PixelSet* b = new PixelSet(copyRender(renderB), "b");
+		
+		for (int operation = 0; operation <= OP_LEFT; operation++) {
+			
+			Timer timer;
+			int baselineCount = 0;
+			for (int run = 0; run < baselineRuns; run++)
+				baselineCount = runBaseline((Operation)operation, renderA, renderB);
+			double baselineRate = baselineRuns * double(width * height) / std::max(timer.getMicroseconds(), 1UL);
+			
+			timer.reset();
+			int count = 0;
+			for (int run = 0; run < pixelSetRuns; run++)
+				count = runPixelSet((Operation)operation, renderA, a, b);
+			double rate = pixelSetRuns * double(width * height) / std::max(timer.getMicroseconds(), 1UL);
+			
+			std::cout << operationNames[operation] << ", " << formatNames[f] << ": " 
+				<< baselineRate << " Mpixels/s through getColourAt, " << rate << " Mpixels/s now, x" 
+				<< rate / baselineRate << std::endl;
+			
+			if (count != baselineCount) {
+				std::cerr << operationNames[operation] << ", " << formatNames[f] << ": " << count 
+					<< " pixels instead of " << baselineCount << std::endl;
+				same = false;
+			}
+		}
+		
+		delete a;
+		delete b;
+		delete renderA;
+		delete renderB;
+	}
+	
+	return same;
+}
+
+/** A render of width x height holding a comb between columns x0 and x1: a spine along the top and 
+	teeth down to the bottom, as wide as the gaps between them */
+static Image* makeComb( int width, int height, PixelFormat format, int x0, int x1, int teeth )
+{
+	size_t bytes = PixelUtil::getNumElemBytes(format);
+	uchar* data = OGRE_ALLOC_T(uchar, width * height * bytes, MEMCATEGORY_GENERAL);
+	memset(data, 0, width * height * bytes);
+	
+	int period = std::max((x1 - x0) / teeth, 2);
+	
+	for (int y = height / 10; y < height * 9 / 10; y++)
+		for (int x = x0; x < x1; x++)
+			if ( y < height / 10 + 8 || (x - x0) % period < period / 2 )
+				PixelUtil::packColour(0.5f, 0.5f, 0.5f, 1.0f, format, data + (y * width + x) * bytes);
+	
+	Image* image = new Image();
+	image->loadDynamicImage(data, width, height, 1, format, true);
+	
+	return image;
+}
+
+/** The edge pixels of the first face of a pixel set, found pixel by pixel: the pixels of the set 
+	with one of their eight neighbours out of it, or on the border of the image */
+static void findEdgePixels( PixelSet* ps, std::vector<std::pair<int,int> >& edges )
+{
+	int width = ps->Width(), height = ps->Height();
+	
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			
+			if ( !ps->Contains(x, y) )
+				continue;
+			
+			bool edge = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+			
+			for (int dy = -1; dy <= 1 && !edge; dy++)
+				for (int dx = -1; dx <= 1 && !edge; dx++)
+					edge = !ps->Contains(x + dx, y + dy);
+			
+			if (edge)
+				edges.push_back(std::make_pair(x, y));
+		}
+}
+
+/** The distance as PixelSet first computed it: the smallest one between two edge pixels of the sets */
+static float scanDistance( const std::vector<std::pair<int,int> >& edgesA, const std::vector<std::pair<int,int> >& edgesB )
+{
+	float minDistance = FLT_MAX;
+	
+	for (size_t i = 0; i < edgesA.size(); i++)
+		for (size_t j = 0; j < edgesB.size(); j++) {
+			float dx = float(edgesA[i].first - edgesB[j].first), dy = float(edgesA[i].second - edgesB[j].second);
+			minDistance = std::min(minDistance, dx * dx + dy * dy);
+		}
+	
+	return sqrtf(minDistance);
+}
+
+/** Checks Distance against the scan of the pairs of edge pixels, then times both on combs of more 
+	and more teeth. Returns false if they don't find the same distance. */
+static bool distance()
+{
+	bool same = true;
+	
+	// random ellipses on a render of an odd size, overlapping or not, with the transform cached or not
+	const int width = 257, height = 193, pairs = 100;
+	
+	srand(5);
+	
+	for (int i = 0; i < pairs * 2 && same; i++) {
+		
+		int f = i % 2;
+		PixelSet::cacheDistanceTransform = (i / 2) % 2 == 0;
+		
+		float cx = float(rand() % width), cy = float(rand() % height);
+		float rx = float(rand() % 60 + 1), ry = float(rand() % 60 + 1);
+		PixelSet* a = new PixelSet(makeRender(width, height, formats[f], cx, cy, rx, ry, rand()), "a");
+		
+		cx = float(rand() % width), cy = float(rand() % height);
+		rx = float(rand() % 60 + 1), ry = float(rand() % 60 + 1);
+		PixelSet* b = new PixelSet(makeRender(width, height, formats[f], cx, cy, rx, ry, rand()), "b");
+		
+		if (a->Count() > 0 && b->Count() > 0) {
+			
+			std::vector<std::pair<int,int> > edgesA, edgesB;
+			findEdgePixels(a, edgesA);
+			findEdgePixels(b, edgesB);
+			
+			float expected = scanDistance(edgesA, edgesB);
+			float ab = a->Distance(b), ba = b->Distance(a);
+			
+			if ( fabsf(ab - expected) > 1e-4f * expected || fabsf(ba - expected) > 1e-4f * expected ) {
+				std::cerr << "Distance, " << formatNames[f] << ": " << ab << " and " << ba 
+					<< " instead of " << expected << std::endl;
+				same = false;
+			}
+		}
+		
+		delete a;
+		delete b;
+	}
+	
+	std::cout << "Distance: " << (same ? "same as the scan of the pairs of edge pixels" : "FAILED") << std::endl;
+	
+	// combs side by side on a render of a fixed size, their perimeter grows with their teeth
+	const int size = 1024, runs = 5;
+	PixelSet::cacheDistanceTransform = false;
+	
+	for (int teeth = 4; teeth <= 256; teeth *= 2) {
+		
+		Image* renderA = makeComb(size, size, PF_L16, 0, size / 2 - 8, teeth);
+		Image* renderB = makeComb(size, size, PF_L16, size / 2 + 8, size, teeth);
+		
+		std::vector<std::pair<int,int> > edgesA, edgesB;
+		unsigned long transform = 0;
+		
+		// the edge pixels are kept by the pixel sets, each run gets new ones
+		for (int run = 0; run < runs; run++) {
+			
+			PixelSet* a = new PixelSet(copyRender(renderA), "a");
+			PixelSet* b = new PixelSet(copyRender(renderB), "b");
+			
+			if (run == 0) {
+				findEdgePixels(a, edgesA);
+				findEdgePixels(b, edgesB);
+			}
+			
+			Timer timer;
+			a->Distance(b);
+			transform += timer.getMicroseconds();
+			
+			delete a;
+			delete b;
+		}
+		
+		std::cout << "Distance, " << teeth << " teeth, " << edgesA.size() + edgesB.size() << " edge pixels: " 
+			<< transform / runs << " us through the transform";
+		
+		// the scan takes minutes past some 10^9 pairs
+		if ( double(edgesA.size()) * edgesB.size() < 1e9 ) {
+			Timer timer;
+			scanDistance(edgesA, edgesB);
+			std::cout << ", " << timer.getMicroseconds() << " us through the scan";
+		}
+		
+		std::cout << std::endl;
+		
+		delete renderA;
+		delete renderB;
+	}
+	
+	PixelSet::cacheDistanceTransform = true;
+	
+	return same;
+}
+
+/** The measures of a pixel set, as the CEL expressions get them */
+static std::string measures( PixelSet* ps )
+{
+	std::ostringstream s;
+	s.precision(9);
+	s << ps->Count() << " pixels in [" << ps->Min_x() << ", " << ps->Max_x() << "] x [" << ps->Min_y() << ", " 
+		<< ps->Max_y() << "] x [" << ps->Min_z() << ", " << ps->Max_z() << "]";
+	return s.str();
+}
+
+/** Runs an operation on new pixel sets of the renders, the statistics on a pixel set of renderA. 
+	Returns its time in microseconds and the measures of its result. */
+static unsigned long timeOperation( Operation operation, Image* renderA, Image* renderB, std::string& result )
+{
+	Image* copy = (operation == OP_STATISTICS) ? copyRender(renderA) : 0;
+	PixelSet* a = new PixelSet(copyRender(renderA), "a");
+	PixelSet* b = new PixelSet(copyRender(renderB), "b");
+	
+	PixelSet* ps = 0;
+	float distance = 0;
+	
+	Timer timer;
+	
+	switch (operation) {
+		case OP_STATISTICS: ps = new PixelSet(copy, "a"); break;
+		case OP_OVERLAP: ps = a->Overlap(b); break;
+		case OP_COVERED_BY: ps = a->CoveredBy(b); break;
+		case OP_LEFT: ps = a->Left(b); break;
+		case OP_SILHOUETTE: ps = a->Silhouette(); break;
+		case OP_DISTANCE: distance = a->Distance(b); break;
+		default: break;
+	}
+	
+	unsigned long elapsed = timer.getMicroseconds();
+	
+	if (ps) {
+		result = measures(ps);
+		delete ps;
+	} else {
+		std::ostringstream s;
+		s << distance;
+		result = s.str();
+	}
+	
+	delete a;
+	delete b;
+	
+	return elapsed;
+}
+
+/** Times the operators on a 4K render for 1 to 16 threads. Returns false if their results change 
+	with the number of threads. */
+static bool threads()
+{
+	const int width = 3840, height = 2160, runs = 5;
+	const int threadCounts[] = { 1, 2, 4, 8, 16 };
+	
+#ifndef _OPENMP
+	std::cout << "built without OpenMP, the operators run on one thread whatever PixelSet::threads" << std::endl;
+#endif
+	
+	Image* renderA = makeRender(width, height, PF_L16, 0.4f * width, 0.5f * height, 0.3f * width, 0.35f * height, 1);
+	Image* renderB = makeRender(width, height, PF_L16, 0.6f * width, 0.5f * height, 0.3f * width, 0.35f * height, 2);
+	
+	bool same = true;
+	
+	for (int operation = 0; operation < OPERATIONS; operation++) {
+		
+		std::string reference;
+		unsigned long serial = 1;
+		
+		std::cout << operationNames[operation] << ", 4K:";
+		
+		for (int t = 0; t < 5; t++) {
+			
+			PixelSet::threads = threadCounts[t];
+			
+			unsigned long elapsed = 0;
+			std::string result;
+			
+			for (int run = 0; run < runs; run++)
+				elapsed += timeOperation((Operation)operation, renderA, renderB, result);
+			
+			if (t == 0) {
+				reference = result;
+				serial = std::max(elapsed, 1UL);
+			} else if (result != reference) {
+				std::cerr << operationNames[operation] << ", " << threadCounts[t] << " threads: " << result 
+					<< " instead of " << reference << std::endl;
+				same = false;
+			}
+			
+			std::cout << " " << threadCounts[t] << (t == 0 ? " thread " : " threads ") << elapsed / (runs * 1000.0) 
+				<< " ms (x" << double(serial) / std::max(elapsed, 1UL) << ")" << (t < 4 ? "," : "");
+		}
+		
+		std::cout << std::endl;
+	}
+	
+	PixelSet::threads = 1;
+	
+	delete renderA;
+	delete renderB;
+	
+	return same;
+}
+
+/** The cache misses of the calling thread, counted by the processor through perf_event_open on Linux. 
+	Not available elsewhere, or where the kernel doesn't allow it. */
+class CacheMisses
+{
+public:
+	CacheMisses() : fd(-1)
+	{
+	#ifdef __linux__
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		
+		fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	#endif
+	}
+	
+	~CacheMisses()
+	{
+	#ifdef __linux__
+		if (fd >= 0)
+			close(fd);
+	#endif
+	}
+	
+	bool available() const { return fd >= 0; }
+	
+	void start()
+	{
+	#ifdef __linux__
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	#endif
+	}
+	
+	/** the misses since start, 0 if not available */
+	long long stop()
+	{
+		long long misses = 0;
+		
+	#ifdef __linux__
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+				misses = 0;
+		}
+	#endif
+		
+		return misses;
+	}
+	
+private:
+	int fd;
+	
+	CacheMisses( const CacheMisses& );
+	CacheMisses& operator=( const CacheMisses& );
+};
+
+/** Times both versions of each operation on 4K renders, with their cache misses where counters are 
+	available. Returns false if they don't count the same pixels. */
+static bool cache()
+{
+	const int width = 3840, height = 2160;
+	const char* sceneNames[] = { "filling the viewport", "in a corner" };
+	
+	CacheMisses counter;
+	
+	if (!counter.available())
+		std::cout << "no perf counters here, timing only" << std::endl;
+	
+	// the counter follows this thread only
+	PixelSet::threads = 1;
+	
+	bool same = true;
+	
+	for (int scene = 0; scene < 2; scene++) {
+		
+		// the same pair as the throughput, then shrunk to a tenth of the viewport in its top left corner
+		float scale = (scene == 0) ? 1.0f : 0.1f;
+		Image* renderA = makeRender(width, height, PF_L16, 0.4f * width * scale, 0.5f * height * scale, 
+			0.3f * width * scale, 0.35f * height * scale, 1);
+		Image* renderB = makeRender(width, height, PF_L16, 0.6f * width * scale, 0.5f * height * scale, 
+			0.3f * width * scale, 0.35f * height * scale, 2);
+		
+		PixelSet* a = new PixelSet(copyRender(renderA), "a");
+		PixelSet* b = new PixelSet(copyRender(renderB), "b");
+		
+		for (int operation = 0; operation <= OP_LEFT; operation++) {
+			
+			Timer timer;
+			counter.start();
+			int baselineCount = runBaseline((Operation)operation, renderA, renderB);
+			long long baselineMisses = counter.stop();
+			unsigned long baselineTime = timer.getMicroseconds();
+			
+			timer.reset();
+			counter.start();
+			int count = runPixelSet((Operation)operation, renderA, a, b);
+			long long misses = counter.stop();
+			unsigned long time = timer.getMicroseconds();
+			
+			std::cout << operationNames[operation] << ", 4K, " << sceneNames[scene] << ": " 
+				<< baselineTime / 1000.0 << " ms through getColourAt, " << time / 1000.0 << " ms now";
+			
+			if (counter.available())
+				std::cout << ", cache misses per pixel " << double(baselineMisses) / (width * height) 
+					<< " through getColourAt, " << double(misses) / (width * height) << " now";
+			
+			std::cout << std::endl;
+			
+			if (count != baselineCount) {
+				std::cerr << operationNames[operation] << ", 4K, " << sceneNames[scene] << ": " << count 
+					<< " pixels instead of " << baselineCount << std::endl;
+				same = false;
+			}
+		}
+		
+		delete a;
+		delete b;
+		delete renderA;
+		delete renderB;
+	}
+	
+	return same;
+}
+
+/** Returns true if two pixel sets hold the same pixels with the same depths */
+static bool samePixels( PixelSet* x, PixelSet* y )
+{
+	for (int v = 0; v < x->Height(); v++)
+		for (int u = 0; u < x->Width(); u++)
+			if ( x->getDepth(u, v) != y->getDepth(u, v) )
+				return false;
+	
+	return true;
+}
+
+/** A pixel set of a render, stored as asked whatever its fill ratio */
+static PixelSet* storedAs( Image* render, PixelSetStorage storage )
+{
+	PixelSet* ps = new PixelSet(copyRender(render), "a");
+	
+	if (storage == DENSE)
+		ps->makeDense();
+	else
+		ps->makeSparse();
+	
+	return ps;
+}
+
+/** Runs every operator on pixel sets of renders a and b stored as asked, with sparseFillRatio at 
+	fillRatio for their results. Appends the results to results, and returns "operands" if the 
+	operators changed how a or b are stored. */
+static std::string runStored( Image* renderA, Image* renderB, PixelSetStorage storageA, PixelSetStorage storageB, 
+							 float fillRatio, std::vector<PixelSet*>& results, float& distance )
+{
+	PixelSet* a = storedAs(renderA, storageA);
+	PixelSet* b = storedAs(renderB, storageB);
+	
+	float savedRatio = PixelSet::sparseFillRatio;
+	PixelSet::sparseFillRatio = fillRatio;
+	
+	results.push_back(a->Overlap(b));
+	results.push_back(a->CoveredBy(b));
+	results.push_back(a->Left(b));
+	results.push_back(a->Right(b));
+	results.push_back(a->Above(b));
+	results.push_back(a->Below(b));
+	results.push_back(a->Copy("copy"));
+	results.push_back(a->Silhouette());
+	distance = (a->Count() > 0 && b->Count() > 0) ? a->Distance(b) : 0;
+	
+	PixelSet::sparseFillRatio = savedRatio;
+	
+	std::string wrong;
+	if (a->Storage() != storageA || b->Storage() != storageB)
+		wrong = "operands";
+	
+	delete a;
+	delete b;
+	
+	return wrong;
+}
+
+/** Checks that every operator gives the same results on pixel sets stored DENSE, SPARSE or one of each, 
+	with their results stored either way. Returns false if they don't. */
+static bool storage()
+{
+	const char* resultNames[] = { "Overlap", "CoveredBy", "Left", "Right", "Above", "Below", "Copy", "Silhouette" };
+	const int trials = 100;
+	
+	// the operands stored DENSE and SPARSE, then mixed, with their results DENSE, then as sparse as possible
+	const PixelSetStorage storagesA[] = { DENSE, SPARSE, DENSE, SPARSE };
+	const PixelSetStorage storagesB[] = { DENSE, SPARSE, SPARSE, DENSE };
+	const float fillRatios[] = { 0.0f, 1.1f, 0.05f, 0.05f };
+	const char* runNames[] = { "DENSE", "SPARSE", "DENSE and SPARSE", "SPARSE and DENSE" };
+	
+	bool same = true;
+	bool cacheDistance = PixelSet::cacheDistanceTransform;
+	PixelSet::cacheDistanceTransform = false;
+	
+	srand(7);
+	
+	for (int i = 0; i < trials && same; i++) {
+		
+		// odd sizes for partial words of the bitmap, from isolated pixels to solid ellipses
+		int f = i % 2;
+		int width = rand() % 200 + 33, height = rand() % 150 + 17;
+		const int holes[] = { 2, 3, 16, 0 };
+		
+		float cx = float(rand() % width), cy = float(rand() % height);
+		float rx = float(rand() % width + 1), ry = float(rand() % height + 1);
+		Image* renderA = makeRender(width, height, formats[f], cx, cy, rx, ry, rand(), holes[rand() % 4]);
+		
+		cx = float(rand() % width), cy = float(rand() % height);
+		rx = float(rand() % width + 1), ry = float(rand() % height + 1);
+		Image* renderB = makeRender(width, height, formats[f], cx, cy, rx, ry, rand(), holes[rand() % 4]);
+		
+		std::vector<PixelSet*> reference;
+		float referenceDistance;
+		runStored(renderA, renderB, DENSE, DENSE, 0.0f, reference, referenceDistance);
+		
+		for (int run = 0; run < 4; run++) {
+			
+			std::vector<PixelSet*> results;
+			float distance;
+			std::string wrong = runStored(renderA, renderB, storagesA[run], storagesB[run], fillRatios[run], results, distance);
+			
+			for (size_t r = 0; r < results.size(); r++) {
+				
+				// stored DENSE, or SPARSE when the fill ratio is above anything they can hold
+				if ( (fillRatios[run] == 0.0f && results[r]->Storage() != DENSE) || 
+					(fillRatios[run] > 1.0f && results[r]->Storage() != SPARSE) )
+					wrong = resultNames[r];
+				
+				if ( measures(results[r]) != measures(reference[r]) || !samePixels(results[r], reference[r]) ) {
+					std::cerr << resultNames[r] << ", " << formatNames[f] << ", " << runNames[run] << ": " 
+						<< measures(results[r]) << " instead of " << measures(reference[r]) << std::endl;
+					same = false;
+				}
+				
+				delete results[r];
+			}
+			
+			if (!wrong.empty()) {
+				std::cerr << wrong << ", " << runNames[run] << ": not stored as asked" << std::endl;
+				same = false;
+			}
+			
+			if (distance != referenceDistance) {
+				std::cerr << "Distance, " << formatNames[f] << ", " << runNames[run] << ": " << distance 
+					<< " instead of " << referenceDistance << std::endl;
+				same = false;
+			}
+		}
+		
+		for (size_t r = 0; r < reference.size(); r++)
+			delete reference[r];
+		
+		delete renderA;
+		delete renderB;
+	}
+	
+	PixelSet::cacheDistanceTransform = cacheDistance;
+	
+	std::cout << "Storage: " << (same ? "same results DENSE, SPARSE and mixed" : "FAILED") << std::endl;
+	
+	return same;
+}
+
+/** A pixel set whose edge pixels, as Distance finds them, can be looked at */
+class EdgeProbe : public PixelSet
+{
+public:
+	EdgeProbe( Image* render ) : PixelSet(render, "a") {}
+	
+	const std::vector<std::pair<int,int> >& edges() { return edgePixels; }
+	
+	void findEdges() { edgePixels.clear(); FindEdgePixels(); }
+};
+
+/** Returns true if silhouette holds the edge pixels of ps with their depth, and nothing else */
+static bool sameSilhouette( PixelSet* ps, PixelSet* silhouette, const std::vector<std::pair<int,int> >& edges )
+{
+	if ( silhouette->Count() != (int)edges.size() )
+		return false;
+	
+	for (size_t i = 0; i < edges.size(); i++)
+		if ( silhouette->getDepth(edges[i].first, edges[i].second) != ps->getDepth(edges[i].first, edges[i].second) )
+			return false;
+	
+	return true;
+}
+
+/** Checks Silhouette and the edge pixels against the pixel by pixel scan, then times both. 
+	Returns false if they don't find the same pixels. */
+static bool silhouette()
+{
+	const int trials = 100;
+	const int holes[] = { 2, 3, 16, 0 };
+	const PixelSetStorage storages[] = { DENSE, SPARSE };
+	const char* storageNames[] = { "DENSE", "SPARSE" };
+	
+	bool same = true;
+	
+	srand(9);
+	
+	for (int i = 0; i < trials && same; i++) {
+		
+		// odd sizes for partial words of the bitmap, touching the border of the image or not
+		int f = i % 2;
+		int width = rand() % 200 + 33, height = rand() % 150 + 17;
+		float cx = float(rand() % width), cy = float(rand() % height);
+		float rx = float(rand() % width + 1), ry = float(rand() % height + 1);
+		Image* render = makeRender(width, height, formats[f], cx, cy, rx, ry, rand(), holes[rand() % 4]);
+		
+		for (int s = 0; s < 2; s++) {
+			
+			EdgeProbe* ps = new EdgeProbe(copyRender(render));
+			EdgeProbe* fresh = new EdgeProbe(copyRender(render));
+			if (storages[s] == DENSE) {
+				ps->makeDense();
+				fresh->makeDense();
+			} else {
+				ps->makeSparse();
+				fresh->makeSparse();
+			}
+			
+			std::vector<std::pair<int,int> > edges;
+			findEdgePixels(ps, edges);
+			
+			// the edge pixels of Distance, found on their own, then kept from the silhouette
+			ps->findEdges();
+			bool found = ps->edges() == edges;
+			
+			ps->findEdges();
+			PixelSet* result = ps->Silhouette();
+			bool kept = ps->edges() == edges;
+			
+			PixelSet* freshResult = fresh->Silhouette();
+			bool keptFresh = fresh->edges() == edges;
+			
+			if ( !sameSilhouette(ps, result, edges) || !sameSilhouette(ps, freshResult, edges) ) {
+				std::cerr << "Silhouette, " << formatNames[f] << ", " << storageNames[s] << ": " << result->Count() 
+					<< " pixels instead of " << edges.size() << std::endl;
+				same = false;
+			}
+			
+			if ( !found || !kept || !keptFresh ) {
+				std::cerr << "Edge pixels, " << formatNames[f] << ", " << storageNames[s] << ": " << ps->edges().size() 
+					<< " and " << fresh->edges().size() << " instead of " << edges.size() << std::endl;
+				same = false;
+			}
+			
+			delete result;
+			delete freshResult;
+			delete ps;
+			delete fresh;
+		}
+		
+		delete render;
+	}
+	
+	std::cout << "Silhouette: " << (same ? "same as the scan of the eight neighbours" : "FAILED") << std::endl;
+	
+	// the pair of the throughput on a 4K render
+	const int width = 3840, height = 2160, runs = 5;
+	Image* render = makeRender(width, height, PF_L16, 0.4f * width, 0.5f * height, 0.3f * width, 0.35f * height, 1);
+	PixelSet* ps = new PixelSet(copyRender(render), "a");
+	
+	std::vector<std::pair<int,int> > edges;
+	Timer timer;
+	findEdgePixels(ps, edges);
+	unsigned long scan = timer.getMicroseconds();
+	
+	unsigned long kernel = 0;
+	for (int run = 0; run < runs; run++) {
+		PixelSet* fresh = new PixelSet(copyRender(render), "a");
+		timer.reset();
+		delete fresh->Silhouette();
+		kernel += timer.getMicroseconds();
+		delete fresh;
+	}
+	
+	std::cout << "Silhouette, 4K, " << edges.size() << " edge pixels: " << kernel / (runs * 1000.0) 
+		<< " ms through the bitmaps, " << scan / 1000.0 << " ms through the scan" << std::endl;
+	
+	delete ps;
+	delete render;
+	
+	return same;
+}
+
+int main( int argc, char* argv[] )
+{
+	std::string benchmark = argc > 1 ? argv[1] : "";
+	
+	// the operators log to the default log with LOG_OPERATIONS
+	LogManager* logs = new LogManager();
+	logs->createLog("PixelSetBenchmark.log", true, false);
+	
+	bool passed = true;
+	
+	if (benchmark == "" || benchmark == "throughput")
+		passed = throughput() && passed;
+	
+	if (benchmark == "" || benchmark == "distance")
+		passed = distance() && passed;
+	
+	if (benchmark == "" || benchmark == "threads")
+		passed = threads() && passed;
+	
+	if (benchmark == "" || benchmark == "cache")
+		passed = cache() && passed;
+	
+	if (benchmark == "" || benchmark == "storage")
+		passed = storage() && passed;
+	
+	if (benchmark == "" || benchmark == "silhouette")
+		passed = silhouette() && passed;
+	
+	delete logs;
+	
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+# Benchmarks of the PixelSet operators on synthetic renders
+
+TEMPLATE = app
+TARGET = PixelSetBenchmark
+
+INCLUDEPATH += . ../Operators $(OGRE_HOME)/include
+
+CONFIG += console release
+CONFIG -= qt
+
+LIBS += -lOgreMain
+
+# The operators only split their work on several threads with OpenMP
+unix:QMAKE_CXXFLAGS += -fopenmp
+unix:QMAKE_LFLAGS += -fopenmp
+win32:QMAKE_CXXFLAGS += /openmp
+
+HEADERS += ../Operators/PixelSet.h \
+	../Operators/PixelSetKernels.h \
+	../Operators/PixelSetPool.h
+
+SOURCES += PixelSetBenchmark.cpp \
+	  ../Operators/PixelSet.cpp \
+	  ../Operators/PixelSetKernels.cpp \
+	  ../Operators/PixelSetPool.cpp
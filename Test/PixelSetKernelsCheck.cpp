@@ -0,0 +1,115 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+/** Checks the vectorized PixelSet kernels against the scalar ones, on random rows with the 
+	edge cases of both depth formats: empty pixels, equal depths and the extremes of the range.
+	It only needs PixelSetKernels and the integer types of Ogre, and returns non-zero on a mismatch:
+	g++ -I../Operators -I$OGRE_HOME/include PixelSetKernelsCheck.cpp ../Operators/PixelSetKernels.cpp
+*/
+
+#include "PixelSetKernels.h"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Ogre;
+
+static const int ROWS = 100000;
+
+template <typename T, typename Kernel>
+static bool sameWord( Kernel kernel, Kernel reference, const T* src, const T* other )
+{
+	T dest[64], expected[64];
+	
+	if (kernel(src, other, dest) != reference(src, other, expected))
+		return false;
+	
+	return memcmp(dest, expected, sizeof(dest)) == 0;
+}
+
+static bool check( const PixelSetKernels& kernels, const PixelSetKernels& reference )
+{
+	const uint16 depths16[] = { 0, 1, 2, 0x7fff, 0x8000, 0x8001, 0xfffe, 0xffff };
+	const float depths32[] = { 0.0f, 1e-9f, 0.25f, 0.5f, 0.7f, 1.0f };
+	
+	uint16 src16[64], other16[64];
+	float src32[64], other32[64];
+	
+	for (int row = 0; row < ROWS; row++) {
+		
+		// mostly the edge cases, and arbitrary depths for the others
+		for (int i = 0; i < 64; i++) {
+			src16[i] = rand() % 4 ? depths16[rand() % 8] : (uint16)rand();
+			other16[i] = rand() % 4 ? depths16[rand() % 8] : (uint16)rand();
+			src32[i] = rand() % 4 ? depths32[rand() % 6] : (float)rand() / RAND_MAX;
+			other32[i] = rand() % 4 ? depths32[rand() % 6] : (float)rand() / RAND_MAX;
+		}
+		
+		if (!sameWord(kernels.overlap16, reference.overlap16, src16, other16)) {
+			std::cerr << kernels.isa << " Overlap differs on L16 depth" << std::endl;
+			return false;
+		}
+		if (!sameWord(kernels.coveredBy16, reference.coveredBy16, src16, other16)) {
+			std::cerr << kernels.isa << " CoveredBy differs on L16 depth" << std::endl;
+			return false;
+		}
+		if (!sameWord(kernels.overlap32, reference.overlap32, src32, other32)) {
+			std::cerr << kernels.isa << " Overlap differs on float depth" << std::endl;
+			return false;
+		}
+		if (!sameWord(kernels.coveredBy32, reference.coveredBy32, src32, other32)) {
+			std::cerr << kernels.isa << " CoveredBy differs on float depth" << std::endl;
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+int main( int argc, char* argv[] )
+{
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	
+	std::vector<const PixelSetKernels*> kernels = PixelSetKernels::supported();
+	bool passed = true;
+	
+	for (size_t i = 1; i < kernels.size(); i++) {
+		
+		bool same = check(*kernels[i], PixelSetKernels::scalar());
+		std::cout << kernels[i]->isa << ": " << (same ? "same as scalar" : "FAILED") << std::endl;
+		
+		passed = passed && same;
+	}
+	
+	if (kernels.size() == 1)
+		std::cout << "only the scalar kernels are supported, nothing to check" << std::endl;
+	
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,14 @@
+# Standalone check of the vectorized PixelSet kernels against the scalar ones
+
+TEMPLATE = app
+TARGET = PixelSetKernelsCheck
+
+INCLUDEPATH += . ../Operators $(OGRE_HOME)/include
+
+CONFIG += console
+CONFIG -= qt
+
+HEADERS += ../Operators/PixelSetKernels.h
+
+SOURCES += PixelSetKernelsCheck.cpp \
+	  ../Operators/PixelSetKernels.cpp
@@ -0,0 +1,353 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+/** Checks the pixel sets evaluated on the GPU by GpuPixelSet against the PixelSets of the renders 
+	read back, on the city scene of the Test application: the count and extents of the renders of 
+	some of its nodes, and of Overlap, CoveredBy and Left between them, with the camera looking at 
+	each node and away from it so that empty sets are checked too.
+	The same PixelSets are computed by a software Renderer, whose DepthRasterizer has to give 
+	the ones of the GPU renders up to the pixels on the edges of the triangles. It runs as CEL 
+	does without a GPU: a Root with no render system nor window, and a DefaultHardwareBufferManager.
+	A Renderer is created once per process, so each viewport size, odd ones included, is checked 
+	by running the program again with the size as arguments, and "software" for the rasterizer.
+	Both write the measures of their PixelSets to RenderCheck_<size>_<renderer>.txt, which are 
+	compared at last. It is run from the directory of the Test application (plugins.cfg, ogre.cfg, 
+	resources.cfg) and returns non-zero on a mismatch.
+*/
+
+#include "Renderer.h"
+#include "GpuPixelSet.h"
+#include "PixelSet.h"
+#include <OgreMaxScene.hpp>
+#include <OgreDefaultHardwareBufferManager.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+
+using namespace Ogre;
+
+static const char* nodeNames[] = { "transporter1", "Carpark", "Dustbin", "Roadsign", "manhole" };
+static const int NODES = 5;
+
+static const int sizes[][2] = { { 640, 480 }, { 333, 171 }, { 257, 255 }, { 31, 17 } };
+static const int SIZES = 4;
+
+/** Pixels the rasterizer may cover differently from the GPU, at least, and per 1000 pixels of a set */
+static const int EDGE_PIXELS = 16;
+static const int EDGE_PER_MILLE = 20;
+
+/** Count and extents of a pixel set */
+struct Measures {
+	
+	int count, minX, maxX, minY, maxY;
+	
+	Measures() : count(0), minX(-1), maxX(-1), minY(-1), maxY(-1) {}
+	
+	template <typename Set>
+	Measures( Set* ps ) : count(ps->Count()), minX(ps->Min_x()), maxX(ps->Max_x()), minY(ps->Min_y()), maxY(ps->Max_y()) {}
+	
+	bool operator==( const Measures& m ) const {
+		return count == m.count && minX == m.minX && maxX == m.maxX && minY == m.minY && maxY == m.maxY;
+	}
+	
+	/** Same up to the pixels on the edges of the triangles, which the rasterizer may cover differently */
+	bool isClose( const Measures& m ) const {
+		
+		int slack = std::max(EDGE_PIXELS, std::max(count, m.count) * EDGE_PER_MILLE / 1000);
+		
+		if (abs(count - m.count) > slack)
+			return false;
+		
+		// a set that is empty for one may be a few pixels anywhere for the other
+		if (count == 0 || m.count == 0)
+			return true;
+		
+		return abs(minX - m.minX) <= 1 && abs(maxX - m.maxX) <= 1 && abs(minY - m.minY) <= 1 && abs(maxY - m.maxY) <= 1;
+	}
+};
+
+static std::ostream& operator<<( std::ostream& out, const Measures& m )
+{
+	return out << m.count << " pixels in [" << m.minX << ", " << m.maxX << "] x [" << m.minY << ", " << m.maxY << "]";
+}
+
+/** Measures of the PixelSets of a Renderer, with what they are the measures of */
+typedef std::vector<std::pair<String, Measures> > MeasuresList;
+
+/** An operator of both kinds of pixel sets */
+struct Operator {
+	const char* name;
+	PixelSet* (PixelSet::*cpu)( PixelSet* );
+	GpuPixelSet* (GpuPixelSet::*gpu)( GpuPixelSet* );
+};
+
+static const Operator operators[] = {
+	{ "Overlap", &PixelSet::Overlap, &GpuPixelSet::Overlap },
+	{ "CoveredBy", &PixelSet::CoveredBy, &GpuPixelSet::CoveredBy },
+	{ "Left", &PixelSet::Left, &GpuPixelSet::Left }
+};
+static const int OPERATORS = 3;
+
+/** Adds the measures of cpu to the list, and compares them to the ones of gpu if any */
+static bool compare( const String& what, PixelSet* cpu, GpuPixelSet* gpu, MeasuresList& measures )
+{
+	Measures expected(cpu);
+	measures.push_back(std::make_pair(what, expected));
+	
+	if (!gpu)
+		return true;
+	
+	Measures measured(gpu);
+	
+	if (expected == measured)
+		return true;
+	
+	std::cerr << what << ": " << expected << " on the CPU, " << measured << " on the GPU" << std::endl;
+	return false;
+}
+
+/** Measures the renders of a and b, and the operators between them, b being rendered in modeB. 
+	When the GPU pixel sets are available, they are compared to the PixelSets. */
+static bool checkPair( SceneNode* a, SceneNode* b, RenderingMode modeB, const String& view, MeasuresList& measures )
+{
+	std::vector<SceneNode*> nodesA(1, a), nodesB(1, b);
+	
+	PixelSet* cpuA = Renderer::OgreRenderer->Render(nodesA, NODE);
+	PixelSet* cpuB = Renderer::OgreRenderer->Render(nodesB, modeB);
+	GpuPixelSet* gpuA = GpuPixelSet::Render(nodesA, NODE);
+	GpuPixelSet* gpuB = GpuPixelSet::Render(nodesB, modeB);
+	
+	String nameB = (modeB == NODE ? "" : "!") + b->getName();
+	
+	bool same = compare("R(" + a->getName() + ") " + view, cpuA, gpuA, measures);
+	same = compare("R(" + nameB + ") " + view, cpuB, gpuB, measures) && same;
+	
+	for (int i = 0; i < OPERATORS; i++) {
+		
+		PixelSet* cpu = (cpuA->*operators[i].cpu)(cpuB);
+		GpuPixelSet* gpu = gpuA ? (gpuA->*operators[i].gpu)(gpuB) : 0;
+		
+		same = compare(String(operators[i].name) + "(" + a->getName() + ", " + nameB + ") " + view, cpu, gpu, measures) && same;
+		
+		cpu->Release();
+		delete gpu;
+	}
+	
+	cpuA->Release();
+	cpuB->Release();
+	delete gpuA;
+	delete gpuB;
+	
+	return same;
+}
+
+/** Measures the pixel sets of the nodes, looking at each one and away from it */
+static bool check( SceneManager* sceneManager, Camera* camera, MeasuresList& measures )
+{
+	std::vector<SceneNode*> nodes;
+	for (int i = 0; i < NODES; i++)
+		nodes.push_back(sceneManager->getSceneNode(nodeNames[i]));
+	
+	sceneManager->getRootSceneNode()->_update(true, false);
+	
+	bool same = true;
+	
+	for (int i = 0; i < NODES; i++) {
+		
+		const AxisAlignedBox& bounds = nodes[i]->_getWorldAABB();
+		Vector3 center = bounds.getCenter();
+		Real distance = std::max(bounds.getHalfSize().length() * 3, (Real)1.0);
+		
+		camera->setPosition(center + Vector3(1.0, 0.5, 1.0).normalisedCopy() * distance);
+		
+		for (int away = 0; away < 2; away++) {
+			
+			// looking away, the renders of the node are empty
+			camera->setDirection(away ? camera->getPosition() - center : center - camera->getPosition());
+			String view = away ? "away from " + nodes[i]->getName() : "at " + nodes[i]->getName();
+			
+			for (int j = 0; j < NODES; j++)
+				if (j != i)
+					same = checkPair(nodes[i], nodes[j], NODE, view, measures) && same;
+			
+			same = checkPair(nodes[i], nodes[i], ALL_BUT_NODE, view, measures) && same;
+		}
+	}
+	
+	return same;
+}
+
+static String measuresFile( int width, int height, bool software )
+{
+	std::ostringstream name;
+	name << "RenderCheck_" << width << "x" << height << (software ? "_software" : "_gpu") << ".txt";
+	return name.str();
+}
+
+/** Loads the city scene in a hidden window of width x height pixels, and checks it with a Renderer 
+	of that size, writing the measures of its PixelSets to measuresFile() */
+static bool checkSize( int width, int height, bool software )
+{
+	Root* root;
+	RenderWindow* window = 0;
+	DefaultHardwareBufferManager* buffers = 0;
+	SceneType sceneType = ST_GENERIC;
+	
+	if (software) {
+		
+		// no plugins and no render system, the meshes are loaded into buffers in memory
+		root = new Root("", "", "RenderCheck.log");
+		buffers = new DefaultHardwareBufferManager();
+	}
+	else {
+		
+		root = new Root("plugins.cfg", "ogre.cfg", "RenderCheck.log");
+		
+		if (!root->restoreConfig() && !root->showConfigDialog()) {
+			delete root;
+			return false;
+		}
+		
+		root->initialise(false);
+		
+		NameValuePairList options;
+		options["hidden"] = "true";
+		window = root->createRenderWindow("RenderCheck", width, height, false, &options);
+		sceneType = ST_EXTERIOR_CLOSE;
+	}
+	
+	// the resources of the Test application
+	ConfigFile resources;
+	resources.load("resources.cfg");
+	
+	ConfigFile::SectionIterator sections = resources.getSectionIterator();
+	while (sections.hasMoreElements()) {
+		
+		String group = sections.peekNextKey();
+		ConfigFile::SettingsMultiMap* settings = sections.getNext();
+		
+		ConfigFile::SettingsMultiMap::iterator setting;
+		for (setting = settings->begin(); setting != settings->end(); ++setting)
+			ResourceGroupManager::getSingleton().addResourceLocation(setting->second, setting->first, group);
+	}
+	ResourceGroupManager::getSingleton().initialiseAllResourceGroups();
+	
+	SceneManager* sceneManager = root->createSceneManager(sceneType);
+	OgreMax::OgreMaxScene().Load("city.scene", window, OgreMax::OgreMaxScene::NO_OPTIONS, sceneManager, sceneManager->getRootSceneNode());
+	
+	Camera* camera = sceneManager->createCamera("RenderCheckCam");
+	camera->setNearClipDistance(0.2);
+	camera->setFarClipDistance(2000.0);
+	camera->setAspectRatio((Real)width / height);
+	
+	Renderer* renderer = new Renderer(sceneManager, width, height, software);
+	renderer->setCamera(camera);
+	
+	if (!software && !GpuPixelSet::isAvailable())
+		std::cout << "the GPU pixel sets are not available, only the renders are measured" << std::endl;
+	
+	MeasuresList measures;
+	bool passed = check(sceneManager, camera, measures);
+	
+	delete renderer;
+	delete root;
+	delete buffers;
+	
+	std::ofstream file(measuresFile(width, height, software).c_str());
+	for (size_t i = 0; i < measures.size(); i++) {
+		const Measures& m = measures[i].second;
+		file << measures[i].first << "\t" << m.count << " " << m.minX << " " << m.maxX << " " << m.minY << " " << m.maxY << "\n";
+	}
+	
+	if (!software)
+		std::cout << width << "x" << height << ": " << (passed ? "same on the CPU and the GPU" : "FAILED") << std::endl;
+	
+	return passed && file.good();
+}
+
+static bool readMeasures( const String& fileName, MeasuresList& measures )
+{
+	std::ifstream file(fileName.c_str());
+	String what;
+	
+	while (std::getline(file, what, '\t')) {
+		Measures m;
+		file >> m.count >> m.minX >> m.maxX >> m.minY >> m.maxY;
+		file.ignore(1);
+		measures.push_back(std::make_pair(what, m));
+	}
+	
+	return !measures.empty();
+}
+
+/** Compares the PixelSets of the DepthRasterizer to the ones of the GPU renders */
+static bool compareSoftware( int width, int height )
+{
+	MeasuresList gpu, software;
+	
+	if (!readMeasures(measuresFile(width, height, false), gpu) || !readMeasures(measuresFile(width, height, true), software) || 
+		gpu.size() != software.size()) {
+		std::cerr << "the measures of the renders at " << width << "x" << height << " are missing" << std::endl;
+		return false;
+	}
+	
+	bool close = true;
+	
+	for (size_t i = 0; i < gpu.size(); i++)
+		if (!gpu[i].second.isClose(software[i].second)) {
+			std::cerr << gpu[i].first << ": " << gpu[i].second << " rendered, " << software[i].second << " rasterized" << std::endl;
+			close = false;
+		}
+	
+	std::cout << width << "x" << height << ": " << (close ? "rasterized as rendered" : "FAILED") << std::endl;
+	
+	return close;
+}
+
+int main( int argc, char* argv[] )
+{
+	if (argc > 2)
+		return checkSize(atoi(argv[1]), atoi(argv[2]), argc > 3 && String(argv[3]) == "software") ? 0 : 1;
+	
+	bool passed = true;
+	
+	for (int i = 0; i < SIZES; i++) {
+		
+		std::ostringstream command;
+		command << "\"" << argv[0] << "\" " << sizes[i][0] << " " << sizes[i][1];
+		
+		passed = system(command.str().c_str()) == 0 && passed;
+		passed = system((command.str() + " software").c_str()) == 0 && passed;
+		passed = compareSoftware(sizes[i][0], sizes[i][1]) && passed;
+	}
+	
+	return passed ? 0 : 1;
+}
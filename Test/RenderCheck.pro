@@ -0,0 +1,36 @@
+# Check of the GPU pixel sets and of the DepthRasterizer against the renders, on the city scene
+
+TEMPLATE = app
+TARGET = RenderCheck
+
+INCLUDEPATH += . ../Operators ../OgreMax ../tinyxml $(OGRE_HOME)/include
+
+CONFIG += console
+CONFIG -= qt
+
+LIBS += -lOgreMain
+
+HEADERS += ../Operators/DepthRasterizer.h \
+	../Operators/GpuPixelSet.h \
+	../Operators/PixelSet.h \
+	../Operators/PixelSetKernels.h \
+	../Operators/PixelSetPool.h \
+	../Operators/RenderCache.h \
+	../Operators/Renderer.h
+
+SOURCES += RenderCheck.cpp \
+	  ../OgreMax/OgreMaxModel.cpp \
+	  ../OgreMax/OgreMaxScene.cpp \
+	  ../OgreMax/OgreMaxUtilities.cpp \
+	  ../OgreMax/ProgressCalculator.cpp \
+	  ../OgreMax/Version.cpp \
+	  ../tinyxml/tinyxml.cpp \
+	  ../tinyxml/tinyxmlerror.cpp \
+	  ../tinyxml/tinyxmlparser.cpp \
+	  ../Operators/DepthRasterizer.cpp \
+	  ../Operators/GpuPixelSet.cpp \
+	  ../Operators/PixelSet.cpp \
+	  ../Operators/PixelSetKernels.cpp \
+	  ../Operators/PixelSetPool.cpp \
+	  ../Operators/RenderCache.cpp \
+	  ../Operators/Renderer.cpp
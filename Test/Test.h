@@ -48,15 +48,20 @@ using Ogre::Node;
 #include <Renderer.h>
 #include <celparser.h>
 #include <map>
+#include <fstream>
 
 using namespace CEL;
 
 /** Console-related global variables */
 String celFile, oldCelFile;	
 
-bool evaluate, quit, load, reload, initial = true, help;
+bool evaluate, quit, load, reload, initial = true, help, benchmark;
 CelParser *cp = 0;
 
+/** Benchmark-related global variables */
+String benchmarkMode;
+unsigned int benchmarkSize;
+
 void reloadFile(std::vector<String>& args) {
 	reload = true;
 }
@@ -83,6 +88,14 @@ void evaluateFile(std::vector<String>& args) {
 	evaluate = true;
 }
 
+void benchmarkScripts(std::vector<String>& args) {
+
+	benchmarkMode = args.size() > 1 ? args[1] : "";
+	benchmarkSize = args.size() > 2 ? StringConverter::parseUnsignedInt(args[2]) : 0;
+	
+	benchmark = true;
+}
+
 void quitTest(std::vector<String>& args) {
 	quit = true;
 }
@@ -113,6 +126,7 @@ public:
 		OgreConsole::getSingleton().addCommand("evaluate", &evaluateFile);
 		OgreConsole::getSingleton().addCommand("help", &helpMe);
 		OgreConsole::getSingleton().addCommand("reload", &reloadFile);
+		OgreConsole::getSingleton().addCommand("benchmark", &benchmarkScripts);
 		OgreConsole::getSingleton().addCommand("quit", &quitTest);
 		OgreConsole::getSingleton().addCommand("exit", &quitTest);
 
@@ -210,6 +224,13 @@ public:
 			OgreConsole::getSingleton().print("  \"clear\" clears the CEL console,\n");
 			OgreConsole::getSingleton().print("  \"evaluate\" or keypress [E] (console closed) evaluates the current CEL script,\n");
 			OgreConsole::getSingleton().print("  \"reload\" or keypress [R] (console closed) reloads the current CEL script,\n");
+			OgreConsole::getSingleton().print("  \"benchmark targets <nodes>\" times the binding of render targets in a scene grown to <nodes> scene nodes,\n");
+			OgreConsole::getSingleton().print("  \"benchmark poses <poses>\" times the evaluation of the current CEL script for <poses> camera poses,\n");
+			OgreConsole::getSingleton().print("  \"benchmark vm <runs>\" times the camera shots of the current CEL script run as bytecode against their trees,\n");
+			OgreConsole::getSingleton().print("  \"benchmark readback <renders>\" times <renders> renders of the scene nodes read back at once, then asynchronously,\n");
+			OgreConsole::getSingleton().print("  \"benchmark cube <renders>\" times <renders> cube renders of the scene nodes against six renders read back face by face,\n");
+			OgreConsole::getSingleton().print("  \"benchmark window <renders>\" times <renders> renders of the scene nodes read back whole, then only their screen rectangles,\n");
+			OgreConsole::getSingleton().print("  \"benchmark calls <calls>\" times a script calling a small function <calls> times, as bytecode and walking its trees,\n");
 			OgreConsole::getSingleton().print("  \"exit\" or \"quit\" terminates the application,\n");
 			OgreConsole::getSingleton().print("  [TAB] toggles the console (console closed/open).\n\n");	
 			
@@ -282,6 +303,28 @@ public:
 			}
 		}
 		
+		if (benchmark) {
+		
+			benchmark = false;
+			
+			if (benchmarkMode == "targets")
+				benchmarkTargets(benchmarkSize > 0 ? benchmarkSize : 5000);
+			else if (benchmarkMode == "poses")
+				benchmarkPoses(benchmarkSize > 0 ? benchmarkSize : 100);
+			else if (benchmarkMode == "vm")
+				benchmarkCompiled(benchmarkSize > 0 ? benchmarkSize : 10000);
+			else if (benchmarkMode == "readback")
+				benchmarkReadback(benchmarkSize > 0 ? benchmarkSize : 300);
+			else if (benchmarkMode == "cube")
+				benchmarkCube(benchmarkSize > 0 ? benchmarkSize : 100);
+			else if (benchmarkMode == "window")
+				benchmarkWindow(benchmarkSize > 0 ? benchmarkSize : 300);
+			else if (benchmarkMode == "calls")
+				benchmarkCalls(benchmarkSize > 0 ? benchmarkSize : 100000);
+			else
+				LogManager::getSingleton().logMessage("unknown benchmark " + benchmarkMode);
+		}
+		
 		if (reload) {
 			
 			reload = false;
@@ -304,6 +347,364 @@ public:
 		}
 	}
 
+	/** Grows the scene to nbNodes empty scene nodes, then times a script whose function 
+	 * bodies render targets passed by the call sites, alternating between a target of the 
+	 * city and the nodes added last. The renders bind their targets through the call sites, 
+	 * so the evaluations should not slow down as the scene grows. */
+	void benchmarkTargets(unsigned int nbNodes) {
+	
+		SceneNode* benchmarkNode = mSceneMgr->hasSceneNode("CEL_Benchmark") ? 
+			mSceneMgr->getSceneNode("CEL_Benchmark") : 
+			mSceneMgr->getRootSceneNode()->createChildSceneNode("CEL_Benchmark");
+		
+		for (unsigned int i = benchmarkNode->numChildren(); i < nbNodes; i++)
+			benchmarkNode->createChildSceneNode("CEL_Benchmark_" + StringConverter::toString(i));
+		
+		const unsigned int nbShots = 32, nbRuns = 50;
+		String script = "../Scripts/benchmark_targets.cel";
+		
+		std::ofstream out(script.c_str());
+		out << "Declare\n\nArea(obj) = Count(R(obj));\n\nEvaluate\n\n";
+		for (unsigned int i = 0; i < nbShots; i++) {
+			if (i % 2 == 0)
+				out << "Area(\"transporter1\");\n";
+			else
+				out << "Area(\"CEL_Benchmark_" << nbNodes - 1 - i / 2 % nbNodes << "\");\n";
+		}
+		out.close();
+		
+		try {
+		
+			CelParser parser(script);
+			parser.initSymbolTable();
+			parser.parseFile();
+			
+			offScreenR->setCamera(mCamera);
+			parser.evaluate();
+			
+			Ogre::Timer timer;
+			for (unsigned int run = 0; run < nbRuns; run++)
+				parser.evaluate();
+			unsigned long elapsed = timer.getMicroseconds();
+			
+			LogManager::getSingleton().logMessage("benchmark targets: " + 
+				StringConverter::toString(nbNodes) + " scene nodes, " + 
+				StringConverter::toString(nbRuns * nbShots) + " camera shots in " + 
+				StringConverter::toString(elapsed / 1000) + " ms, " + 
+				StringConverter::toString(elapsed / float(nbRuns * nbShots)) + " us per camera shot");
+		
+		} catch (CelParserException e) {
+			LogManager::getSingleton().logMessage("CEL parser error: " + e.getError());
+		}
+	}
+
+	/** Times the evaluation of the current script for nbPoses poses of the camera, turning 
+	 * around where it stands, and logs the number of poses evaluated per second. */
+	void benchmarkPoses(unsigned int nbPoses) {
+	
+		if (cp == 0) {
+			LogManager::getSingleton().logMessage("invalid CEL script");
+			return;
+		}
+		
+		std::vector<CameraPose> poses(nbPoses);
+		
+		for (unsigned int i = 0; i < nbPoses; i++) {
+			poses[i].position = mCamera->getPosition();
+			poses[i].orientation = Quaternion(Degree(360.0f * i / nbPoses), Vector3::UNIT_Y) * mCamera->getOrientation();
+			poses[i].fovY = mCamera->getFOVy();
+			poses[i].nearClipDistance = mCamera->getNearClipDistance();
+			poses[i].farClipDistance = mCamera->getFarClipDistance();
+		}
+		
+		std::vector< std::vector<double> > evaluations;
+		
+		try {
+		
+			offScreenR->setCamera(mCamera);
+			
+			Ogre::Timer timer;
+			cp->evaluate(poses, evaluations);
+			unsigned long elapsed = timer.getMicroseconds();
+			
+			LogManager::getSingleton().logMessage("benchmark poses: " + 
+				StringConverter::toString(nbPoses) + " poses of " + celFile + " in " + 
+				StringConverter::toString(elapsed / 1000) + " ms, " + 
+				StringConverter::toString(nbPoses * 1000000.0f / std::max(elapsed, 1UL)) + " poses per second");
+		
+		} catch (CelParserException e) {
+			LogManager::getSingleton().logMessage("CEL parser error: " + e.getError());
+		}
+	}
+
+	/** Times the camera shots of the current script run nbRuns times as bytecode, then walking 
+	 * their trees, once their pixel sets are rendered and shared, and logs the time per camera 
+	 * shot each way. */
+	void benchmarkCompiled(unsigned int nbRuns) {
+	
+		if (cp == 0) {
+			LogManager::getSingleton().logMessage("invalid CEL script");
+			return;
+		}
+		
+		try {
+		
+			offScreenR->setCamera(mCamera);
+			
+			double compiled, tree;
+			cp->benchmarkShots(nbRuns, compiled, tree);
+			
+			LogManager::getSingleton().logMessage("benchmark vm: " + 
+				StringConverter::toString(nbRuns) + " runs of " + celFile + ", " + 
+				StringConverter::toString(Real(compiled)) + " us per camera shot as bytecode, " + 
+				StringConverter::toString(Real(tree)) + " us per camera shot as trees");
+		
+		} catch (CelParserException e) {
+			LogManager::getSingleton().logMessage("CEL parser error: " + e.getError());
+		}
+	}
+
+	/** Collects the scene nodes holding objects under node, the targets the render benchmarks render */
+	void collectTargets(SceneNode* node, std::vector<SceneNode*>& targets) {
+	
+		if (node->numAttachedObjects() > 0)
+			targets.push_back(node);
+		
+		SceneNode::ChildNodeIterator it = node->getChildIterator();
+		while (it.hasMoreElements())
+			collectTargets(static_cast<SceneNode*>(it.getNext()), targets);
+	}
+
+	/** Renders the scene nodes holding objects in turn, nbRenders times, and evaluates the silhouette 
+	 * of each pixel set: first reading each rendering back as soon as it is issued, as Render() does, 
+	 * then through RenderAsync() and Resolve(), Renderer::asyncDepth renderings ahead so that the 
+	 * GPU renders the next ones while the CPU evaluates. Logs the renders per second each way. */
+	void benchmarkReadback(unsigned int nbRenders) {
+	
+		std::vector<SceneNode*> targets;
+		collectTargets(mSceneMgr->getRootSceneNode(), targets);
+		
+		if (targets.empty()) {
+			LogManager::getSingleton().logMessage("no scene node to render");
+			return;
+		}
+		
+		// the cache would serve the renders of a node after the first one
+		bool persistentCache = offScreenR->isPersistentCache();
+		offScreenR->setPersistentCache(false);
+		
+		offScreenR->setCamera(mCamera);
+		offScreenR->ClearTargets();
+		
+		Ogre::Timer timer;
+		for (unsigned int i = 0; i < nbRenders; i++) {
+			
+			PixelSet* ps = offScreenR->Render(targets[i % targets.size()], mCamera);
+			delete ps->Silhouette();
+			ps->Release();
+			
+			if ((i + 1) % targets.size() == 0)
+				offScreenR->ClearTargets();
+		}
+		offScreenR->ClearTargets();
+		unsigned long sync = timer.getMicroseconds();
+		
+		std::vector<RenderHandle> handles(nbRenders);
+		unsigned int nbIssued = 0;
+		
+		timer.reset();
+		for (unsigned int i = 0; i < nbRenders; i++) {
+			
+			for (; nbIssued < nbRenders && nbIssued < i + Renderer::asyncDepth; nbIssued++)
+				handles[nbIssued] = offScreenR->RenderAsync(std::vector<SceneNode*>(1, targets[nbIssued % targets.size()]), mCamera);
+			
+			PixelSet* ps = offScreenR->Resolve(handles[i]);
+			delete ps->Silhouette();
+			ps->Release();
+		}
+		unsigned long async = timer.getMicroseconds();
+		
+		offScreenR->setPersistentCache(persistentCache);
+		
+		LogManager::getSingleton().logMessage("benchmark readback: " + 
+			StringConverter::toString(nbRenders) + " renders of " + 
+			StringConverter::toString(targets.size()) + " scene nodes, " + 
+			StringConverter::toString(nbRenders * 1000000.0f / std::max(sync, 1UL)) + " renders per second read back at once, " + 
+			StringConverter::toString(nbRenders * 1000000.0f / std::max(async, 1UL)) + " renders per second read back asynchronously");
+	}
+
+	/** Times nbRenders cube renders of the scene nodes holding objects, in turn, from the camera: 
+	 * first as CR() used to do them, turning a camera to each face and reading each face back 
+	 * before rendering the next, here six Render() of the viewport from a camera of 90 degrees, 
+	 * then through CubeRender(), which renders the faces back to back into the cube texture and 
+	 * reads them back at the end. Logs the latency of a cube render each way. */
+	void benchmarkCube(unsigned int nbRenders) {
+	
+		std::vector<SceneNode*> targets;
+		collectTargets(mSceneMgr->getRootSceneNode(), targets);
+		
+		if (targets.empty()) {
+			LogManager::getSingleton().logMessage("no scene node to render");
+			return;
+		}
+		
+		// the cache would serve the renders of a node after the first one
+		bool persistentCache = offScreenR->isPersistentCache();
+		offScreenR->setPersistentCache(false);
+		
+		offScreenR->setCamera(mCamera);
+		offScreenR->ClearTargets();
+		
+		// the faces in the order of CubeRender(), turned around the axes of the camera
+		Camera* faceCamera = mSceneMgr->createCamera("CEL_BenchmarkCubeCamera");
+		faceCamera->setPosition(mCamera->getDerivedPosition());
+		faceCamera->setFOVy(Degree(90));
+		faceCamera->setAspectRatio(1.0f);
+		faceCamera->setNearClipDistance(mCamera->getNearClipDistance());
+		faceCamera->setFarClipDistance(mCamera->getFarClipDistance());
+		
+		Quaternion orientation = mCamera->getDerivedOrientation();
+		Vector3 up = orientation * Vector3::UNIT_Y;
+		Vector3 right = orientation * Vector3::UNIT_X;
+		
+		Quaternion faceOrientations[6] = {
+			Quaternion(Degree(-90), up) * orientation,
+			Quaternion(Degree(90), up) * orientation,
+			Quaternion(Degree(90), right) * orientation,
+			Quaternion(Degree(-90), right) * orientation,
+			Quaternion(Degree(180), up) * orientation,
+			orientation
+		};
+		
+		Ogre::Timer timer;
+		for (unsigned int i = 0; i < nbRenders; i++) {
+			
+			for (int face = 0; face < 6; face++) {
+				faceCamera->setOrientation(faceOrientations[face]);
+				offScreenR->Render(targets[i % targets.size()], faceCamera)->Release();
+			}
+			
+			// the six faces of a node are six keys, dropped with the renders of the others
+			if ((i + 1) % targets.size() == 0)
+				offScreenR->ClearTargets();
+		}
+		offScreenR->ClearTargets();
+		unsigned long faceByFace = timer.getMicroseconds();
+		
+		timer.reset();
+		for (unsigned int i = 0; i < nbRenders; i++) {
+			
+			offScreenR->CubeRender(targets[i % targets.size()], mCamera)->Release();
+			
+			if ((i + 1) % targets.size() == 0)
+				offScreenR->ClearTargets();
+		}
+		offScreenR->ClearTargets();
+		unsigned long cube = timer.getMicroseconds();
+		
+		mSceneMgr->destroyCamera(faceCamera);
+		offScreenR->setPersistentCache(persistentCache);
+		
+		LogManager::getSingleton().logMessage("benchmark cube: " + 
+			StringConverter::toString(nbRenders) + " cube renders of " + 
+			StringConverter::toString(targets.size()) + " scene nodes, " + 
+			StringConverter::toString(faceByFace / float(nbRenders)) + " us per cube render read back face by face, " + 
+			StringConverter::toString(cube / float(nbRenders)) + " us per cube render through the cube texture");
+	}
+
+	/** Times nbRenders renders of the scene nodes holding objects, in turn, reading back and scanning 
+	 * the whole viewport, then only the screen rectangle of each node, see Renderer::setWindowedReadback(). 
+	 * Logs the time per render each way, and the pixels the nodes cover on average. */
+	void benchmarkWindow(unsigned int nbRenders) {
+	
+		std::vector<SceneNode*> targets;
+		collectTargets(mSceneMgr->getRootSceneNode(), targets);
+		
+		if (targets.empty()) {
+			LogManager::getSingleton().logMessage("no scene node to render");
+			return;
+		}
+		
+		// the cache would serve the renders of a node after the first one
+		bool persistentCache = offScreenR->isPersistentCache();
+		bool windowedReadback = offScreenR->isWindowedReadback();
+		offScreenR->setPersistentCache(false);
+		
+		offScreenR->setCamera(mCamera);
+		offScreenR->ClearTargets();
+		
+		unsigned long elapsed[2];
+		double pixels = 0;
+		
+		for (int windowed = 0; windowed < 2; windowed++) {
+			
+			offScreenR->setWindowedReadback(windowed == 1);
+			
+			Ogre::Timer timer;
+			for (unsigned int i = 0; i < nbRenders; i++) {
+				
+				PixelSet* ps = offScreenR->Render(targets[i % targets.size()], mCamera);
+				if (windowed == 1)
+					pixels += ps->Count();
+				ps->Release();
+				
+				if ((i + 1) % targets.size() == 0)
+					offScreenR->ClearTargets();
+			}
+			offScreenR->ClearTargets();
+			elapsed[windowed] = timer.getMicroseconds();
+		}
+		
+		offScreenR->setWindowedReadback(windowedReadback);
+		offScreenR->setPersistentCache(persistentCache);
+		
+		LogManager::getSingleton().logMessage("benchmark window: " + 
+			StringConverter::toString(nbRenders) + " renders of " + 
+			StringConverter::toString(targets.size()) + " scene nodes covering " + 
+			StringConverter::toString(Real(pixels / nbRenders)) + " pixels of the " + 
+			StringConverter::toString(offScreenR->getViewportWidth()) + "x" + 
+			StringConverter::toString(offScreenR->getViewportHeight()) + " viewport on average, " + 
+			StringConverter::toString(elapsed[0] / float(nbRenders)) + " us per render reading back the viewport, " + 
+			StringConverter::toString(elapsed[1] / float(nbRenders)) + " us per render reading back the rectangles of the nodes");
+	}
+
+	/** Times a script calling a small function nbCalls times, in camera shots of ten calls each, 
+	 * run as bytecode, then walking their trees. The calls push activation frames, so their cost 
+	 * should not depend on the symbols of the script. Logs the time per call each way. */
+	void benchmarkCalls(unsigned int nbCalls) {
+	
+		const unsigned int nbShots = 100, nbCallsPerShot = 10;
+		unsigned int nbRuns = std::max(1U, nbCalls / (nbShots * nbCallsPerShot));
+		String script = "../Scripts/benchmark_calls.cel";
+		
+		std::ofstream out(script.c_str());
+		out << "Declare\n\nSq(x) = x * x + 1;\n\nEvaluate\n\n";
+		for (unsigned int i = 0; i < nbShots; i++) {
+			for (unsigned int j = 0; j < nbCallsPerShot; j++)
+				out << (j > 0 ? " + " : "") << "Sq(" << i * nbCallsPerShot + j << ")";
+			out << ";\n";
+		}
+		out.close();
+		
+		try {
+		
+			CelParser parser(script);
+			parser.initSymbolTable();
+			parser.parseFile();
+			
+			double compiled, tree;
+			parser.benchmarkShots(nbRuns, compiled, tree);
+			
+			LogManager::getSingleton().logMessage("benchmark calls: " + 
+				StringConverter::toString(nbRuns * nbShots * nbCallsPerShot) + " calls, " + 
+				StringConverter::toString(Real(compiled / nbCallsPerShot)) + " us per call as bytecode, " + 
+				StringConverter::toString(Real(tree / nbCallsPerShot)) + " us per call walking the trees");
+		
+		} catch (CelParserException e) {
+			LogManager::getSingleton().logMessage("CEL parser error: " + e.getError());
+		}
+	}
+
 	/** We need a sceneNode in order to make frustums inherit the camera's 
 	 * direction/position. For this reason the ExampleFrameListener's 
 	 * moveCamera method has been redefined in order to handle a SceneNode,
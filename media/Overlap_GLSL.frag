@@ -0,0 +1,47 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+// Overlap(source, other): the pixels of source that are in other too, see PixelSet::Overlap.
+// Both pixel sets are render textures of the size of the target, sampled at the pixel written.
+uniform sampler2D source;
+uniform sampler2D other;
+uniform vec2 size;
+
+void main()
+{
+	
+	vec2 uv = gl_FragCoord.xy / size;
+	float s = texture2D(source, uv).r;
+	float o = texture2D(other, uv).r;
+	
+	float depth = (s > 0.0 && o > 0.0) ? s : 0.0;
+	gl_FragColor = vec4(depth, depth, depth, 1.0);
+	
+}
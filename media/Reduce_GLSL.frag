@@ -0,0 +1,48 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+// Following steps of the reduction of the extents: the min of a 2x2 block of source
+uniform sampler2D source;
+uniform vec2 size;
+
+vec4 extents(vec2 p)
+{
+	return texture2D(source, (p + 0.5) / size);
+}
+
+void main()
+{
+	
+	vec2 p = floor(gl_FragCoord.xy) * 2.0;
+	vec2 q = min(p + 1.0, size - 1.0);
+	
+	gl_FragColor = min(min(extents(p), extents(vec2(q.x, p.y))), min(extents(vec2(p.x, q.y)), extents(q)));
+	
+}
@@ -0,0 +1,65 @@
+/*
+--------------------------------------------------------------------------------
+This source file is part of CEL (Camera Evaluation Language), a research project
+by Marc Christie (INRIA-Rennes, France), Roberto Ranon and Tommaso Urli (both
+from HCI-Lab, University of Udine, Italy).
+
+For the latest info, see http://www.cameracontrol.org/language
+
+Copyright (c) 2010 INRIA Rennes, France and University of Udine, Italy
+Also see acknowledgements in Readme.txt
+
+If you use, modify, or simply find this code interesting please let us know
+at info@cameracontrol.org.
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+http://www.gnu.org/copyleft/lesser.txt.
+--------------------------------------------------------------------------------
+*/
+
+// Left, Right, Above and Below(source, other): the pixels of source on one side of the
+// bounding box of other, see PixelSet::RSL. other is the 1x1 texture of the extents of 
+// the other pixel set written by Extents_FS and Reduce_FS: (minX, minY, -maxX, -maxY).
+uniform sampler2D source;
+uniform sampler2D other;
+uniform vec2 size;
+
+// 0 Left, 1 Right, 2 Above, 3 Below
+uniform int relation;
+
+void main()
+{
+	
+	float s = texture2D(source, gl_FragCoord.xy / size).r;
+	vec4 extents = texture2D(other, vec2(0.5, 0.5));
+	vec2 p = floor(gl_FragCoord.xy);
+	
+	// An empty pixel set has no pixels left of it nor below it, while all 
+	// the pixels are right of it and above it
+	bool empty = extents.x >= 1.0e9;
+	bool inside;
+	
+	if (relation == 0)
+		inside = !empty && p.x < extents.x;
+	else if (relation == 1)
+		inside = p.x > -extents.z;
+	else if (relation == 2)
+		inside = p.y > -extents.w;
+	else
+		inside = !empty && p.y < extents.y;
+	
+	float depth = (s > 0.0 && inside) ? s : 0.0;
+	gl_FragColor = vec4(depth, depth, depth, 1.0);
+	
+}
@@ -15,7 +15,12 @@ HEADERS += OgreConsole/OgreConsole.h \
            OgreMax/OgreMaxUtilities.hpp \
            OgreMax/ProgressCalculator.hpp \
            OgreMax/Version.hpp \
+           Operators/DepthRasterizer.h \
+           Operators/GpuPixelSet.h \
            Operators/PixelSet.h \
+           Operators/PixelSetKernels.h \
+           Operators/PixelSetPool.h \
+           Operators/RenderCache.h \
            Operators/Renderer.h \
            Parser/aboveofpixelsetexpression.h \
            Parser/basetype.h \
@@ -25,6 +30,7 @@ HEADERS += OgreConsole/OgreConsole.h \
            Parser/cel_yacc.h \
            Parser/celparser.h \
            Parser/comparisionoperator.h \
+           Parser/compiledexpression.h \
            Parser/conditionaloperator.h \
            Parser/constant.h \
            Parser/count.h \
@@ -63,16 +69,23 @@ SOURCES += OgreConsole/OgreConsole.cpp \
            OgreMax/OgreMaxUtilities.cpp \
            OgreMax/ProgressCalculator.cpp \
            OgreMax/Version.cpp \
+           Operators/DepthRasterizer.cpp \
+           Operators/GpuPixelSet.cpp \
            Operators/PixelSet.cpp \
+           Operators/PixelSetKernels.cpp \
+           Operators/PixelSetPool.cpp \
+           Operators/RenderCache.cpp \
            Operators/Renderer.cpp \
            Parser/basetype.cpp \
            Parser/buffer.cpp \
            Parser/cel_lex.cpp \
            Parser/cel_yacc.cpp \
            Parser/celparser.cpp \
+           Parser/compiledexpression.cpp \
            Parser/expression.cpp \
            Parser/main.cpp \
            Parser/operator.cpp \
+           Parser/pixelsetexpression.cpp \
            Parser/symbol.cpp \
            Parser/symboltable.cpp \
            Parser/target.cpp \